@@ -130,7 +130,7 @@ debug_print_line_text(outputline *ol)
 {
 textblock *tb;
 for (tb = ol->txtblk; tb != NULL; tb = tb->next)
-  debug_print_string(tb->string, tb->length, "");
+  debug_print_string(TBTEXT(tb), tb->length, "");
 debug_printf("\n");
 }
 
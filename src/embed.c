@@ -0,0 +1,1120 @@
+/*************************************************
+*          sdop - Simple DocBook Processor       *
+*************************************************/
+
+/* Copyright (c) Philip Hazel, 2009 */
+
+/* This module contains code for embedding subsets of Type 1 fonts in the
+output. While the pages are being written, set_font() notes each code that is
+printed in each actual font. A font whose program is found in the font
+directory can then be embedded, containing only the glyphs for those codes.
+
+The font program, in PFB or PFA format, is read as a stream. The clear text is
+copied, and the encrypted section is decrypted as it is read and re-encrypted
+as it is written, leaving out the CharStrings entries for glyphs that are not
+wanted. The Subrs are all kept, because any glyph may call any of them. A glyph
+that is built with "seac" needs the two glyphs that it is made from, which may
+come earlier in the font, so the entries for unwanted glyphs that could be used
+in this way (those in the Standard Encoding) are kept in memory until the end
+of the CharStrings, where any that turn out to be needed are written.
+
+If a cache directory is set, each subset is kept there, named by the font and a
+hash of the font file's name, size, and time and of the set of glyphs. A later
+run that needs the same glyphs from the same file copies the subset instead of
+making it again. */
+
+#include "sdop.h"
+
+
+#define EEXEC_KEY        55665     /* Initial key for the encrypted section */
+#define CHARSTRING_KEY   4330      /* Initial key for each charstring */
+#define CRYPT_C1         52845     /* Constants for the encryption */
+#define CRYPT_C2         22719
+
+#define MAXSUBSETGLYPHS  1200      /* Glyph names in one subset */
+#define MAXT1TOKEN       64        /* Longest token that is recognized */
+
+
+/* The state of reading a font program. For a PFB file, the length and type of
+the current segment are kept. The key is for decrypting the encrypted
+section, which is binary in a PFB file and hex in a PFA file. */
+
+typedef struct t1input {
+  FILE   *file;
+  BOOL    pfb;                /* TRUE for PFB format */
+  long    segleft;            /* bytes left in the current PFB segment */
+  int     segtype;            /* type of the current PFB segment */
+  unsigned short int r;       /* decryption key */
+} t1input;
+
+/* The state of writing the encrypted section of a subset, which is always in
+hex (PFA format). */
+
+typedef struct t1output {
+  FILE   *file;
+  int     column;             /* hex digits on the current line */
+  unsigned short int r;       /* encryption key */
+} t1output;
+
+/* A glyph that is wanted in the subset */
+
+typedef struct subsetglyph {
+  uschar *name;
+  BOOL    written;            /* TRUE when it has been written */
+} subsetglyph;
+
+/* An unwanted glyph that may yet be needed by "seac" */
+
+typedef struct heldglyph {
+  struct heldglyph *next;
+  int     length;             /* length of the charstring */
+  uschar *data;               /* the charstring (follows the name) */
+  uschar  name[1];
+} heldglyph;
+
+
+/* The set of glyphs for the font that is being subsetted */
+
+static subsetglyph glyphs[MAXSUBSETGLYPHS];
+static int glyphcount;
+
+/* The tokens that introduce the binary data for a charstring and end its
+definition are defined in each font; they are remembered from the first glyph
+so that held glyphs can be written in the same way. */
+
+static uschar rdtoken[MAXT1TOKEN];
+static uschar ndtoken[MAXT1TOKEN];
+
+/* The names of the glyphs in the two encodings that the PostScript header sets
+up for standardly encoded fonts, read from the header when first needed. */
+
+static uschar *encoding_names[512];
+static BOOL encodings_read = FALSE;
+
+/* The Adobe Standard Encoding, from code 32 onwards. This is needed for the
+glyphs that "seac" uses, which are given by their codes in this encoding. */
+
+static const char *standard_names[] = {
+  "space", "exclam", "quotedbl", "numbersign",                      /*  32 */
+  "dollar", "percent", "ampersand", "quoteright",
+  "parenleft", "parenright", "asterisk", "plus",
+  "comma", "hyphen", "period", "slash",
+  "zero", "one", "two", "three", "four", "five", "six", "seven",     /*  48 */
+  "eight", "nine", "colon", "semicolon",
+  "less", "equal", "greater", "question",
+  "at", "A", "B", "C", "D", "E", "F", "G",                          /*  64 */
+  "H", "I", "J", "K", "L", "M", "N", "O",
+  "P", "Q", "R", "S", "T", "U", "V", "W",                           /*  80 */
+  "X", "Y", "Z", "bracketleft",
+  "backslash", "bracketright", "asciicircum", "underscore",
+  "quoteleft", "a", "b", "c", "d", "e", "f", "g",                   /*  96 */
+  "h", "i", "j", "k", "l", "m", "n", "o",
+  "p", "q", "r", "s", "t", "u", "v", "w",                           /* 112 */
+  "x", "y", "z", "braceleft", "bar", "braceright", "asciitilde", NULL,
+  NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,                   /* 128 */
+  NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+  NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,                   /* 144 */
+  NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+  NULL, "exclamdown", "cent", "sterling",                           /* 160 */
+  "fraction", "yen", "florin", "section",
+  "currency", "quotesingle", "quotedblleft", "guillemotleft",
+  "guilsinglleft", "guilsinglright", "fi", "fl",
+  NULL, "endash", "dagger", "daggerdbl",                            /* 176 */
+  "periodcentered", NULL, "paragraph", "bullet",
+  "quotesinglbase", "quotedblbase", "quotedblright", "guillemotright",
+  "ellipsis", "perthousand", NULL, "questiondown",
+  NULL, "grave", "acute", "circumflex",                             /* 192 */
+  "tilde", "macron", "breve", "dotaccent",
+  "dieresis", NULL, "ring", "cedilla",
+  NULL, "hungarumlaut", "ogonek", "caron",
+  "emdash", NULL, NULL, NULL, NULL, NULL, NULL, NULL,               /* 208 */
+  NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+  NULL, "AE", NULL, "ordfeminine", NULL, NULL, NULL, NULL,          /* 224 */
+  "Lslash", "Oslash", "OE", "ordmasculine", NULL, NULL, NULL, NULL,
+  NULL, "ae", NULL, NULL, NULL, "dotlessi", NULL, NULL,             /* 240 */
+  "lslash", "oslash", "oe", "germandbls", NULL, NULL, NULL, NULL
+};
+
+
+
+/*************************************************
+*          Find the program for a font           *
+*************************************************/
+
+/* Font programs are looked for in the directory set by -F, or in the "fonts"
+subdirectory of the share directories, beside "fontmetrics". A PFB file is
+preferred to a PFA file. A name that is too long for the buffer cannot be the
+font's file, so it is not looked for.
+
+Arguments:
+  name       the font name
+  buffer     where to put the file name, of size FONTFILESIZE
+
+Returns:     TRUE if a font program was found
+*/
+
+BOOL
+embed_find(uschar *name, uschar *buffer)
+{
+int i;
+for (i = 0; i < 2; i++)
+  {
+  const char *suffix = (i == 0)? "pfb" : "pfa";
+  if (font_directory != NULL)
+    {
+    if (snprintf(CS buffer, FONTFILESIZE, "%s/%s.%s", font_directory, name,
+        suffix) < FONTFILESIZE && sys_exists(buffer)) return TRUE;
+    }
+  else
+    {
+    uschar relname[FONTFILESIZE];
+    if (snprintf(CS relname, sizeof(relname), "fonts/%s.%s", name,
+        suffix) < (int)sizeof(relname) &&
+        misc_find_share(relname, buffer, FALSE)) return TRUE;
+    }
+  }
+return FALSE;
+}
+
+
+
+/*************************************************
+*       Read the encodings from the header       *
+*************************************************/
+
+/* The glyph names for the two halves of a standardly encoded font are in the
+LowerEncoding and UpperEncoding vectors in the PostScript header, which is the
+only definition of them that has to be kept in step with the code. Each vector
+is filled by one or more "putinterval" operations.
+
+Argument:   the PostScript header
+Returns:    nothing
+*/
+
+static void
+read_encodings(uschar *header)
+{
+int half;
+
+for (half = 0; half < 2; half++)
+  {
+  const char *vector = (half == 0)? "\nLowerEncoding " : "\nUpperEncoding ";
+  uschar *p = header;
+
+  while ((p = Ustrstr(p, vector)) != NULL)
+    {
+    int n;
+    p += strlen(vector);
+    if (!isdigit(*p)) continue;
+    n = Uatoi(p);
+    while (isdigit(*p) || *p == ' ') p++;
+    if (*p != '[') continue;
+
+    while (*(++p) != ']' && *p != 0 && n < 256)
+      {
+      uschar *s;
+      if (*p != '/') continue;
+      for (s = ++p; *p != 0 && Ustrchr("/] \t\r\n", *p) == NULL; p++);
+      encoding_names[half*256 + n] = misc_malloc(p - s + 1);
+      Ustrncpy(encoding_names[half*256 + n], s, p - s);
+      encoding_names[half*256 + n][p - s] = 0;
+      n++;
+      p--;
+      }
+    }
+  }
+
+encodings_read = TRUE;
+}
+
+
+
+/*************************************************
+*     Read the built-in encoding of a font       *
+*************************************************/
+
+/* For a font that is not standardly encoded, the codes are those of the
+font's own encoding, for which the glyph names are found in its AFM file.
+
+Arguments:
+  af         the font
+  names      a vector of 256 names to fill in
+
+Returns:     nothing
+*/
+
+static void
+read_afm_names(afontstr *af, uschar **names)
+{
+FILE *f;
+uschar line[256];
+uschar filename[256];
+
+(void)sprintf(CS line, "fontmetrics/%s.afm", af->name);
+(void)misc_find_share(line, filename, TRUE);
+f = Ufopen(filename, "rb");
+if (f == NULL)
+  (void)error(0, filename, "font metric file", strerror(errno));   /* Hard */
+
+while (Ufgets(line, sizeof(line), f) != NULL)
+  {
+  int code;
+  uschar *p, *s;
+
+  if (memcmp(line, "C ", 2) != 0) continue;
+  code = Uatoi(line + 2);
+  if (code < 0 || code > 255) continue;
+  p = Ustrstr(line, "; N ");
+  if (p == NULL) continue;
+  for (s = p += 4; *p != 0 && *p != ' ' && *p != ';' && *p != '\n'; p++);
+  names[code] = misc_malloc(p - s + 1);
+  Ustrncpy(names[code], s, p - s);
+  names[code][p - s] = 0;
+  }
+
+(void)fclose(f);
+}
+
+
+
+/*************************************************
+*           Find or add a wanted glyph           *
+*************************************************/
+
+/*
+Arguments:
+  name       the glyph name
+  add        TRUE to add it if it is not already wanted
+
+Returns:     the glyph, or NULL if it is not wanted (and not added)
+*/
+
+static subsetglyph *
+glyph_find(uschar *name, BOOL add)
+{
+int i;
+for (i = 0; i < glyphcount; i++)
+  if (Ustrcmp(glyphs[i].name, name) == 0) return glyphs + i;
+if (!add || glyphcount >= MAXSUBSETGLYPHS) return NULL;
+glyphs[glyphcount].name = name;
+glyphs[glyphcount].written = FALSE;
+return glyphs + glyphcount++;
+}
+
+
+
+/*************************************************
+*       Read the next byte of a font program     *
+*************************************************/
+
+/* In a PFB file, this moves on to the next segment when the current one is
+used up, stopping at a change of segment type.
+
+Argument:   the input state
+Returns:    the byte, or EOF at the end of the segment type
+*/
+
+static int
+t1_getbyte(t1input *in)
+{
+if (in->pfb)
+  {
+  while (in->segleft <= 0)
+    {
+    int type = in->segtype;
+    int i, c;
+    c = fgetc(in->file);
+    if (c != 0x80) return EOF;
+    in->segtype = fgetc(in->file);
+    in->segleft = 0;
+    if (in->segtype == 3) return EOF;      /* End of file has no length */
+    for (i = 0; i < 4; i++)
+      {
+      if ((c = fgetc(in->file)) == EOF) return EOF;
+      in->segleft |= (long)c << (8*i);
+      }
+    if (in->segtype != type) return EOF;
+    }
+  in->segleft--;
+  }
+return fgetc(in->file);
+}
+
+
+
+/*************************************************
+*     Read the next byte of the encrypted part   *
+*************************************************/
+
+/*
+Argument:   the input state
+Returns:    the decrypted byte, or EOF
+*/
+
+static int
+t1_getc(t1input *in)
+{
+int c, plain;
+
+if (in->pfb) c = t1_getbyte(in); else
+  {
+  int i;
+  c = 0;
+  for (i = 0; i < 2; i++)
+    {
+    int x;
+    do x = fgetc(in->file); while (x != EOF && isspace(x));
+    if (x == EOF || !isxdigit(x)) return EOF;
+    c = (c << 4) + (isdigit(x)? x - '0' : tolower(x) - 'a' + 10);
+    }
+  }
+
+if (c == EOF) return EOF;
+plain = c ^ (in->r >> 8);
+in->r = (c + in->r) * CRYPT_C1 + CRYPT_C2;
+return plain;
+}
+
+
+
+/*************************************************
+*      Write a byte of the encrypted part        *
+*************************************************/
+
+/*
+Arguments:
+  out        the output state
+  c          the byte
+
+Returns:     nothing
+*/
+
+static void
+t1_putc(t1output *out, int c)
+{
+int cipher = (c ^ (out->r >> 8)) & 0xff;
+out->r = (cipher + out->r) * CRYPT_C1 + CRYPT_C2;
+(void)fprintf(out->file, "%02x", cipher);
+if ((out->column += 2) >= 64)
+  {
+  (void)fputc('\n', out->file);
+  out->column = 0;
+  }
+}
+
+
+
+/*************************************************
+*     Write bytes to the encrypted part          *
+*************************************************/
+
+/*
+Arguments:
+  out        the output state
+  s          the bytes
+  length     the number of bytes
+
+Returns:     nothing
+*/
+
+static void
+t1_write(t1output *out, uschar *s, int length)
+{
+while (length-- > 0) t1_putc(out, *s++);
+}
+
+
+
+/*************************************************
+*     Write a string to the encrypted part       *
+*************************************************/
+
+/*
+Arguments:
+  out        the output state
+  s          the string
+
+Returns:     nothing
+*/
+
+static void
+t1_puts(t1output *out, uschar *s)
+{
+t1_write(out, s, Ustrlen(s));
+}
+
+
+
+/*************************************************
+*     Read a token from the encrypted part       *
+*************************************************/
+
+/* This is used within the CharStrings dictionary, where tokens are separated
+by white space. Over-long tokens are truncated.
+
+Arguments:
+  in         the input state
+  token      where to put the token (MAXT1TOKEN bytes)
+
+Returns:     the character that ended the token, or EOF
+*/
+
+static int
+t1_token(t1input *in, uschar *token)
+{
+int c;
+int len = 0;
+
+do c = t1_getc(in); while (c != EOF && isspace(c));
+while (c != EOF && !isspace(c))
+  {
+  if (len < MAXT1TOKEN - 1) token[len++] = c;
+  c = t1_getc(in);
+  }
+token[len] = 0;
+return c;
+}
+
+
+
+/*************************************************
+*          Check for a numerical token           *
+*************************************************/
+
+/*
+Arguments:
+  token      the token
+  value      where to put the value
+
+Returns:     TRUE if the token is an integer
+*/
+
+static BOOL
+t1_number(uschar *token, int *value)
+{
+uschar *p = token;
+if (*p == '-') p++;
+if (!isdigit(*p)) return FALSE;
+while (isdigit(*p)) p++;
+if (*p != 0) return FALSE;
+*value = Uatoi(token);
+return TRUE;
+}
+
+
+
+/*************************************************
+*         Find the glyphs used by "seac"         *
+*************************************************/
+
+/* An accented character may be made from two other glyphs by the "seac"
+operator, whose last two operands are their codes in the Standard Encoding.
+The charstring is decrypted and scanned for the operator.
+
+Arguments:
+  data       the charstring
+  length     its length
+  lenIV      the number of random bytes at the start, or -1 if not encrypted
+  bchar      where to put the code of the base character
+  achar      where to put the code of the accent character
+
+Returns:     TRUE if the charstring uses "seac"
+*/
+
+static BOOL
+charstring_seac(uschar *data, int length, int lenIV, int *bchar, int *achar)
+{
+unsigned short int r = CHARSTRING_KEY;
+int stack[24];
+int sp = 0;
+int i;
+BOOL yield = FALSE;
+uschar *s = misc_malloc(length + 1);
+
+for (i = 0; i < length; i++)
+  {
+  if (lenIV < 0) s[i] = data[i]; else
+    {
+    s[i] = data[i] ^ (r >> 8);
+    r = (data[i] + r) * CRYPT_C1 + CRYPT_C2;
+    }
+  }
+
+for (i = (lenIV < 0)? 0 : lenIV; i < length;)
+  {
+  int v = s[i++];
+
+  /* Numbers are pushed on the stack */
+
+  if (v >= 32)
+    {
+    int value;
+    if (v <= 246) value = v - 139;
+    else if (v <= 254)
+      {
+      if (i >= length) break;
+      value = (v <= 250)? (v - 247)*256 + s[i] + 108 :
+        -(v - 251)*256 - s[i] - 108;
+      i++;
+      }
+    else
+      {
+      if (i + 4 > length) break;
+      value = (int)(((unsigned int)s[i] << 24) | (s[i+1] << 16) |
+        (s[i+2] << 8) | s[i+3]);
+      i += 4;
+      }
+    if (sp < 24) stack[sp++] = value;
+    }
+
+  /* "seac" is escape 6; any other operator clears the stack. */
+
+  else
+    {
+    if (v == 12 && i < length && s[i] == 6 && sp >= 5)
+      {
+      *bchar = stack[sp-2];
+      *achar = stack[sp-1];
+      yield = TRUE;
+      break;
+      }
+    if (v == 12) i++;
+    sp = 0;
+    }
+  }
+
+misc_free(s, length + 1);
+return yield;
+}
+
+
+
+/*************************************************
+*           Write a CharStrings entry            *
+*************************************************/
+
+/*
+Arguments:
+  out        the output state
+  name       the glyph name
+  data       the charstring
+  length     its length
+
+Returns:     nothing
+*/
+
+static void
+write_glyph(t1output *out, uschar *name, uschar *data, int length)
+{
+uschar buffer[3*MAXT1TOKEN];
+(void)sprintf(CS buffer, "/%s %d %s ", name, length, rdtoken);
+t1_puts(out, buffer);
+t1_write(out, data, length);
+(void)sprintf(CS buffer, " %s\n", ndtoken);
+t1_puts(out, buffer);
+}
+
+
+
+/*************************************************
+*        Copy the wanted CharStrings entries     *
+*************************************************/
+
+/* This is called after "begin" for the CharStrings dictionary, and returns
+after its "end". Each entry is "/name length RD <binary> ND", where RD and ND
+are defined in the font (often as "-|" and "|-"), and ND may also be written
+out as "noaccess def".
+
+Arguments:
+  in         the input state
+  out        the output state
+  lenIV      the lenIV value for the charstrings
+
+Returns:     NULL if all is well, or an error message
+*/
+
+static uschar *
+subset_charstrings(t1input *in, t1output *out, int lenIV)
+{
+heldglyph *held = NULL;
+uschar *data = NULL;
+uschar *yield = NULL;
+int datasize = 0;
+
+for (;;)
+  {
+  subsetglyph *g;
+  int c, i, length, bchar, achar;
+  uschar name[MAXT1TOKEN];
+  uschar token[MAXT1TOKEN];
+
+  c = t1_token(in, name);
+  if (c == EOF)
+    {
+    yield = US"unexpected end of CharStrings";
+    break;
+    }
+
+  /* At the end, write any held glyphs that turned out to be needed. */
+
+  if (Ustrcmp(name, "end") == 0)
+    {
+    heldglyph *h;
+    for (h = held; h != NULL; h = h->next)
+      {
+      g = glyph_find(h->name, FALSE);
+      if (g == NULL || g->written) continue;
+      write_glyph(out, h->name, h->data, h->length);
+      g->written = TRUE;
+      }
+    t1_puts(out, US"end");
+    t1_putc(out, c);
+    break;
+    }
+
+  /* Read the rest of the entry */
+
+  if (name[0] != '/' || t1_token(in, token) == EOF ||
+      !t1_number(token, &length) || length < 0 ||
+      t1_token(in, rdtoken) != ' ')
+    {
+    yield = US"malformed CharStrings entry";
+    break;
+    }
+
+  if (length > datasize)
+    {
+    if (data != NULL) misc_free(data, datasize);
+    datasize = (length > 1024)? length : 1024;
+    data = misc_malloc(datasize);
+    }
+
+  for (i = 0; i < length; i++)
+    {
+    if ((c = t1_getc(in)) == EOF) break;
+    data[i] = c;
+    }
+
+  if (i < length || t1_token(in, ndtoken) == EOF)
+    {
+    yield = US"unexpected end of CharStrings";
+    break;
+    }
+
+  if (Ustrcmp(ndtoken, "noaccess") == 0)
+    {
+    (void)t1_token(in, token);
+    Ustrcat(ndtoken, " def");
+    }
+
+  /* A wanted glyph is written, and any glyphs that it is built from become
+  wanted. An unwanted glyph that is in the Standard Encoding is held in case
+  it is one of these. */
+
+  g = glyph_find(name + 1, Ustrcmp(name, "/.notdef") == 0);
+  if (g != NULL)
+    {
+    write_glyph(out, name + 1, data, length);
+    g->written = TRUE;
+    if (charstring_seac(data, length, lenIV, &bchar, &achar))
+      {
+      if (bchar >= 32 && bchar < 256 && standard_names[bchar-32] != NULL)
+        (void)glyph_find(US standard_names[bchar-32], TRUE);
+      if (achar >= 32 && achar < 256 && standard_names[achar-32] != NULL)
+        (void)glyph_find(US standard_names[achar-32], TRUE);
+      }
+    }
+
+  else
+    {
+    for (i = 0; i < 224; i++)
+      {
+      if (standard_names[i] != NULL &&
+          Ustrcmp(standard_names[i], name + 1) == 0) break;
+      }
+    if (i < 224)
+      {
+      heldglyph *h = misc_malloc(sizeof(heldglyph) + Ustrlen(name) + length);
+      Ustrcpy(h->name, name + 1);
+      h->data = h->name + Ustrlen(name);
+      memcpy(h->data, data, length);
+      h->length = length;
+      h->next = held;
+      held = h;
+      }
+    }
+  }
+
+/* Free the held glyphs and the buffer */
+
+while (held != NULL)
+  {
+  heldglyph *h = held;
+  held = h->next;
+  misc_free(h, sizeof(heldglyph) + Ustrlen(h->name) + 1 + h->length);
+  }
+if (data != NULL) misc_free(data, datasize);
+return yield;
+}
+
+
+
+/*************************************************
+*        Copy the encrypted part of a font       *
+*************************************************/
+
+/* The decrypted text is scanned for tokens as it is copied. The binary data
+for each Subrs entry, which follows RD or -| and a single space, is copied
+without scanning. The CharStrings dictionary is handed to the function above,
+and the copying ends after "closefile".
+
+Arguments:
+  in         the input state
+  out        the output state
+
+Returns:     NULL if all is well, or an error message
+*/
+
+static uschar *
+subset_private(t1input *in, t1output *out)
+{
+int len = 0;
+int number = -1;
+int lenIV = 4;
+BOOL lenIVnext = FALSE;
+BOOL charstrings = FALSE;
+uschar token[MAXT1TOKEN];
+
+for (;;)
+  {
+  int c = t1_getc(in);
+  if (c == EOF) return US"unexpected end of encrypted section";
+  t1_putc(out, c);
+
+  if (c != 0 && !isspace(c) && Ustrchr("/[]{}()<>", c) == NULL)
+    {
+    if (len < MAXT1TOKEN - 1) token[len++] = c;
+    continue;
+    }
+
+  /* A token has ended */
+
+  if (len > 0)
+    {
+    int value;
+    BOOL isnumber;
+
+    token[len] = 0;
+    len = 0;
+
+    if ((Ustrcmp(token, "RD") == 0 || Ustrcmp(token, "-|") == 0) &&
+        number >= 0 && c == ' ')
+      {
+      while (number-- > 0)
+        {
+        if ((c = t1_getc(in)) == EOF)
+          return US"unexpected end of encrypted section";
+        t1_putc(out, c);
+        }
+      }
+
+    else if (Ustrcmp(token, "closefile") == 0) return NULL;
+
+    else if (charstrings && Ustrcmp(token, "begin") == 0)
+      {
+      uschar *msg = subset_charstrings(in, out, lenIV);
+      if (msg != NULL) return msg;
+      charstrings = FALSE;
+      }
+
+    else if (Ustrcmp(token, "/CharStrings") == 0) charstrings = TRUE;
+
+    isnumber = t1_number(token, &value);
+    if (lenIVnext && isnumber) lenIV = value;
+    lenIVnext = Ustrcmp(token, "/lenIV") == 0;
+    number = (isnumber && value >= 0)? value : -1;
+    }
+
+  if (c == '/') token[len++] = c;
+  }
+}
+
+
+
+/*************************************************
+*            Write a subset of a font            *
+*************************************************/
+
+/* The subset is always written in PFA format.
+
+Arguments:
+  filename   the font program
+  f          where to write the subset
+
+Returns:     NULL if all is well, or an error message
+*/
+
+static uschar *
+subset_font(uschar *filename, FILE *f)
+{
+int c, i;
+BOOL zeros = FALSE;
+uschar *msg = NULL;
+t1input in;
+t1output out;
+uschar line[1024];
+
+in.file = Ufopen(filename, "rb");
+if (in.file == NULL) return US strerror(errno);
+
+c = fgetc(in.file);
+in.pfb = c == 0x80;
+(void)ungetc(c, in.file);
+in.segleft = 0;
+in.segtype = 1;
+
+/* Copy the clear text, which is the first segment of a PFB file, or up to and
+including the line containing "eexec" in a PFA file. */
+
+if (in.pfb)
+  {
+  while ((c = t1_getbyte(&in)) != EOF) (void)fputc(c, f);
+  if (in.segtype != 2) msg = US"no binary segment";
+  }
+else
+  {
+  for (;;)
+    {
+    if (Ufgets(line, sizeof(line), in.file) == NULL)
+      {
+      msg = US"no encrypted section";
+      break;
+      }
+    (void)fputs(CS line, f);
+    if (Ustrstr(line, "eexec") != NULL) break;
+    }
+  }
+
+/* The first four bytes of the encrypted section are random. Write zeros in
+their place, so that the subset is the same every time. */
+
+if (msg == NULL)
+  {
+  in.r = EEXEC_KEY;
+  out.file = f;
+  out.r = EEXEC_KEY;
+  out.column = 0;
+
+  for (i = 0; i < 4; i++)
+    {
+    (void)t1_getc(&in);
+    t1_putc(&out, 0);
+    }
+  msg = subset_private(&in, &out);
+  t1_putc(&out, '\n');
+  if (out.column > 0) (void)fputc('\n', f);
+  }
+
+/* Copy the trailer (512 zeros and "cleartomark"), skipping whatever follows
+"closefile" in the encrypted section. In a PFB file, this is the rest of the
+binary segments; in a PFA file, it is everything before the first line of
+zeros. */
+
+if (msg == NULL && in.pfb)
+  {
+  while (t1_getbyte(&in) != EOF);
+  if (in.segtype == 1)
+    {
+    int last = '\n';
+    while ((c = t1_getbyte(&in)) != EOF) (void)fputc(last = c, f);
+    c = last;
+    }
+  if (in.segtype != 3) msg = US"no trailer segment";
+  }
+
+else if (msg == NULL)
+  {
+  while (Ufgets(line, sizeof(line), in.file) != NULL)
+    {
+    if (!zeros)
+      {
+      uschar *p;
+      for (p = line; *p == '0'; p++);
+      if (p - line < 32 || (*p != 0 && !isspace(*p))) continue;
+      zeros = TRUE;
+      }
+    (void)fputs(CS line, f);
+    c = line[Ustrlen(line) - 1];
+    }
+  if (!zeros) msg = US"no trailer";
+  }
+
+/* Make sure that the subset ends with a newline. */
+
+if (msg == NULL && c != '\n') (void)fputc('\n', f);
+
+(void)fclose(in.file);
+return msg;
+}
+
+
+
+/*************************************************
+*       Hash the identity of a font subset       *
+*************************************************/
+
+/* Two 32-bit FNV-1a hashes with different primes are computed over the font
+file's name, size, and time, and the names of the wanted glyphs.
+
+Arguments:
+  filename   the font program
+  buffer     where to put the hash, as 16 hex digits
+
+Returns:     nothing
+*/
+
+static void
+subset_hash(uschar *filename, uschar *buffer)
+{
+unsigned int h1 = 2166136261u;
+unsigned int h2 = 2166136261u;
+int i;
+long size, mtime;
+uschar stamp[64];
+
+if (!sys_filestamp(filename, &size, &mtime)) size = mtime = 0;
+(void)sprintf(CS stamp, "%ld %ld", size, mtime);
+
+for (i = -2; i < glyphcount; i++)
+  {
+  uschar *s = (i == -2)? filename : (i == -1)? stamp : glyphs[i].name;
+  do
+    {
+    h1 = (h1 ^ *s) * 16777619u;
+    h2 = (h2 ^ *s) * 16777633u;
+    }
+  while (*s++ != 0);
+  }
+
+(void)sprintf(CS buffer, "%08x%08x", h1, h2);
+}
+
+
+
+/*************************************************
+*           Make a subset of a font              *
+*************************************************/
+
+/* This is called from write_file() for each actual font, once the pages have
+been written. If the font's program can be found, the glyphs for the codes
+that were printed are found, and a subset containing them (and .notdef) is
+either found in the cache or made. If anything goes wrong, a warning is given
+and the font is not embedded.
+
+Arguments:
+  af         the font, with the codes that were printed
+  header     the PostScript header, for the encodings
+
+Returns:     an open file containing the subset, at its start,
+             or NULL if the font is not to be embedded
+*/
+
+FILE *
+embed_subset(afontstr *af, uschar *header)
+{
+FILE *f = NULL;
+int n;
+uschar *msg;
+uschar *afmnames[256];
+uschar fontfile[FONTFILESIZE];
+uschar cachefile[FONTFILESIZE];
+uschar tempfile[FONTFILESIZE + 24];
+
+if (!embed_find(af->name, fontfile)) return NULL;
+
+/* Find the names of the wanted glyphs */
+
+if (af->stdencoding)
+  {
+  if (!encodings_read) read_encodings(header);
+  }
+else
+  {
+  for (n = 0; n < 256; n++) afmnames[n] = NULL;
+  read_afm_names(af, afmnames);
+  }
+
+glyphcount = 0;
+(void)glyph_find(US".notdef", TRUE);
+
+for (n = 0; n < 512; n++)
+  {
+  uschar *name;
+  if ((af->glyphs[n >> 5] & (1u << (n & 31))) == 0) continue;
+  name = af->stdencoding? encoding_names[n] : afmnames[n & 255];
+  if (name != NULL) (void)glyph_find(name, TRUE);
+  }
+
+DEBUG(D_fontload) debug_printf("Subsetting %s from %s: %d glyphs\n",
+  af->name, fontfile, glyphcount);
+
+/* Look in the cache, if there is one. If the subset is there, there is
+nothing more to do. Otherwise, it is written to a temporary name, and renamed
+when it is complete, so that it is never seen half written. The length of the
+-Fc path is checked when it is given, but a long font name could still make a
+name that does not fit. */
+
+tempfile[0] = 0;
+if (font_cache != NULL)
+  {
+  uschar hash[20];
+  subset_hash(fontfile, hash);
+  if (snprintf(CS cachefile, sizeof(cachefile), "%s/%s-%s.pfa", font_cache,
+      af->name, hash) >= (int)sizeof(cachefile))
+    {
+    (void)error(110, fontfile, "cache file name too long", af->name);
+    return NULL;
+    }
+  f = Ufopen(cachefile, "rb");
+  if (f != NULL)
+    {
+    DEBUG(D_fontload) debug_printf("Using cached subset %s\n", cachefile);
+    stats.fonts_cached++;
+    stats.fonts_embedded++;
+    return f;
+    }
+  (void)snprintf(CS tempfile, sizeof(tempfile), "%s.%d", cachefile,
+    sys_pid());
+  f = Ufopen(tempfile, "w+b");
+  if (f == NULL) tempfile[0] = 0;
+  }
+
+if (f == NULL)
+  {
+  f = tmpfile();
+  if (f == NULL)
+    (void)error(0, US"(temporary)", "font subset", strerror(errno)); /* Hard */
+  }
+
+msg = subset_font(fontfile, f);
+
+if (msg != NULL)
+  {
+  (void)error(110, fontfile, msg, af->name);
+  (void)fclose(f);
+  if (tempfile[0] != 0) (void)remove(CS tempfile);
+  return NULL;
+  }
+
+if (tempfile[0] != 0)
+  {
+  (void)fflush(f);
+  if (rename(CS tempfile, CS cachefile) != 0) (void)remove(CS tempfile);
+  }
+
+stats.fonts_embedded++;
+rewind(f);
+return f;
+}
+
+/* End of embed.c */
@@ -38,16 +38,16 @@ tree_node *tn;
 entity_block *bot, *mid, *top;
 ventity_block *vbot, *vmid, *vtop;
 
-/* Search the tree of dynamic entities. */
+/* Search the table of dynamic entities. */
 
-tn = tree_search(entity_tree, attname);
+tn = hash_search(entity_table, attname);
 if (tn != NULL)
   {
   *vptr = tn->data.ptr;
   return;
   }
 
-/* Not found in tree; search the static list by binary chop. A replacement
+/* Not found in table; search the static list by binary chop. A replacement
 that starts with "&#x" is re-interpreted as a hex character. */
 
 bot = entity_list;
@@ -104,15 +104,69 @@ return;
 
 
 
+/*************************************************
+*     Check for an entity with a variable value  *
+*************************************************/
+
+/* The values of the entities in the variable list come from the <bookinfo>
+element and from global processing instructions, so they are not known while
+the input is being read. This function is called from the reader when it meets
+an ifdef or ifndef processing instruction, to find out whether the condition
+can be decided there and then. A name that is found in the table of dynamic
+entities or in the static list is not variable, because it is found there first
+by entity_find_byname().
+
+Argument:   the entity name
+Returns:    TRUE if the name is that of a variable entity
+*/
+
+BOOL
+entity_is_variable(uschar *name)
+{
+entity_block *bot, *mid, *top;
+ventity_block *vbot, *vmid, *vtop;
+
+if (hash_search(entity_table, name) != NULL) return FALSE;
+
+bot = entity_list;
+top = entity_list + entity_list_count;
+
+while (top > bot)
+  {
+  int c;
+  mid = bot + (top - bot)/2;
+  c = Ustrcmp(mid->name, name);
+  if (c == 0) return FALSE;
+  if (c < 0) bot = mid + 1; else top = mid;
+  }
+
+vbot = ventity_list;
+vtop = ventity_list + ventity_list_count;
+
+while (vtop > vbot)
+  {
+  int c;
+  vmid = vbot + (vtop - vbot)/2;
+  c = Ustrcmp(vmid->name, name);
+  if (c == 0) return TRUE;
+  if (c < 0) vbot = vmid + 1; else vtop = vmid;
+  }
+
+return FALSE;
+}
+
+
+
 /*************************************************
 *             Find one entity value              *
 *************************************************/
 
 /* This function is called from entity_expand_one() when an & character is
-encountered. It reads the entity and finds its value. Because each line is
-processed twice - the first time to find out the size of the expanded line, the
-second to do the deed - this function is called twice for each entity. To avoid
-duplicating error messages, an argument indicates which pass is in progress.
+encountered. It reads the entity and finds its value. Some callers process a
+string twice - the first time to find out the size of the expanded string, the
+second to do the deed - and so call this function twice for each entity. To
+avoid duplicating error messages, an argument indicates which pass is in
+progress.
 
 This function is also called from toc_make() when creating strings from chapter
 and section titles for use in pdfmark items. It is also called when creating
@@ -172,8 +226,8 @@ if (*p == '#')
   }
 
 /* Handle named entities. Some may be defined in the document - they are put
-into a tree. There are also two built-in lists - one for static values, and one
-for variables. */
+into a hash table. There are also two built-in lists - one for static values,
+and one for variables. */
 
 pn = p;
 
@@ -210,15 +264,51 @@ return p;
 }
 
 
+/*************************************************
+*        Ensure expansion buffer is big enough   *
+*************************************************/
+
+/* The buffer used for expanding entities is kept between calls, and enlarged
+by doubling when necessary.
+
+Arguments:
+  needed     the number of bytes required
+  used       the number of bytes already in use, which must be preserved
+
+Returns:     nothing
+*/
+
+static uschar *expand_buffer = NULL;
+static int expand_buffer_size = 0;
+
+static void
+expand_buffer_ensure(int needed, int used)
+{
+uschar *newbuffer;
+int newsize = (expand_buffer_size == 0)? 1024 : 2*expand_buffer_size;
+if (needed <= expand_buffer_size) return;
+while (newsize < needed) newsize *= 2;
+newbuffer = misc_malloc(newsize);
+if (used > 0) memcpy(newbuffer, expand_buffer, used);
+if (expand_buffer != NULL) misc_free(expand_buffer, expand_buffer_size);
+expand_buffer = newbuffer;
+expand_buffer_size = newsize;
+}
+
+
+
 /*************************************************
 *           Expand entities in a string          *
 *************************************************/
 
 /* This function goes through a string, expanding any entities that are
-encoded as &name; or &#number; or &#xhexnumber; and if necessary, moving the
-string to a new memory block. It scans each string twice; the first pass finds
-out how much memory is needed. If necessary, the string is moved to a new
-block. In practice, this should be fairly rare.
+encoded as &name; or &#number; or &#xhexnumber;. Strings without any &
+characters, which are the vast majority, are recognized by a single memchr()
+and left alone. Otherwise, the string is expanded in a single forward pass into
+a working buffer, which is kept between calls and enlarged as necessary. If the
+result fits in the original text block (the usual case, because most entities
+are longer than their values) it is copied back; otherwise the text block is
+replaced by a new one.
 
 Argument:    the anchor of the text block
 Returns:     TRUE if OK, FALSE on error
@@ -229,64 +319,63 @@ but we always continue. */
 static BOOL
 entity_expand_one(textblock **tbanchor)
 {
-BOOL found = FALSE;
 textblock *tb = *tbanchor;
-uschar *p, *stringend;
-int spare = 0;
+uschar *p = tb->string;
+uschar *pend = p + tb->length;
+uschar *amp = memchr(p, '&', tb->length);
+int used = 0;
+
+if (amp == NULL) return TRUE;
 
-/* First pass: Scan the string for & characters, and compute the number of
-spare bytes we will have after conversion. */
+/* Loop for each entity; at the top of the loop amp points to the next '&' in
+the string. The data before it is copied, followed by the entity's value. The
+buffer is enlarged if necessary so that it can always hold the rest of the
+string as it stands. */
 
-for (p = tb->string; *p != 0;)
+for (;;)
   {
+  int len, nlen;
   uschar *value;
-  uschar *pp = p;
-  if (*p++ != '&') continue;
-  found = TRUE;
-  p = entity_find(p, &value, FALSE, US"");
-  spare += p - pp - Ustrlen(value);
+
+  len = amp - p;
+  expand_buffer_ensure(used + (pend - p) + 1, used);
+  memcpy(expand_buffer + used, p, len);
+  used += len;
+  p = entity_find(amp + 1, &value, FALSE, US"");
+
+  /* Ensure there is room for the value as well as the rest of the string. */
+
+  nlen = Ustrlen(value);
+  expand_buffer_ensure(used + nlen + (pend - p) + 1, used);
+  memcpy(expand_buffer + used, value, nlen);
+  used += nlen;
+
+  amp = memchr(p, '&', pend - p);
+  if (amp == NULL) break;
   }
 
-/* We can skip the second pass if no '&' characters were found. */
+/* Copy the tail of the string, including the terminating zero. */
 
-if (!found) return TRUE;
+memcpy(expand_buffer + used, p, pend - p + 1);
+used += pend - p;
 
-/* If we have a negative number of spare bytes, we need to get a new chunk
-of memory and copy the text block into it so that it can be expanded. */
+/* If the expanded string is longer than the original, we need to get a new
+chunk of memory for the text block. */
 
-if (spare < 0)
+if (used > tb->length)
   {
-  textblock *newtb = misc_malloc(sizeof(textblock) + tb->length - spare);
+  textblock *newtb = misc_malloc(sizeof(textblock) + used);
   newtb->next = tb->next;    /* At this stage, will in fact always be NULL */
   newtb->vfont = tb->vfont;
   newtb->pin_flags = tb->pin_flags;
   newtb->colour = tb->colour;
-  newtb->length = tb->length;
-  memcpy(newtb->string, tb->string, tb->length + 1);
   *tbanchor = newtb;
   misc_free(tb, sizeof(textblock) + tb->length);
   tb = newtb;
   }
 
-/* At this point we know we have enough space in the string buffer to do the
-expansions. */
-
-stringend = tb->string + tb->length;
-for (p = tb->string; *p != 0;)
-  {
-  int nlen;
-  uschar *value;
-  uschar *pp = p;
-  if (*p++ != '&') continue;
-  p = entity_find(p, &value, TRUE, US"");
-  nlen = Ustrlen(value);
-  memmove(pp + nlen, p, stringend - p + 1);
-  stringend += nlen - (p - pp);
-  tb->length += nlen - (p - pp);
-  Ustrncpy(pp, value, nlen);
-  p = pp + nlen;
-  }
-
+memcpy(tb->string, expand_buffer, used + 1);
+tb->length = used;
 return TRUE;
 }
 
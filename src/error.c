@@ -72,7 +72,7 @@ static error_struct error_data[] = {
 { ec_disaster, "unexpected EOF inside element (started on input line %d)" },
 /* 25-29 */
 { ec_warning,  "line overflow (%spt)" },
-{ ec_warning,  "internal error: page %d is too long: new page started" },
+{ ec_warning,  "internal error: page %s is too long: new page started" },
 { ec_disaster, "error loading metric data for font '%s': %s" },
 { ec_disaster, "internal error: special auxiliary font missing" },
 { ec_disaster, "internal error: substitute character not found" },
@@ -177,10 +177,13 @@ static error_struct error_data[] = {
 { ec_serious,  "subscript_down or superscript_up value is too large" },
 { ec_serious,  "\"yes\" or \"no\" expected but \"%s\" found" },
 { ec_warning,  "page_full_length=%s is too small; set to 108" },
-{ ec_disaster, "error while processing PNG file: %s" }
+{ ec_disaster, "error while processing PNG file: %s" },
+/* 110 */
+{ ec_warning,  "font file %s could not be subsetted (%s): font \"%s\" not "
+               "embedded" }
 };
 
-#define error_maxerror 109
+#define error_maxerror 110
 
 
 
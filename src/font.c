@@ -9,6 +9,12 @@
 #include "sdop.h"
 
 
+/* Fonts whose tables are loaded when the render server starts up. The tables
+are shared by the afonts that are set up for each job. */
+
+static afontstr *afont_cache = NULL;
+
+
 
 
 /*************************************************
@@ -65,6 +71,38 @@ return ka->pair - kb->pair;
 
 
 
+/*************************************************
+*          Look up a pair in a kern table        *
+*************************************************/
+
+/*
+Arguments:
+  af        points to a font structure
+  pair      the two characters, as (first << 16) | second
+
+Returns:    the unscaled kern value, or 0
+*/
+
+static int
+kern_lookup(afontstr *af, unsigned int pair)
+{
+int bot = 0;
+int top = af->kerncount;
+
+while (top > bot)
+  {
+  kerntablestr *k;
+  int mid = (top + bot)/2;
+  k = &(af->kerns[mid]);
+  if (pair == k->pair) return k->kwidth;
+  if (pair > k->pair) bot = mid + 1; else top = mid;
+  }
+
+return 0;
+}
+
+
+
 /*************************************************
 *          Number reader from AFM files          *
 *************************************************/
@@ -101,6 +139,7 @@ static void
 font_loadtables(afontstr *af)
 {
 FILE *f;
+afontstr *cf;
 kerntablestr *kerntable;
 int i;
 int kerncount = 0;
@@ -112,6 +151,25 @@ uschar line[256];
 
 if (af->widths != NULL) return;    /* We have seen this afont before */
 
+/* If the tables were preloaded, just point to them. They are never changed
+once they have been loaded. */
+
+for (cf = afont_cache; cf != NULL; cf = cf->next)
+  {
+  if (Ustrcmp(cf->name, af->name) != 0) continue;
+  DEBUG(D_fontload) debug_printf("Using preloaded metrics for %s\n", af->name);
+  af->widths = cf->widths;
+  af->widths_table = cf->widths_table;
+  af->kerns = cf->kerns;
+  af->kerncount = cf->kerncount;
+  af->asciikerns = cf->asciikerns;
+  af->asciiwidth = cf->asciiwidth;
+  af->stdencoding = cf->stdencoding;
+  af->fixedpitch = cf->fixedpitch;
+  af->hasfi = cf->hasfi;
+  return;
+  }
+
 sprintf(CS line, "fontmetrics/%s.afm", af->name);
 (void)misc_find_share(line, filename, TRUE);
 f = Ufopen(filename, "rb");
@@ -194,14 +252,22 @@ for (;;)
 
   if (code < LOWCHARLIMIT) widths[code] = width; else
     {
-    tree_node *tc = misc_malloc(sizeof(tree_node) + 6);
-    tc->name[misc_ord2utf8(code, tc->name)] = 0;
-    tc->data.val[0] = width;
-    tc->data.val[1] = poffset;
-    (void)tree_insertnode(&(af->widths_tree), tc);
+    code_node *cn = hash_code_insert(&(af->widths_table), code);
+    cn->val[0] = width;
+    cn->val[1] = poffset;
     }
   }
 
+/* For a fixed pitch font, remember the width of the printing ASCII characters
+if they all have the same width, so that runs of them can be measured quickly
+(see para_get_next_line()). */
+
+if (af->fixedpitch)
+  {
+  for (i = 0x21; i < 0x7f; i++) if (widths[i] != widths[0x21]) break;
+  if (i >= 0x7f) af->asciiwidth = widths[0x21];
+  }
+
 /* Process kerning data (if any); when this is done, we are finished with the
 AFM file. */
 
@@ -282,6 +348,16 @@ while (kerncount--)
 af->kerncount = finalcount;  /* true count */
 qsort(kerntable, af->kerncount, sizeof(kerntablestr), table_cmp);
 
+/* Make a dense table of the kerns between ASCII characters, which are by far
+the most common, so that they can be found without a search. */
+
+if (af->kerncount > 0)
+  {
+  af->asciikerns = misc_malloc(128 * 128 * sizeof(short int));
+  for (i = 0; i < 128 * 128; i++)
+    af->asciikerns[i] = kern_lookup(af, ((i >> 7) << 16) | (i & 127));
+  }
+
 (void)fclose(f);
 DEBUG(D_fontload) debug_printf("Loaded\n");
 
@@ -299,14 +375,8 @@ debug_printf("FONT %s\n", af->name);
 
   for (i = LOWCHARLIMIT; i < 0xffff; i++)
     {
-    tree_node *t;
-    uschar key[4];
-    key[0] = (i >> 8) & 255;
-    key[1] = i & 255;
-    key[2] = 0;
-    t = tree_search(af->widths_tree, key);
-    if (t != NULL) debug_printf("%04x %5d %5d\n", i, t->data.val[0],
-      t->data.val[1]);
+    code_node *cn = hash_code_search(af->widths_table, i);
+    if (cn != NULL) debug_printf("%04x %5d %5d\n", i, cn->val[0], cn->val[1]);
     }
 
   debug_printf("KERNS %d\n", af->kerncount);
@@ -323,6 +393,66 @@ debug_printf("FONT %s\n", af->name);
 
 
 
+/*************************************************
+*        Preload tables for the usual fonts      *
+*************************************************/
+
+/* This function is called when the render server starts up. It loads the
+tables for the default serif, sans-serif, and monospaced families, and for
+the special fonts, into a private list. When a job later sets up an afont
+with one of these names, font_loadtables() uses the preloaded tables.
+
+Arguments:   none
+Returns:     TRUE
+*/
+
+BOOL
+font_preload(void)
+{
+int i, j;
+uschar namebuffer[64];
+
+for (i = 0; i < FFAM_SPECIAL + 2; i++)
+  {
+  for (j = 0; j < 4; j++)
+    {
+    afontstr *af;
+
+    if (i < FFAM_SPECIAL)
+      {
+      fontsuffixstr *fs;
+      for (fs = fontsuffixes; fs->familyname != NULL; fs++)
+        { if (Ustrcmp(type_families[i], fs->familyname) == 0) break; }
+      if (fs->familyname == NULL) (void)error(23, type_families[i]);
+      sprintf(CS namebuffer, "%s%s", type_families[i], fs->suffixes[j]);
+      }
+    else if (j == 0) Ustrcpy(namebuffer, sfontname[i - FFAM_SPECIAL]);
+    else break;
+
+    af = misc_malloc(sizeof(afontstr) + Ustrlen(namebuffer));
+    Ustrcpy(af->name, namebuffer);
+    af->widths = NULL;
+    af->widths_table = NULL;
+    af->kerns = NULL;
+    af->kerncount = 0;
+    af->asciikerns = NULL;
+    af->asciiwidth = WIDTH_UNKNOWN;
+    af->psnumber = -1;
+    (void)memset(af->glyphs, 0, sizeof(af->glyphs));
+    af->stdencoding = FALSE;
+    af->fixedpitch = FALSE;
+    af->hasfi = FALSE;
+    font_loadtables(af);
+    af->next = afont_cache;
+    afont_cache = af;
+    }
+  }
+
+return TRUE;
+}
+
+
+
 /*************************************************
 *         Load tables for all used fonts         *
 *************************************************/
@@ -365,12 +495,12 @@ Returns:         the width, zero for unknown characters
 int
 font_charwidth(int c, vfontstr *vf, int *chtype)
 {
-uschar utf[8];
 int top, bot, which;
-tree_node *t;
+code_node *cn;
 u2sencod *u2s;
 afontstr *af = vf->afont;
 
+stats.charwidth_calls++;
 if (chtype != NULL) *chtype = CHTYPE_STD;
 
 /* The zero-width space and the break-permitting chars do not appear in any
@@ -394,12 +524,11 @@ if (c < LOWCHARLIMIT)
   return MUL(w, vf->size);
   }
 
-/* The remainder have their widths in a tree, keyed on the UTF-8 encoding of
-the character. */
+/* The remainder have their widths in a hash table, keyed on the code point. */
 
-utf[misc_ord2utf8(c, utf)] = 0;
-t = tree_search(af->widths_tree, utf);
-if (t != NULL) return MUL(t->data.val[0], vf->size);
+stats.charwidth_slow++;
+cn = hash_code_search(af->widths_table, c);
+if (cn != NULL) return MUL(cn->val[0], vf->size);
 
 /* We have a character that is not available in the current font. Look in the
 table that lists characters in the special fonts. */
@@ -447,10 +576,13 @@ if (vf->sfont[which] == NULL)
     Ustrcpy(af->name, fontname);
     af->next = NULL;
     af->widths = NULL;
-    af->widths_tree = NULL;
+    af->widths_table = NULL;
     af->kerns = NULL;
     af->kerncount = 0;
+    af->asciikerns = NULL;
+    af->asciiwidth = WIDTH_UNKNOWN;
     af->psnumber = -1;
+    (void)memset(af->glyphs, 0, sizeof(af->glyphs));
     af->stdencoding = FALSE;
     af->fixedpitch = FALSE;
     af->hasfi = FALSE;
@@ -471,6 +603,7 @@ if (vf->sfont[which] == NULL)
   if (avf == NULL)
     {
     avf = misc_malloc(sizeof(vfontstr));
+    avf->pnumber = (vfont_last == NULL)? 0 : vfont_last->pnumber + 2;
     if (vfont_last == NULL) vfont_list = avf; else vfont_last->next = avf;
     vfont_last = avf;
     avf->next = NULL;
@@ -478,7 +611,6 @@ if (vf->sfont[which] == NULL)
     avf->type = FTYPE_SPECIAL;
     avf->size = vf->size;
     avf->leading = vf->leading;
-    avf->pnumber = -1;
     avf->afont = af;
     memset(avf->sfont, 0, sizeof(avf->sfont));
     }
@@ -525,6 +657,60 @@ return width;
 
 
 
+/*************************************************
+*     Find the widths of a string's prefixes     *
+*************************************************/
+
+/* This function measures a string once, recording the width of each of its
+leading substrings, so that a caller that needs the widths of several of them
+(for example, when trying different hyphenation points in a word) can look
+them up instead of measuring again from the start. If kerning is requested,
+the kern between each pair of characters is included, as it is when lines are
+filled. Unknown characters have no width, as in font_stringwidth().
+
+Arguments:
+  s              the string
+  length         its length in bytes
+  vf             pointer to a vfont structure
+  kerning        TRUE if kerns are to be included
+  widths         if not NULL, widths[n] is set to the width of the first n
+                   bytes, for each n that is at the end of a character; there
+                   must be room for length + 1 values
+
+Returns:         the width of the whole string
+*/
+
+int
+font_widthindex(uschar *s, int length, vfontstr *vf, BOOL kerning,
+  int *widths)
+{
+int width = 0;
+int lastc = -1;
+uschar *start = s;
+uschar *end = s + length;
+
+if (widths != NULL) widths[0] = 0;
+while (s < end)
+  {
+  int c, chtype;
+  GETCHARINC(c, s);
+  width += font_charwidth(c, vf, &chtype);
+  if (kerning)
+    {
+    if (chtype == CHTYPE_STD && c != ' ')
+      {
+      width += font_kernwidth(lastc, c, vf);
+      lastc = c;
+      }
+    else lastc = -1;
+    }
+  if (widths != NULL) widths[s - start] = width;
+  }
+return width;
+}
+
+
+
 /*************************************************
 *      Find the kern between two characters      *
 *************************************************/
@@ -544,27 +730,13 @@ Returns:        a kern value, or 0
 int
 font_kernwidth(int lastc, int c, vfontstr *vf)
 {
-unsigned int pair;
-int top, bot, mid;
 afontstr *af = vf->afont;
 
+stats.kernwidth_calls++;
 if (lastc < 0 || lastc > 0xffff || c > 0xffff) return 0;
-
-pair = (lastc << 16) | c;
-
-bot = 0;
-top = af->kerncount;
-
-while (top > bot)
-  {
-  kerntablestr *k;
-  mid = (top + bot)/2;
-  k = &(af->kerns[mid]);
-  if (pair == k->pair) return MUL(k->kwidth, vf->size);
-  if (pair > k->pair) bot = mid + 1; else top = mid;
-  }
-
-return 0;
+if (lastc < 128 && c < 128 && af->asciikerns != NULL)
+  return MUL(af->asciikerns[(lastc << 7) | c], vf->size);
+return MUL(kern_lookup(af, (lastc << 16) | c), vf->size);
 }
 
 
@@ -608,8 +780,12 @@ for (ovf = vfont_list; ovf != NULL; ovf = ovf->next)
     return ovf;
   }
 
-/* New vfont; add to the chain of vfonts that are actually used. */
+/* New vfont; add to the chain of vfonts that are actually used. Each vfont
+has two PostScript font numbers, allocated in chain order. They are set here
+rather than when the setup is written, because streamed pages are written
+before all the fonts are known. */
 
+vf->pnumber = (vfont_last == NULL)? 0 : vfont_last->pnumber + 2;
 if (vfont_last == NULL) vfont_list = vf; else vfont_last->next = vf;
 vfont_last = vf;
 vf->next = NULL;
@@ -645,10 +821,13 @@ afont_last = af;
 Ustrcpy(af->name, fontname);
 af->next = NULL;
 af->widths = NULL;
-af->widths_tree = NULL;
+af->widths_table = NULL;
 af->kerns = NULL;
 af->kerncount = 0;
+af->asciikerns = NULL;
+af->asciiwidth = WIDTH_UNKNOWN;
 af->psnumber = -1;
+(void)memset(af->glyphs, 0, sizeof(af->glyphs));
 af->stdencoding = FALSE;
 af->fixedpitch = FALSE;
 af->hasfi = FALSE;
@@ -985,7 +1164,7 @@ for (i = item_list; i != NULL; i = i->next)
     else if (Ustrncmp(pm->value, "rgb=", 4) == 0)
       {
       int c[3];
-      if (misc_get_colour(pm->value+4, &c[0]))
+      if (misc_get_colour(pm->value+4, &c[0], TRUE))
         fontcolour = (c[0] << 20) | (c[1] << 10) | c[2];
       }
 
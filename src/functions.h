@@ -10,13 +10,16 @@ ones. */
 #if SUPPORT_JPEG
 extern int           read_JPEG_file(FILE *, BOOL, void *);
 extern void          give_jpeg_image_data(int, int, int);
-extern void          put_scanline_someplace(uschar *, int, void *);
 #endif
 
 #if SUPPORT_PNG
-extern int           read_PNG_file(FILE *, uschar **);
+extern int           read_PNG_file(FILE *, BOOL, uschar **);
 extern void          give_png_image_data(int, int, int);
-extern void          write_png_data(FILE *);
+extern void          write_png_data(void *);
+#endif
+
+#if SUPPORT_JPEG || SUPPORT_PNG
+extern void          put_scanline_someplace(uschar *, int, void *);
 #endif
 
 extern BOOL          book_getdata(item *);
@@ -29,22 +32,34 @@ extern void          debug_print_line_text(outputline *);
 extern void          debug_print_para(item *, item *, char *v);
 extern void          debug_print_string(uschar *, int, char *);
 
+extern BOOL          embed_find(uschar *, uschar *);
+extern FILE         *embed_subset(afontstr *, uschar *);
 extern BOOL          entity_expand(item *);
 extern uschar       *entity_find(uschar *, uschar **, BOOL, uschar *);
 extern void          entity_find_byname(uschar *, uschar **, BOOL, uschar *);
+extern BOOL          entity_is_variable(uschar *);
 extern BOOL          error(int, ...);
 
 extern BOOL          font_assign(item *, int);
 extern int           font_charwidth(int, vfontstr *, int *);
 extern int           font_kernwidth(int, int, vfontstr *);
 extern BOOL          font_loadalltables(void);
+extern BOOL          font_preload(void);
 extern int           font_stringwidth(uschar *, vfontstr *);
+extern int           font_widthindex(uschar *, int, vfontstr *, BOOL, int *);
 extern vfontstr     *font_used(vfontstr *, uschar *);
 
 extern void          footnote_insert_reference(item *, unsigned int);
 extern BOOL          footnote_insert_keys(item *);
 extern void          footnote_remove_newline(item *);
 
+extern code_node    *hash_code_insert(code_table **, int);
+extern code_node    *hash_code_search(code_table *, int);
+extern int           hash_insertnode(hash_table **, tree_node *);
+extern tree_node    *hash_search(hash_table *, uschar *);
+extern tree_node   **hash_sorted(hash_table *, int *);
+
+extern void          index_init_collation(void);
 extern BOOL          index_make(item *, item *);
 
 extern int           misc_alpha(uschar *, int);
@@ -54,13 +69,14 @@ extern BOOL          misc_find_share(uschar *, uschar *, BOOL);
 extern lengthstring *misc_find_title(item *, uschar *);
 extern char         *misc_formatfixed(int);    /* char * is deliberate */
 extern void          misc_free(void *, int);
-extern BOOL          misc_get_colour(uschar *, int *);
+extern BOOL          misc_get_colour(uschar *, int *, BOOL);
 extern int           misc_get_fp(uschar *, uschar **);
 extern int           misc_get_dimension(uschar *);
 extern BOOL          misc_get_dimensions(int, uschar *, int *, BOOL);
 extern int           misc_get_number(uschar *);
 extern item         *misc_insert_element_pair(uschar *, item *);
 extern void          misc_insert_item(item *, item *);
+extern BOOL          misc_is_stream_boundary(item *);
 extern BOOL          misc_istext_elname(uschar *);
 extern void         *misc_malloc(int);
 extern int           misc_ord2utf8(int, uschar *);
@@ -72,6 +88,7 @@ extern BOOL          misc_yesno_vector(item *, uschar *, BOOL *, int);
 extern BOOL          number_titles(item *);
 
 extern int           object_find_size(item *, int *);
+extern BOOL          object_prefetch(item *);
 extern int           object_write_image(item *, int, FILE *, int *, int *);
 
 extern BOOL          page_format(item *, item **, BOOL, BOOL, int *, uschar *);
@@ -83,6 +100,7 @@ extern void          pin_change_font_assign(item *);
 extern void          pin_change_layparm(item *);
 extern void          pin_change_olformat(item *);
 extern BOOL          pin_cutcond(item *);
+extern void          pin_decode(item *);
 extern void          pin_dynamic_layparm(item *);
 extern void          pin_dynamic_subsuper(item *);
 extern void          pin_figtab_format_changes(item *);
@@ -106,7 +124,25 @@ extern BOOL          read_write(uschar *);
 extern BOOL          ref_resolve(item *);
 extern BOOL          revision_check(item *);
 
+extern void          stats_begin(uschar *);
+extern BOOL          stats_end(BOOL);
+extern BOOL          stats_layout_report(uschar *, uschar *, double);
+extern void          stats_unresolved_xref(uschar *);
+extern void          stats_write(uschar *, BOOL);
+
 extern BOOL          sys_exists(uschar *);
+extern BOOL          sys_filestamp(uschar *, long *, long *);
+extern int           sys_pid(void);
+extern void          sys_prefetch(uschar *);
+extern BOOL          sys_read_line(uschar *, int);
+extern int           sys_run_filter(int (*)(int, char **), int, char **,
+                       const char *, size_t,
+                       int (*)(void *, const char *, size_t), void *);
+extern int           sys_run_job(int (*)(int, char **), int, char **);
+extern double        sys_wallclock(void);
+extern void          sys_worker_finish(int);
+extern int           sys_worker_start(FILE *, int *);
+extern BOOL          sys_worker_wait(int, int);
 
 extern BOOL          table_identify(item *, item *);
 extern int           table_row_depth(tdatastr *td, item *);
@@ -118,5 +154,7 @@ extern tree_node    *tree_search(tree_node *, uschar *);
 extern BOOL          url_check(item *);
 
 extern BOOL          write_file(uschar *);
+extern BOOL          write_load_psheader(void);
+extern BOOL          write_stream_pages(BOOL, item *);
 
 /* End of functions.h */
@@ -57,13 +57,17 @@ uschar       *editor_lineage             = NULL;
 uschar       *editor_orgname             = NULL;
 uschar       *editor_othername           = NULL;
 uschar       *editor_surname             = NULL;
-tree_node    *entity_tree                = NULL;
+hash_table   *entity_table               = NULL;
+BOOL          entity_variables_set       = FALSE;
 int           example_nformat_pcount     = 2;
 int           extra_leading              = 0;
 
 int           figure_nformat_pcount      = 2;
+uschar       *font_cache                 = NULL;
+uschar       *font_directory             = NULL;
 
-tree_node    *id_tree                    = NULL;
+hash_table   *id_table                   = NULL;
+int           image_resolution           = 0;
 int           index_count                = 0;
 uschar       *index_names[INDEXMAX];
 unsigned int *index_sort_omit            = NULL;
@@ -71,6 +75,7 @@ uschar       *index_sort_omit_string     = NULL;
 BOOL          inheadorfoot               = FALSE;
 BOOL          internal_processing        = FALSE;
 
+BOOL          layout_only                = FALSE;
 item         *legalnotice_item_list      = NULL;
 
 item         *main_foot_item_list        = NULL;
@@ -90,6 +95,7 @@ uschar       *othercredit_orgname        = NULL;
 uschar       *othercredit_othername      = NULL;
 uschar       *othercredit_surname        = NULL;
 
+int           page_break_lookahead       = 0;
 int           page_columns               = 0;
 int           page_columns_init          = 0;
 int           page_columns_save          = 0;
@@ -116,6 +122,9 @@ item         *revdescription_item_list   = NULL;
 
 int           scale_typesize_base        = 11000;
 uschar       *sdop_share                 = NULL;
+statsstr      stats                      = { 0 };
+uschar       *stats_filename             = NULL;
+BOOL          stream_output              = FALSE;
 BOOL          subscript_small            = TRUE;
 int           subscript_down             = 33;
 BOOL          superscript_small          = TRUE;
@@ -132,8 +141,8 @@ int           toc_page_count             = 0;
 pdfmarkstr   *toc_pdfmarks               = NULL;
 uschar       *toc_title                  = US"Contents";
 
-tree_node    *unknown_char_tree          = NULL;
-tree_node    *unknown_element_tree       = NULL;
+code_table   *unknown_char_table         = NULL;
+hash_table   *unknown_element_table      = NULL;
 
 vfontstr     *vfont_last                 = NULL;
 vfontstr     *vfont_list                 = NULL;
@@ -144,6 +153,8 @@ BOOL          warn_unsupported_set       = FALSE;
 BOOL          warn_unsupported_chars     = TRUE;
 BOOL          warn_unsupported_chars_set = FALSE;
 
+int           write_workers              = 1;
+
 
 /*************************************************
 *       Parameters that control the output       *
@@ -61,17 +61,21 @@ extern uschar       *editor_othername;
 extern uschar       *editor_surname;
 extern entity_block  entity_list[];
 extern int           entity_list_count;
-extern tree_node    *entity_tree;
+extern hash_table   *entity_table;
+extern BOOL          entity_variables_set;
 extern int           example_nformat_pcount;
 extern int           extra_leading;
 
 extern uschar       *family_names[];
 extern int           figure_nformat_pcount;
+extern uschar       *font_cache;
+extern uschar       *font_directory;
 
 extern fontelstr     fontels[];
 extern fontsuffixstr fontsuffixes[];
 
-extern tree_node    *id_tree;
+extern hash_table   *id_table;
+extern int           image_resolution;
 extern int           index_count;
 extern uschar       *index_names[INDEXMAX];
 extern unsigned int *index_sort_omit;
@@ -80,6 +84,7 @@ extern BOOL          inheadorfoot;
 extern BOOL          internal_processing;
 extern vfontstr     *italfonts[];
 
+extern BOOL          layout_only;
 extern item         *legalnotice_item_list;
 extern layoutparam  *lptable[];
 
@@ -103,6 +108,7 @@ extern uschar       *othercredit_orgname;
 extern uschar       *othercredit_othername;
 extern uschar       *othercredit_surname;
 
+extern int           page_break_lookahead;
 extern int           page_columns;
 extern int           page_columns_init;
 extern int           page_columns_save;
@@ -131,6 +137,9 @@ extern vfontstr     *romanfonts[];
 extern int           scale_typesize_base;
 extern uschar       *sdop_share;
 extern uschar       *sfontname[];
+extern statsstr      stats;
+extern uschar       *stats_filename;
+extern BOOL          stream_output;
 extern BOOL          subscript_small;
 extern int           subscript_down;
 extern BOOL          superscript_small;
@@ -153,8 +162,8 @@ extern uschar       *type_names[];
 
 extern int           u2scount;
 extern u2sencod      u2slist[];
-extern tree_node    *unknown_char_tree;
-extern tree_node    *unknown_element_tree;
+extern code_table   *unknown_char_table;
+extern hash_table   *unknown_element_table;
 extern const int     utf8_table1[];
 extern const int     utf8_table2[];
 extern const int     utf8_table3[];
@@ -186,6 +195,8 @@ extern BOOL          warn_unsupported_set;
 extern BOOL          warn_unsupported_chars;
 extern BOOL          warn_unsupported_chars_set;
 
+extern int           write_workers;
+
 
 /*************************************************
 *       Parameters that control the output       *
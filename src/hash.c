@@ -0,0 +1,381 @@
+/*************************************************
+*          sdop - Simple DocBook Processor       *
+*************************************************/
+
+/* Copyright (c) Philip Hazel, 2009 */
+
+
+#include "sdop.h"
+
+
+
+/***********************************************************
+*              Hash Table Management Routines              *
+***********************************************************/
+
+/* These routines maintain open-addressing hash tables with linear probing.
+There are two kinds: tables of named nodes (the same tree_node structure that
+the balanced tree routines use), and tables keyed by an integer code point,
+where the data is held in the slots themselves. Nothing is ever deleted from
+either kind of table, so there is no need for tombstones.
+
+A table is created on the first insertion, so a NULL table pointer is an empty
+table, in the same way as an empty tree. */
+
+
+/*************************************************
+*              Flags and Parameters              *
+*************************************************/
+
+#define HASH_INITSIZE     16     /* initial number of slots (power of 2) */
+
+/* A table is enlarged when it becomes more than half full, which keeps the
+probe sequences short. */
+
+#define HASH_FULL(t)      ((t)->count * 2 >= (t)->size)
+
+
+
+/*************************************************
+*            Compute hash of a name              *
+*************************************************/
+
+/* This is the FNV-1a hash.
+
+Argument:   the zero-terminated name
+Returns:    the hash value
+*/
+
+static unsigned int
+hash_name(uschar *name)
+{
+unsigned int h = 2166136261u;
+while (*name != 0) h = (h ^ *name++) * 16777619u;
+return h;
+}
+
+
+
+/*************************************************
+*          Compute hash of a code point          *
+*************************************************/
+
+/* Code points tend to be clustered, so they are scrambled by multiplication,
+with the high-order bits folded down.
+
+Argument:   the code point
+Returns:    the hash value
+*/
+
+static unsigned int
+hash_code(int code)
+{
+unsigned int h = (unsigned int)code * 2654435761u;
+return h ^ (h >> 16);
+}
+
+
+
+/*************************************************
+*           Allocate a new named table           *
+*************************************************/
+
+/*
+Argument:   number of slots (a power of 2)
+Returns:    pointer to an empty table
+*/
+
+static hash_table *
+new_hash_table(int size)
+{
+hash_table *t = misc_malloc(sizeof(hash_table));
+t->slots = misc_malloc(size * sizeof(hash_slot));
+(void)memset(t->slots, 0, size * sizeof(hash_slot));
+t->size = size;
+t->count = 0;
+return t;
+}
+
+
+
+/*************************************************
+*          Enlarge a named table                 *
+*************************************************/
+
+/* The slots vector is doubled in size, and all the nodes are re-inserted,
+using the saved hash values.
+
+Argument:   the table
+Returns:    nothing
+*/
+
+static void
+grow_hash_table(hash_table *t)
+{
+int i;
+int oldsize = t->size;
+int newsize = oldsize * 2;
+unsigned int mask = newsize - 1;
+hash_slot *oldslots = t->slots;
+hash_slot *newslots = misc_malloc(newsize * sizeof(hash_slot));
+
+(void)memset(newslots, 0, newsize * sizeof(hash_slot));
+for (i = 0; i < oldsize; i++)
+  {
+  unsigned int j;
+  if (oldslots[i].node == NULL) continue;
+  for (j = oldslots[i].hash & mask; newslots[j].node != NULL; j = (j+1) & mask);
+  newslots[j] = oldslots[i];
+  }
+
+misc_free(oldslots, oldsize * sizeof(hash_slot));
+t->slots = newslots;
+t->size = newsize;
+}
+
+
+
+/*************************************************
+*        Insert a new node into a table          *
+*************************************************/
+
+/* The node->name field must (obviously) be set, but the other fields need not
+be initialized. The node's name is used as the key, without copying.
+
+Arguments:
+  tablebase  pointer to the table pointer
+  node       the node to insert, with name field set
+
+Returns:     TRUE if node inserted; FALSE if not (duplicate)
+*/
+
+int
+hash_insertnode(hash_table **tablebase, tree_node *node)
+{
+hash_table *t = *tablebase;
+unsigned int h = hash_name(node->name);
+unsigned int mask, j;
+
+if (t == NULL) *tablebase = t = new_hash_table(HASH_INITSIZE);
+  else if (HASH_FULL(t)) grow_hash_table(t);
+
+mask = t->size - 1;
+for (j = h & mask; t->slots[j].node != NULL; j = (j+1) & mask)
+  {
+  if (t->slots[j].hash == h && Ustrcmp(t->slots[j].node->name, node->name) == 0)
+    return FALSE;                              /* Duplicate node encountered */
+  }
+
+t->slots[j].hash = h;
+t->slots[j].node = node;
+t->count++;
+return TRUE;
+}
+
+
+
+/*************************************************
+*          Search a table for a name             *
+*************************************************/
+
+/*
+Arguments:
+  t          the table (may be NULL)
+  name       the name to search for
+
+Returns:     pointer to the node, or NULL if not found
+*/
+
+tree_node *
+hash_search(hash_table *t, uschar *name)
+{
+unsigned int h, mask, j;
+
+stats.hash_searches++;
+if (t == NULL) return NULL;
+h = hash_name(name);
+mask = t->size - 1;
+
+for (j = h & mask; t->slots[j].node != NULL; j = (j+1) & mask)
+  {
+  if (t->slots[j].hash == h && Ustrcmp(t->slots[j].node->name, name) == 0)
+    return t->slots[j].node;
+  }
+
+return NULL;
+}
+
+
+
+/*************************************************
+*       Compare two node pointers for sorting    *
+*************************************************/
+
+static int
+compare_nodes(const void *a, const void *b)
+{
+return Ustrcmp((*(tree_node **)a)->name, (*(tree_node **)b)->name);
+}
+
+
+
+/*************************************************
+*      Get the nodes of a table in name order    *
+*************************************************/
+
+/* A hash table has no intrinsic order, so when the contents are wanted in
+order (for example, for printing), a sorted vector of node pointers is made.
+The caller should free it with misc_free(), whose size argument is the count
+times sizeof(tree_node *).
+
+Arguments:
+  t          the table (may be NULL)
+  countptr   where to return the number of nodes
+
+Returns:     pointer to a vector of node pointers, or NULL if the table is
+               empty
+*/
+
+tree_node **
+hash_sorted(hash_table *t, int *countptr)
+{
+int i, n;
+tree_node **v;
+
+*countptr = 0;
+if (t == NULL || t->count == 0) return NULL;
+
+v = misc_malloc(t->count * sizeof(tree_node *));
+for (i = n = 0; i < t->size; i++)
+  if (t->slots[i].node != NULL) v[n++] = t->slots[i].node;
+
+qsort(v, n, sizeof(tree_node *), compare_nodes);
+*countptr = n;
+return v;
+}
+
+
+
+/*************************************************
+*         Allocate a new code point table        *
+*************************************************/
+
+/*
+Argument:   number of slots (a power of 2)
+Returns:    pointer to an empty table
+*/
+
+static code_table *
+new_code_table(int size)
+{
+int i;
+code_table *t = misc_malloc(sizeof(code_table));
+t->slots = misc_malloc(size * sizeof(code_node));
+for (i = 0; i < size; i++) t->slots[i].code = -1;
+t->size = size;
+t->count = 0;
+return t;
+}
+
+
+
+/*************************************************
+*          Enlarge a code point table            *
+*************************************************/
+
+/*
+Argument:   the table
+Returns:    nothing
+*/
+
+static void
+grow_code_table(code_table *t)
+{
+int i;
+int oldsize = t->size;
+int newsize = oldsize * 2;
+unsigned int mask = newsize - 1;
+code_node *oldslots = t->slots;
+code_node *newslots = misc_malloc(newsize * sizeof(code_node));
+
+for (i = 0; i < newsize; i++) newslots[i].code = -1;
+for (i = 0; i < oldsize; i++)
+  {
+  unsigned int j;
+  if (oldslots[i].code < 0) continue;
+  for (j = hash_code(oldslots[i].code) & mask;
+       newslots[j].code >= 0;
+       j = (j+1) & mask);
+  newslots[j] = oldslots[i];
+  }
+
+misc_free(oldslots, oldsize * sizeof(code_node));
+t->slots = newslots;
+t->size = newsize;
+}
+
+
+
+/*************************************************
+*      Insert a code point into a table          *
+*************************************************/
+
+/* If the code point is already present, its existing slot is returned;
+otherwise a new slot is set up with its data zeroed.
+
+Arguments:
+  tablebase  pointer to the table pointer
+  code       the code point (must not be negative)
+
+Returns:     pointer to the slot for the code point
+*/
+
+code_node *
+hash_code_insert(code_table **tablebase, int code)
+{
+code_table *t = *tablebase;
+unsigned int mask, j;
+
+if (t == NULL) *tablebase = t = new_code_table(HASH_INITSIZE);
+  else if (HASH_FULL(t)) grow_code_table(t);
+
+mask = t->size - 1;
+for (j = hash_code(code) & mask; t->slots[j].code >= 0; j = (j+1) & mask)
+  if (t->slots[j].code == code) return t->slots + j;
+
+t->slots[j].code = code;
+t->slots[j].val[0] = t->slots[j].val[1] = 0;
+t->count++;
+return t->slots + j;
+}
+
+
+
+/*************************************************
+*       Search a table for a code point          *
+*************************************************/
+
+/*
+Arguments:
+  t          the table (may be NULL)
+  code       the code point to search for
+
+Returns:     pointer to the slot, or NULL if not found
+*/
+
+code_node *
+hash_code_search(code_table *t, int code)
+{
+unsigned int mask, j;
+
+stats.hash_code_searches++;
+if (t == NULL) return NULL;
+mask = t->size - 1;
+
+for (j = hash_code(code) & mask; t->slots[j].code >= 0; j = (j+1) & mask)
+  if (t->slots[j].code == code) return t->slots + j;
+
+return NULL;
+}
+
+/* End of hash.c */
@@ -0,0 +1,338 @@
+/*************************************************
+*          sdop - Simple DocBook Processor       *
+*************************************************/
+
+/* Copyright (c) Philip Hazel, 2009 */
+
+/* Free-standing program to compare the speed of the balanced tree and hash
+table routines for the kinds of lookup that sdop does: ids (as used for
+cross-references), entity names, and font character widths, which are keyed by
+code point. */
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/* Include the bits of code we are going to test. */
+
+#include "utf8tables.c"
+#include "tree.c"
+#include "hash.c"
+
+
+#define DEFAULT_KEYS    100000
+#define DEFAULT_ROUNDS  10
+#define KEYSIZE         24
+
+
+static unsigned int seed = 12345;
+
+statsstr stats;                 /* Counters used by hash.c */
+
+
+
+/************************************************
+*        Dummy memory handling functions        *
+************************************************/
+
+void *
+misc_malloc(int size)
+{
+void *yield = malloc(size);
+if (yield == NULL)
+  {
+  (void)fprintf(stderr, "** Failed to get %d bytes of memory\n", size);
+  exit(EXIT_FAILURE);
+  }
+return yield;
+}
+
+void
+misc_free(void *ptr, int size)
+{
+size = size;    /* Keep picky compilers happy */
+free(ptr);
+}
+
+
+
+/************************************************
+*          Simple pseudo-random numbers         *
+************************************************/
+
+/* A private generator is used so that the results are the same everywhere. */
+
+static unsigned int
+next_random(void)
+{
+seed = seed * 1103515245u + 12345u;
+return (seed >> 8) & 0xffffff;
+}
+
+
+
+/************************************************
+*            Make a set of test keys            *
+************************************************/
+
+/* Id keys look like those in real documents: a prefix and a number. Entity
+keys are short runs of letters. Half of the keys are inserted; the other half
+are used for failing lookups.
+
+Arguments:
+  keys       vector of KEYSIZE buffers
+  count      number of keys
+  isid       TRUE for id-like keys, FALSE for entity-like keys
+
+Returns:     nothing
+*/
+
+static void
+make_keys(uschar (*keys)[KEYSIZE], int count, BOOL isid)
+{
+int i;
+static const char *prefixes[] = { "SECTconfig", "CHAPintro", "SECID",
+  "TABLE", "FIGURE", "footnote" };
+
+for (i = 0; i < count; i++)
+  {
+  if (isid)
+    (void)sprintf(CS keys[i], "%s%d", prefixes[next_random() % 6], i);
+  else
+    {
+    int j;
+    int len = 3 + next_random() % 6;
+    for (j = 0; j < len; j++) keys[i][j] = 'a' + next_random() % 26;
+    (void)sprintf(CS keys[i] + j, "%d", i);
+    }
+  }
+}
+
+
+
+/************************************************
+*           Time string key lookups             *
+************************************************/
+
+/*
+Arguments:
+  title      title for the output
+  keys       vector of 2*count keys
+  count      number of keys to insert
+  rounds     number of times to look up every key
+
+Returns:     nothing
+*/
+
+static void
+time_strings(const char *title, uschar (*keys)[KEYSIZE], int count,
+  int rounds)
+{
+int i, r;
+long found;
+double t_tree_ins, t_tree_hit, t_tree_miss;
+double t_hash_ins, t_hash_hit, t_hash_miss;
+clock_t start;
+tree_node *tree = NULL;
+hash_table *table = NULL;
+tree_node **nodes = misc_malloc(count * sizeof(tree_node *));
+
+for (i = 0; i < count; i++)
+  {
+  nodes[i] = misc_malloc(sizeof(tree_node) + Ustrlen(keys[i]));
+  Ustrcpy(nodes[i]->name, keys[i]);
+  }
+
+/* Insertion */
+
+start = clock();
+for (i = 0; i < count; i++) (void)tree_insertnode(&tree, nodes[i]);
+t_tree_ins = (double)(clock() - start)/CLOCKS_PER_SEC;
+
+start = clock();
+for (i = 0; i < count; i++) (void)hash_insertnode(&table, nodes[i]);
+t_hash_ins = (double)(clock() - start)/CLOCKS_PER_SEC;
+
+/* Successful lookups */
+
+found = 0;
+start = clock();
+for (r = 0; r < rounds; r++)
+  for (i = 0; i < count; i++)
+    if (tree_search(tree, keys[i]) != NULL) found++;
+t_tree_hit = (double)(clock() - start)/CLOCKS_PER_SEC;
+if (found != (long)count * rounds) printf("** Tree lookup failure\n");
+
+found = 0;
+start = clock();
+for (r = 0; r < rounds; r++)
+  for (i = 0; i < count; i++)
+    if (hash_search(table, keys[i]) != NULL) found++;
+t_hash_hit = (double)(clock() - start)/CLOCKS_PER_SEC;
+if (found != (long)count * rounds) printf("** Hash lookup failure\n");
+
+/* Failing lookups */
+
+found = 0;
+start = clock();
+for (r = 0; r < rounds; r++)
+  for (i = count; i < 2*count; i++)
+    if (tree_search(tree, keys[i]) != NULL) found++;
+t_tree_miss = (double)(clock() - start)/CLOCKS_PER_SEC;
+
+start = clock();
+for (r = 0; r < rounds; r++)
+  for (i = count; i < 2*count; i++)
+    if (hash_search(table, keys[i]) != NULL) found++;
+t_hash_miss = (double)(clock() - start)/CLOCKS_PER_SEC;
+if (found != 0) printf("** Unexpected match for a missing key\n");
+
+printf("%s (%d keys)\n", title, count);
+printf("  insert   tree %8.1f ns/op   hash %8.1f ns/op\n",
+  t_tree_ins * 1e9 / count, t_hash_ins * 1e9 / count);
+printf("  hit      tree %8.1f ns/op   hash %8.1f ns/op\n",
+  t_tree_hit * 1e9 / ((double)count * rounds),
+  t_hash_hit * 1e9 / ((double)count * rounds));
+printf("  miss     tree %8.1f ns/op   hash %8.1f ns/op\n",
+  t_tree_miss * 1e9 / ((double)count * rounds),
+  t_hash_miss * 1e9 / ((double)count * rounds));
+
+for (i = 0; i < count; i++) free(nodes[i]);
+free(nodes);
+}
+
+
+
+/************************************************
+*          Time code point lookups              *
+************************************************/
+
+/* The tree is keyed by the UTF-8 encoding of the code point, as it used to be
+for font widths, so the cost of the encoding is included.
+
+Arguments:
+  count      number of code points to insert (from 0x0400 up)
+  rounds     number of times to look up every code point
+
+Returns:     nothing
+*/
+
+static void
+time_codes(int count, int rounds)
+{
+int i, r;
+long found = 0;
+double t_tree, t_hash;
+clock_t start;
+tree_node *tree = NULL;
+code_table *table = NULL;
+
+for (i = 0; i < count; i++)
+  {
+  int c = 0x400 + i;
+  tree_node *tn = misc_malloc(sizeof(tree_node) + 6);
+  tn->name[misc_ord2utf8(c, tn->name)] = 0;
+  (void)tree_insertnode(&tree, tn);
+  (void)hash_code_insert(&table, c);
+  }
+
+start = clock();
+for (r = 0; r < rounds; r++)
+  for (i = 0; i < 2*count; i++)
+    {
+    uschar utf[8];
+    utf[misc_ord2utf8(0x400 + i, utf)] = 0;
+    if (tree_search(tree, utf) != NULL) found++;
+    }
+t_tree = (double)(clock() - start)/CLOCKS_PER_SEC;
+
+start = clock();
+for (r = 0; r < rounds; r++)
+  for (i = 0; i < 2*count; i++)
+    if (hash_code_search(table, 0x400 + i) != NULL) found++;
+t_hash = (double)(clock() - start)/CLOCKS_PER_SEC;
+
+if (found != 2L * count * rounds) printf("** Code point lookup failure\n");
+
+printf("Code points (%d keys, half the lookups fail)\n", count);
+printf("  lookup   tree %8.1f ns/op   hash %8.1f ns/op\n",
+  t_tree * 1e9 / (2.0 * count * rounds),
+  t_hash * 1e9 / (2.0 * count * rounds));
+}
+
+
+
+/************************************************
+*     Convert a code point to UTF-8 (copy)      *
+************************************************/
+
+/* This is a copy of misc_ord2utf8(), which cannot be included without
+dragging in most of misc.c.
+
+Arguments:
+  cvalue     the character value
+  buffer     pointer to buffer for result - at least 6 bytes long
+
+Returns:     number of characters placed in the buffer
+*/
+
+int
+misc_ord2utf8(int cvalue, uschar *buffer)
+{
+register int i, j;
+for (i = 0; i < 6; i++) if (cvalue <= utf8_table1[i]) break;
+buffer += i;
+for (j = i; j > 0; j--)
+ {
+ *buffer-- = 0x80 | (cvalue & 0x3f);
+ cvalue >>= 6;
+ }
+*buffer = utf8_table2[i] | cvalue;
+return i + 1;
+}
+
+
+
+/************************************************
+*              Main Program                     *
+************************************************/
+
+int main(int argc, char **argv)
+{
+int count = DEFAULT_KEYS;
+int rounds = DEFAULT_ROUNDS;
+uschar (*keys)[KEYSIZE];
+
+if (argc > 1 && Ustrcmp(argv[1], "--help") == 0)
+  {
+  (void)fprintf(stderr, "Usage: hashbench [<keys> [<rounds>]]\n");
+  exit(EXIT_FAILURE);
+  }
+
+if (argc > 1) count = atoi(argv[1]);
+if (argc > 2) rounds = atoi(argv[2]);
+if (count <= 0 || rounds <= 0)
+  {
+  (void)fprintf(stderr, "** Key and round counts must be positive\n");
+  exit(EXIT_FAILURE);
+  }
+
+keys = misc_malloc(2 * count * KEYSIZE);
+
+make_keys(keys, 2*count, TRUE);
+time_strings("Id lookups", keys, count, rounds);
+
+make_keys(keys, 2*count, FALSE);
+time_strings("Entity lookups", keys, count, rounds);
+
+time_codes(count < 60000? count : 60000, rounds);
+
+free(keys);
+return 0;
+}
+
+/* End of hashbench.c */
@@ -26,13 +26,21 @@ static struct hyindex {
 
 static unsigned int hy_indexsize;     /* size of index */
 
+/* The dictionary itself is read into memory, so that processes forked after
+initialization, which would otherwise share the file's offset, can look words
+up at the same time. */
+
+static uschar *hy_data = NULL;        /* the dictionary */
+static long hy_datasize;              /* its length */
+
 
 
 /*************************************************
 *            Initialize hyphenation              *
 *************************************************/
 
-/* This function reads in the index to the hyphenation dictionary.
+/* This function reads in the index to the hyphenation dictionary, followed by
+the dictionary itself.
 
 Arguments:  none
 Returns:    nothing
@@ -68,8 +76,16 @@ if (main_hyphenfile != NULL)
     hy_index[i].pos = atol(CS line+4);
     }
 
+  /* The index positions are relative to the start of the dictionary, which
+  follows the index. */
+
   hy_indexoffset = ftell(main_hyphenfile);
-  for (i = 0; i < hy_indexsize; i++) hy_index[i].pos += hy_indexoffset;
+  if (fseek(main_hyphenfile, 0, SEEK_END) != 0 ||
+      (hy_datasize = ftell(main_hyphenfile) - hy_indexoffset) < 0 ||
+      fseek(main_hyphenfile, hy_indexoffset, SEEK_SET) != 0)
+    hy_datasize = 0;
+  hy_data = misc_malloc(hy_datasize + 1);
+  hy_datasize = fread(hy_data, 1, hy_datasize, main_hyphenfile);
   }
 }
 
@@ -246,7 +262,7 @@ dictionary. */
 
 if (p == 0)
   {
-  uschar *pp;
+  uschar *pp, *dp, *dend;
   Key key = keyof(word);
   int seekpoint = 0;
   int middle;
@@ -268,9 +284,10 @@ if (p == 0)
       }
     }
 
-  /* Position the hyphenation dictionary to the right place */
+  /* Start at the right place in the hyphenation dictionary */
 
-  fseek(main_hyphenfile, hy_index[seekpoint].pos, SEEK_SET);
+  dp = hy_data + hy_index[seekpoint].pos;
+  dend = hy_data + hy_datasize;
 
   /* Read the hyphenation dictionary until the word is found, or
   a word lexically greater is found, or we hit the end of the dictionary. */
@@ -279,7 +296,12 @@ if (p == 0)
     {
     int c, compare;
     int i = 0, j = 0;
-    if (Ufgets(splitword, 30, main_hyphenfile) == NULL) return -1;
+    if (dp >= dend) return -1;
+    while (dp < dend && i < 29)
+      if ((splitword[i++] = *dp++) == '\n') break;
+    splitword[i] = 0;
+    i = 0;
+    stats.hyphen_reads++;
     splitword[Ustrlen(splitword) - 1] = 0;
     while ((c = splitword[i++]) != 0) if (c != '-') plainword[j++] = c;
     plainword[j] = 0;
@@ -28,6 +28,7 @@
 
 
 FILE *main_hyphenfile = NULL;
+statsstr stats;
 
 
 /************************************************
@@ -79,14 +79,15 @@ return c;
 /* This function reads a list of characters in collation order from the
 "indexcollate" file in the shared data, and uses it to create two sorting
 tables - case-sensitive and case-insensitive. The function may be called more
-than once if there are multiple indexes.
+than once if there are multiple indexes. It is also called when the render
+server starts up, so that the tables are ready for every job.
 
 Arguments:    none
 Returns:      nothing
 */
 
-static void
-init_collation_data(void)
+void
+index_init_collation(void)
 {
 FILE *f;
 uschar fn[128];
@@ -723,7 +724,7 @@ for (i = item_list; i != NULL && i != index_item; i = i->next)
 /* Initialize the sorting collation data, and create the list of collation
 values for inserting headings in the index. */
 
-init_collation_data();
+index_init_collation();
 
 ixh = misc_malloc(sizeof(int) * (Ustrlen(ixhlist) + 1));
 ixh[0] = -999;
@@ -0,0 +1,494 @@
+/*************************************************
+*          sdop - Simple DocBook Processor       *
+*************************************************/
+
+/* Copyright (c) Philip Hazel, 2009 */
+
+/* Free-standing program to time the inner loops of sdop in isolation. So that
+the data they work on is realistic, a document is first processed in the normal
+way, with the output discarded. The kernels are then run repeatedly over the
+fonts, paragraphs, ids, and index entries that were left behind. The modules
+whose kernels are static are included here; the rest are linked as usual. */
+
+#define SDOP_LIBRARY
+#include "sdop.c"
+#include "entity.c"
+#include "index.c"
+#include "para.c"
+#include "write.c"
+
+
+#define DEFAULT_TRIALS  5
+#define MAXWORDSIZE    60
+#define MINTRIALTIME   (CLOCKS_PER_SEC/20)
+
+static int      trials = DEFAULT_TRIALS;
+
+static item    **paras;                /* Formatted paragraphs (#PCPARA) */
+static int      para_count;
+static item   **ixterms;                /* Index entries */
+static int      ixterm_count;
+static uschar **words;                  /* Words for hyphenation */
+static int      word_count;
+static tree_node **ids;                 /* Ids, from the id hash table */
+static int      id_count;
+static tree_node *id_tree = NULL;
+static long     ix_compares;
+
+
+
+/*************************************************
+*               Time one kernel                  *
+*************************************************/
+
+/* The kernel is run the required number of times; each run returns the number
+of operations it did. For small data sets, a trial repeats the kernel until
+enough time has passed for clock() to be meaningful. The best and average times
+per operation are shown.
+
+Arguments:
+  name       name of the kernel, for the output
+  fn         the function that runs it
+
+Returns:     nothing
+*/
+
+static void
+time_kernel(const char *name, long (*fn)(void))
+{
+int t;
+long ops = 0;
+double best = 0.0;
+double total = 0.0;
+
+for (t = 0; t < trials; t++)
+  {
+  long n = 0;
+  double ns;
+  clock_t elapsed;
+  clock_t start = clock();
+  do
+    {
+    ops = fn();
+    n += ops;
+    elapsed = clock() - start;
+    }
+  while (ops > 0 && elapsed < MINTRIALTIME);
+  if (ops <= 0) break;
+  ns = (double)elapsed * 1e9 / CLOCKS_PER_SEC / n;
+  if (t == 0 || ns < best) best = ns;
+  total += ns;
+  }
+
+if (ops <= 0)
+  {
+  printf("%-24s (no data)\n", name);
+  return;
+  }
+
+printf("%-24s %10.1f ns/op  (mean %.1f)  %9ld ops\n", name, best,
+  total / trials, ops);
+}
+
+
+
+/*************************************************
+*                  The kernels                   *
+*************************************************/
+
+/* Each of these runs over all the relevant data once, and returns the number
+of operations. */
+
+/* Character widths for every character of every paragraph. */
+
+static long
+k_charwidth(void)
+{
+int k;
+long ops = 0;
+for (k = 0; k < para_count; k++)
+  {
+  textblock *tb;
+  for (tb = paras[k]->p.prgrph->intxtblk; tb != NULL; tb = tb->next)
+    {
+    uschar *p = tb->string;
+    while (*p != 0)
+      {
+      int c;
+      GETCHARINC(c, p);
+      (void)font_charwidth(c, tb->vfont, NULL);
+      ops++;
+      }
+    }
+  }
+return ops;
+}
+
+/* Kerning for every adjacent pair of characters. */
+
+static long
+k_kernwidth(void)
+{
+int k;
+long ops = 0;
+for (k = 0; k < para_count; k++)
+  {
+  textblock *tb;
+  for (tb = paras[k]->p.prgrph->intxtblk; tb != NULL; tb = tb->next)
+    {
+    int lastc = -1;
+    uschar *p = tb->string;
+    while (*p != 0)
+      {
+      int c;
+      GETCHARINC(c, p);
+      if (lastc >= 0)
+        {
+        (void)font_kernwidth(lastc, c, tb->vfont);
+        ops++;
+        }
+      lastc = c;
+      }
+    }
+  }
+return ops;
+}
+
+/* The width of each paragraph text block as a whole. */
+
+static long
+k_stringwidth(void)
+{
+int k;
+long ops = 0;
+for (k = 0; k < para_count; k++)
+  {
+  textblock *tb;
+  for (tb = paras[k]->p.prgrph->intxtblk; tb != NULL; tb = tb->next)
+    {
+    (void)font_stringwidth(tb->string, tb->vfont);
+    ops++;
+    }
+  }
+return ops;
+}
+
+/* Line breaking: each paragraph is broken into lines again. The input text
+blocks are not changed by this. Paragraphs with footnote references are
+skipped, because pagination has moved their footnotes. */
+
+static long
+k_get_next_line(void)
+{
+int k;
+long ops = 0;
+for (k = 0; k < para_count; k++)
+  {
+  paragraph *pg = paras[k]->p.prgrph;
+  textblock *tb;
+  int offset = 0;
+
+  for (tb = pg->intxtblk; tb != NULL; tb = tb->next)
+    if ((tb->pin_flags & PIN_FNKEYREF) != 0) break;
+  if (tb != NULL) continue;
+
+  tb = pg->intxtblk;
+  while (tb != NULL)
+    {
+    outputline ol;
+    (void)memset(&ol, 0, sizeof(ol));
+    tb = para_get_next_line(tb, &offset, pg->maxwidth - pg->layparm->indent1,
+      &ol, pg->layparm->fill, FALSE);
+    ops++;
+    }
+  }
+return ops;
+}
+
+/* All the hyphenation points of each word. */
+
+static long
+k_hyphen(void)
+{
+int k;
+long ops = 0;
+for (k = 0; k < word_count; k++)
+  {
+  int p = 0;
+  while ((p = Hyphen_Next(words[k], p)) > 0) {}
+  ops++;
+  }
+return ops;
+}
+
+/* Expansion of entities in a copy of each paragraph text block, with some
+entities put back. Any ampersands that are already in the text are changed. */
+
+static long
+k_entity(void)
+{
+int k;
+long ops = 0;
+for (k = 0; k < para_count; k++)
+  {
+  textblock *tb;
+  for (tb = paras[k]->p.prgrph->intxtblk; tb != NULL; tb = tb->next)
+    {
+    int j, n = 0;
+    int size = sizeof(textblock) + 2 * tb->length + 16;
+    textblock *etb = misc_malloc(size);
+    textblock *otb = etb;
+    *etb = *tb;
+    for (j = 0; j < tb->length; j++)
+      {
+      etb->string[n++] = (tb->string[j] == '&')? '+' : tb->string[j];
+      if (tb->string[j] == ' ' && (j & 7) == 0)
+        {
+        Ustrcpy(etb->string + n, (j & 8)? "&amp; " : "&#x2019; ");
+        n += Ustrlen(etb->string + n);
+        }
+      }
+    etb->string[n] = 0;
+    etb->length = n;
+    (void)entity_expand_one(&etb);
+    if (etb == otb) misc_free(etb, size);
+    ops++;
+    }
+  }
+return ops;
+}
+
+/* Lookups of every id, in the hash table and in a balanced tree. */
+
+static long
+k_hash_search(void)
+{
+int k;
+for (k = 0; k < id_count; k++) (void)hash_search(id_table, ids[k]->name);
+return id_count;
+}
+
+static long
+k_tree_search(void)
+{
+int k;
+for (k = 0; k < id_count; k++) (void)tree_search(id_tree, ids[k]->name);
+return id_count;
+}
+
+/* Sorting the index entries from a fixed shuffle; the count is of
+comparisons. */
+
+static int
+ixcompare_counted(const void *a, const void *b)
+{
+ix_compares++;
+return ixcompare(a, b);
+}
+
+static long
+k_ixcompare(void)
+{
+int k;
+unsigned int seed = 12345;
+item **v = misc_malloc(ixterm_count * sizeof(item *));
+(void)memcpy(v, ixterms, ixterm_count * sizeof(item *));
+for (k = ixterm_count - 1; k > 0; k--)
+  {
+  int j;
+  item *x;
+  seed = seed * 1103515245u + 12345u;
+  j = ((seed >> 8) & 0xffffff) % (k + 1);
+  x = v[k]; v[k] = v[j]; v[j] = x;
+  }
+ix_compares = 0;
+qsort(v, ixterm_count, sizeof(item *), ixcompare_counted);
+misc_free(v, ixterm_count * sizeof(item *));
+return ix_compares;
+}
+
+/* Output of each formatted text block, in the way that write.c does it. */
+
+static long
+k_output(void)
+{
+int k;
+long ops = 0;
+for (k = 0; k < para_count; k++)
+  {
+  outputline *ol;
+  for (ol = paras[k]->p.prgrph->out; ol != NULL; ol = ol->next)
+    {
+    textblock *tb;
+    for (tb = ol->txtblk; tb != NULL; tb = tb->next)
+      {
+      (void)cprintf("%s ", misc_formatfixed(ol->indent));
+      (void)cprintf("%s M ", misc_formatfixed(ol->depth));
+      (void)cprintf("%d F (%.*s) S\n", tb->vfont->pnumber, tb->length,
+        TBTEXT(tb));
+      ops++;
+      }
+    }
+  }
+return ops;
+}
+
+
+
+/*************************************************
+*          Collect data for the kernels          *
+*************************************************/
+
+/* This is called after the document has been processed.
+
+Arguments:  none
+Returns:    nothing
+*/
+
+static void
+collect_data(void)
+{
+int k, pass;
+item *i;
+
+/* Count the paragraphs, index entries, and words on the first pass; save
+them on the second. */
+
+for (pass = 0; pass < 2; pass++)
+  {
+  para_count = ixterm_count = word_count = 0;
+  for (i = main_item_list; i != NULL; i = i->next)
+    {
+    if (Ustrcmp(i->name, "#PCPARA") == 0)
+      {
+      textblock *tb;
+      if (pass > 0) paras[para_count] = i;
+      para_count++;
+
+      for (tb = i->p.prgrph->intxtblk; tb != NULL; tb = tb->next)
+        {
+        uschar *p = tb->string;
+        while (*p != 0)
+          {
+          uschar *q = p;
+          while (isalpha(*q)) q++;
+          if (q - p >= 5 && q - p < MAXWORDSIZE)
+            {
+            if (pass > 0)
+              {
+              words[word_count] = misc_malloc(q - p + 1);
+              Ustrncpy(words[word_count], p, q - p);
+              words[word_count][q - p] = 0;
+              }
+            word_count++;
+            }
+          p = (q > p)? q : p + 1;
+          }
+        }
+      }
+
+    else if (Ustrcmp(i->name, "indexterm") == 0 && i->partner != i &&
+             Ustrcmp(i->next->name, "#INDEXDATA") == 0)
+      {
+      if (pass > 0) ixterms[ixterm_count] = i;
+      ixterm_count++;
+      }
+    }
+
+  if (pass == 0)
+    {
+    paras = misc_malloc((para_count + 1) * sizeof(item *));
+    ixterms = misc_malloc((ixterm_count + 1) * sizeof(item *));
+    words = misc_malloc((word_count + 1) * sizeof(uschar *));
+    }
+  }
+
+/* The ids are copied into a tree as well, for comparison. */
+
+if (id_table != NULL)
+  {
+  ids = hash_sorted(id_table, &id_count);
+  for (k = 0; k < id_count; k++)
+    {
+    tree_node *tn = misc_malloc(sizeof(tree_node) + Ustrlen(ids[k]->name));
+    Ustrcpy(tn->name, ids[k]->name);
+    (void)tree_insertnode(&id_tree, tn);
+    }
+  }
+}
+
+
+
+/*************************************************
+*              Main Program                     *
+*************************************************/
+
+/* The arguments are the same as for sdop, except that -t may come first to
+set the number of trials, and the output always goes to /dev/null. */
+
+int main(int argc, char **argv)
+{
+if (argc > 2 && Ustrcmp(argv[1], "-t") == 0)
+  {
+  trials = atoi(argv[2]);
+  if (trials <= 0)
+    {
+    (void)fprintf(stderr, "** The number of trials must be positive\n");
+    exit(EXIT_FAILURE);
+    }
+  argv[2] = argv[0];
+  argv += 2;
+  argc -= 2;
+  }
+
+if (argc < 2 || Ustrcmp(argv[1], "--help") == 0)
+  {
+  (void)fprintf(stderr,
+    "Usage: kernbench [-t <trials>] [sdop options] <input file>\n");
+  exit(EXIT_FAILURE);
+  }
+
+if (!sdop_decode_arg(argc, argv) || sdop_filename == NULL)
+  {
+  (void)fprintf(stderr, "** An input file must be given\n");
+  exit(EXIT_FAILURE);
+  }
+
+if (getenv("SDOP_SHARE") != NULL && sdop_share == NULL)
+  sdop_share = US getenv("SDOP_SHARE");
+
+out_filename = US"/dev/null";
+if (!sdop_load_common() || !render_document())
+  {
+  (void)fprintf(stderr, "** Processing %s failed\n", sdop_filename);
+  exit(EXIT_FAILURE);
+  }
+
+collect_data();
+printf("%s: %d paragraphs, %d words, %d ids, %d index entries\n",
+  sdop_filename, para_count, word_count, id_count, ixterm_count);
+
+outfile = Ufopen("/dev/null", "wb");
+if (outfile == NULL)
+  {
+  (void)fprintf(stderr, "** Failed to open /dev/null: %s\n", strerror(errno));
+  exit(EXIT_FAILURE);
+  }
+suppress = FALSE;
+
+time_kernel("font_charwidth", k_charwidth);
+time_kernel("font_kernwidth", k_kernwidth);
+time_kernel("font_stringwidth", k_stringwidth);
+time_kernel("para_get_next_line", k_get_next_line);
+time_kernel("Hyphen_Next (per word)", k_hyphen);
+time_kernel("entity_expand_one", k_entity);
+time_kernel("hash_search (ids)", k_hash_search);
+time_kernel("tree_search (ids)", k_tree_search);
+time_kernel("ixcompare", k_ixcompare);
+time_kernel("cprintf/formatfixed", k_output);
+
+(void)fclose(outfile);
+return 0;
+}
+
+/* End of kernbench.c */
@@ -0,0 +1,114 @@
+/*************************************************
+*          sdop - Simple DocBook Processor       *
+*************************************************/
+
+/* Copyright (c) Philip Hazel, 2009 */
+
+/* This module contains the library interface; see libsdop.h. The main module
+is included so that its static functions can be used; SDOP_LIBRARY causes it to
+omit the main program. */
+
+#define SDOP_LIBRARY
+#include "sdop.c"
+#include "libsdop.h"
+
+
+
+/*************************************************
+*           Run one library rendering            *
+*************************************************/
+
+/* This function is called in a child process (see sys_run_filter()), whose
+standard input and output are connected to the caller of sdop_render().
+
+Arguments:  as for main()
+Returns:    the exit code for the rendering
+*/
+
+static int
+library_job(int argc, char **argv)
+{
+pages_odd = pages_even = FALSE;
+if (!sdop_decode_arg(argc, argv)) return EXIT_FAILURE;
+if (server_mode || sdop_filename != NULL || out_filename != NULL)
+  {
+  (void)fprintf(stderr, "sdop: options for sdop_render() may not include "
+    "file names or -server\n");
+  return EXIT_FAILURE;
+  }
+return render_document()? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+
+/*************************************************
+*           Initialize the library               *
+*************************************************/
+
+/* See libsdop.h for details. Calls after the first do nothing.
+
+Argument:   directory list, or NULL
+Returns:    zero on success
+*/
+
+int
+sdop_init(const char *share)
+{
+static int yield = -1;
+
+if (yield >= 0) return yield;
+if (share == NULL) share = getenv("SDOP_SHARE");
+if (share != NULL)
+  {
+  sdop_share = misc_malloc(Ustrlen(share) + 1);
+  Ustrcpy(sdop_share, share);
+  }
+
+yield = sdop_load_common()? 0 : 1;
+return yield;
+}
+
+
+
+/*************************************************
+*           Render one document                  *
+*************************************************/
+
+/* See libsdop.h for details.
+
+Arguments:
+  options    NULL-terminated list of options, or NULL
+  document   the document
+  length     its length
+  sink       function to receive the output
+  data       opaque data for the sink
+
+Returns:     zero on success, 1 for errors in the document, -1 otherwise
+*/
+
+int
+sdop_render(const char *const *options, const char *document, size_t length,
+  sdop_sink sink, void *data)
+{
+int argc, yield;
+size_t size;
+char **argv;
+
+if (sdop_init(NULL) != 0) return -1;
+
+for (argc = 1; options != NULL && options[argc-1] != NULL; argc++);
+size = (argc + 1) * sizeof(char *);
+argv = malloc(size);
+if (argv == NULL) return -1;
+
+argv[0] = "sdop";
+for (argc = 1; options != NULL && options[argc-1] != NULL; argc++)
+  argv[argc] = (char *)options[argc-1];
+argv[argc] = NULL;
+
+yield = sys_run_filter(library_job, argc, argv, document, length, sink, data);
+free(argv);
+return yield;
+}
+
+/* End of libsdop.c */
@@ -0,0 +1,42 @@
+/*************************************************
+*          sdop - Simple DocBook Processor       *
+*************************************************/
+
+/* Copyright (c) Philip Hazel, 2009 */
+
+/* This is the public header for the sdop library, libsdop.a. A program that
+uses the library calls sdop_init() once, and then sdop_render() for each
+document. Each document is rendered in a separate process, forked from the
+caller, so documents cannot interfere with each other, and several may be
+rendered at once (for example, from different threads). The data that is
+common to all documents (font metrics, hyphenation data, and so on) is loaded
+by sdop_init() and shared with the rendering processes. */
+
+#ifndef LIBSDOP_H
+#define LIBSDOP_H
+
+#include <stddef.h>
+
+/* A sink is called with each chunk of PostScript output, in order. It should
+return zero to continue, or non-zero to abandon the rendering. */
+
+typedef int (*sdop_sink)(void *data, const char *buffer, size_t length);
+
+/* The share argument is a colon-separated list of directories to search for
+sdop's data files, as for the -S option; if it is NULL, the SDOP_SHARE
+environment variable is used. The result is zero on success. */
+
+extern int sdop_init(const char *share);
+
+/* The options are a NULL-terminated list of command line options, as for the
+sdop command (for example, "-p", "1-10"), and may be NULL. They must not
+include file names. Error messages are written to the standard error. The
+result is zero on success, 1 if there were errors in the document, and -1 if
+the rendering could not be run or was abandoned by the sink. */
+
+extern int sdop_render(const char *const *options, const char *document,
+  size_t length, sdop_sink sink, void *data);
+
+#endif  /* LIBSDOP_H */
+
+/* End of libsdop.h */
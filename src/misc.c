@@ -28,6 +28,8 @@ void *yield = malloc(size);
 if (yield == NULL) (void)error(1, size);   /* Fatal error */
 memory_used += size;
 if (memory_used > memory_hwm) memory_hwm = memory_used;
+stats.malloc_calls++;
+stats.malloc_bytes += size;
 return yield;
 }
 
@@ -61,7 +63,9 @@ memory_used -= size;
 
 /* Given a file name, this function searches the libraries given with -S (in
 sdop_share) and also the inbuilt library for the first one that contains the
-file. The complete file name is then returned.
+file. The complete file name is then returned. Successful lookups are
+remembered, so that a long-running render server does not repeat them for
+every job. The remembered names are discarded if sdop_share changes.
 
 Arguments:
   name         the name of the file
@@ -74,6 +78,28 @@ Returns:       TRUE if file found, FALSE otherwise if hard == FALSE
 BOOL
 misc_find_share(uschar *name, uschar *buffer, BOOL hard)
 {
+static hash_table *found = NULL;
+static uschar *found_share = NULL;
+tree_node *tn;
+
+if ((found_share == NULL)? sdop_share != NULL :
+      (sdop_share == NULL || Ustrcmp(found_share, sdop_share) != 0))
+  {
+  found = NULL;                          /* Small, so not worth freeing */
+  found_share = NULL;
+  if (sdop_share != NULL)
+    {
+    found_share = misc_malloc(Ustrlen(sdop_share) + 1);
+    Ustrcpy(found_share, sdop_share);
+    }
+  }
+
+if ((tn = hash_search(found, name)) != NULL)
+  {
+  Ustrcpy(buffer, tn->data.ptr);
+  return TRUE;
+  }
+
 if (sdop_share != NULL)
   {
   uschar *s = sdop_share;
@@ -83,7 +109,7 @@ if (sdop_share != NULL)
     if (ss != NULL) *ss = 0;
     (void)sprintf(CS buffer, "%s/%s", s, name);
     if (ss != NULL) *ss++ = ':';
-    if (sys_exists(buffer)) return TRUE;
+    if (sys_exists(buffer)) goto FOUND;
     s = ss;
     }
   }
@@ -96,6 +122,13 @@ if (!sys_exists(buffer))
   else
     error(70, name, DATADIR);  /* Hard */
   }
+
+FOUND:
+tn = misc_malloc(sizeof(tree_node) + Ustrlen(name));
+Ustrcpy(tn->name, name);
+tn->data.ptr = misc_malloc(Ustrlen(buffer) + 1);
+Ustrcpy(tn->data.ptr, buffer);
+(void)hash_insertnode(&found, tn);
 return TRUE;
 }
 
@@ -377,6 +410,29 @@ for(;;)
 
 
 
+/*************************************************
+*       Check for a streaming chunk boundary     *
+*************************************************/
+
+/* When output is being streamed, the main text is formatted, paginated, and
+written a chapter at a time. A chunk starts at a chapter or at an appendix that
+is not part of an article - these are the places where a new page is always
+started. A preface is not a boundary, because the prefaces are taken out of the
+main text after it has been formatted.
+
+Argument:  the item
+Returns:   TRUE if a new chunk starts at this item
+*/
+
+BOOL
+misc_is_stream_boundary(item *i)
+{
+return Ustrcmp(i->name, "chapter") == 0 ||
+  (Ustrcmp(i->name, "appendix") == 0 && document_type != DOC_ARTICLE);
+}
+
+
+
 /*************************************************
 *        Check for convert-to-text element       *
 *************************************************/
@@ -384,7 +440,8 @@ for(;;)
 /* Only a very few elements convert into text that is part of what is being
 typeset. They are treated specially because it is necessary to ensure that
 spacing around them (including line breaks) does not get mangled. This function
-is called while reading in the text.
+is called while reading in the text, for every element, so the first character
+is checked before anything else.
 
 Argument:  pointer after the initial '<' of an element
 Returns:   TRUE if it's one of the specials
@@ -396,7 +453,9 @@ misc_istext_elname(uschar *s)
 int k;
 for (k = 0; text_elements[k] != NULL; k++)
   {
-  int len = Ustrlen(text_elements[k]);
+  int len;
+  if (text_elements[k][0] != *s) continue;
+  len = Ustrlen(text_elements[k]);
   if (Ustrncmp(s, text_elements[k], len) == 0 &&
       (s[len] == ' ' || s[len] == '>'))
   return TRUE;
@@ -794,23 +853,24 @@ return TRUE;
 /* This function recognizes r,g,b triples.
 
 Arguments:
-  s         the string to interpret
-  cp        pointer to int[3] for the RGB  values
+  s           the string to interpret
+  cp          pointer to int[3] for the RGB  values
+  give_error  if TRUE, generate an error message for a bad value
 
-Returns:    TRUE on success
+Returns:      TRUE on success
 */
 
 BOOL
-misc_get_colour(uschar *s, int *cp)
+misc_get_colour(uschar *s, int *cp, BOOL give_error)
 {
 double d[3];
 if (sscanf(CS s, "%lf,%lf,%lf", &d[0], &d[1], &d[2]) != 3)
-  return error(93);
+  return give_error? error(93) : FALSE;
 
 if (d[0] < 0.0 || d[0] > 1.0 ||
     d[1] < 0.0 || d[1] > 1.0 ||
     d[2] < 0.0 || d[2] > 1.0)
-  return error(94);
+  return give_error? error(94) : FALSE;
 
 cp[0] = (int)(d[0]*1000);
 cp[1] = (int)(d[1]*1000);
@@ -136,6 +136,7 @@ for (i = item_list; i != NULL; i = i->next)
     Ustrcpy(p->name, "#number");
     Ustrcpy(p->value, ffbuff);
     p->next = i->p.param;
+    p->settings = NULL;
     p->seen = TRUE;
     i->p.param = p;
 
@@ -179,6 +180,7 @@ for (i = item_list; i != NULL; i = i->next)
     Ustrcpy(p->name, "#number");
     Ustrcpy(p->value, ffbuff);
     p->next = i->p.param;
+    p->settings = NULL;
     p->seen = TRUE;
     i->p.param = p;
 
@@ -222,6 +224,7 @@ for (i = item_list; i != NULL; i = i->next)
     Ustrcpy(p->name, "#number");
     Ustrcpy(p->value, ffbuff);
     p->next = i->p.param;
+    p->settings = NULL;
     p->seen = TRUE;
     i->p.param = p;
 
@@ -9,17 +9,39 @@
 #include "sdop.h"
 
 
+/* Where the hex text for the rows of an image goes: into a block of memory
+that is kept with the image's data, or, via a buffer for one row, to the output
+file. When an image is being reduced, each output pixel is the average of a
+block of input pixels; the sums for a row of output pixels are kept until the
+last input row of the block has been seen. */
+
+typedef struct imageout {
+  FILE   *file;               /* the output file */
+  uschar *buffer;             /* text that is being kept, or NULL */
+  int     length;             /* length of kept text so far */
+  uschar *row;                /* buffer for one row when not keeping */
+  int     rowbytes;           /* bytes in a row of output pixels */
+  int     ncomp;              /* components per pixel */
+  int     width;              /* input pixel width */
+  int     depth;              /* input pixel depth */
+  int     outwidth;           /* output pixel width */
+  int     outdepth;           /* output pixel depth */
+  int     inrow;              /* number of input rows seen */
+  int     rows;               /* number of input rows in the sums */
+  int    *colmap;             /* output column for each input column */
+  int    *colcount;           /* input columns for each output column */
+  int    *sums;               /* sums for a row of output pixels */
+  uschar *avg;                /* a row of averaged output pixels */
+} imageout;
+
+static hash_table *image_table = NULL;
+static int image_kept = 0;
+
 #if SUPPORT_JPEG || SUPPORT_PNG
 static int image_width;
 static int image_depth;
-#endif
-
-#if SUPPORT_JPEG
-static int jpeg_ncomp;
-#endif
-
-#if SUPPORT_PNG
-static int png_rowbytes;
+static int image_ncomp;
+static int image_rowbytes;
 #endif
 
 
@@ -44,7 +66,8 @@ give_png_image_data(int width, int depth, int rowbytes)
 {
 image_width = width;
 image_depth = depth;
-png_rowbytes = rowbytes;
+image_ncomp = rowbytes/width;
+image_rowbytes = rowbytes;
 DEBUG(D_object)
   debug_printf("PNG pixel width=%d depth=%d rowbytes=%d\n", width, depth,
     rowbytes);
@@ -73,7 +96,8 @@ give_jpeg_image_data(int width, int depth, int ncomp)
 {
 image_width = width;
 image_depth = depth;
-jpeg_ncomp = ncomp;
+image_ncomp = ncomp;
+image_rowbytes = width * ncomp;
 DEBUG(D_object)
   debug_printf("JPEG pixel width=%d depth=%d ncomp=%d\n", width, depth, ncomp);
 }
@@ -81,34 +105,109 @@ DEBUG(D_object)
 
 
 
+/*************************************************
+*         Output one row of an image in hex      *
+*************************************************/
+
+/* The hex data is made either in the text that is being kept for the image,
+or in the row buffer, which is then written out. The lines are kept to a
+reasonable length.
+
+Arguments:
+  out            the imageout block
+  scanline       points to the row
+  n              the number of bytes in the row
+
+Returns:         nothing
+*/
+
+#if SUPPORT_JPEG || SUPPORT_PNG
+static void
+image_hex_row(imageout *out, uschar *scanline, int n)
+{
+int i;
+uschar *p = (out->buffer != NULL)? out->buffer + out->length : out->row;
+uschar *start = p;
+
+if (n > out->rowbytes) n = out->rowbytes;  /* Be safe */
+
+for (i = 0; i < n; i++)
+  {
+  if ((i & 31) == 0) *p++ = '\n';
+  *p++ = "0123456789abcdef"[scanline[i] >> 4];
+  *p++ = "0123456789abcdef"[scanline[i] & 15];
+  }
+*p++ = '\n';
+
+if (out->buffer != NULL) out->length += p - start;
+  else (void)fwrite(start, 1, p - start, out->file);
+}
+#endif
+
+
+
 /*************************************************
 *    Callback from JPEG to output one scan line  *
 *************************************************/
 
 /* This function is called from read_JPEG_file() to pass back the scan lines
-that comprise the image. We write out the hext data, keeping the lines to a
-reasonable length.
+that comprise the image, and from write_png_data() for the rows of a PNG
+image. Unless the image is being reduced, each line is output as it stands.
+Otherwise, it is added into the sums for the output row to which it belongs,
+and when the last line for that row has been seen, the averages are output.
 
 Arguments:
   scanline       points to the line
   row_stride     the stride (number of elements in the line)
-  token          token that was passed to read_JPEF_file()
+  token          the imageout block
 
 Returns:         nothing
 */
 
-#if SUPPORT_JPEG
+#if SUPPORT_JPEG || SUPPORT_PNG
 void
 put_scanline_someplace(uschar *scanline, int row_stride, void *token)
 {
-int i;
-FILE *outfile = (FILE *)token;
-for (i = 0; i < row_stride; i++)
+int x, c, n;
+imageout *out = (imageout *)token;
+
+if (out->sums == NULL)
+  {
+  image_hex_row(out, scanline, row_stride);
+  return;
+  }
+
+/* Add this row into the sums for its output row. */
+
+if (row_stride > out->width * out->ncomp) row_stride = out->width * out->ncomp;
+for (x = 0; x < row_stride/out->ncomp; x++)
+  {
+  int *sum = out->sums + out->colmap[x] * out->ncomp;
+  for (c = 0; c < out->ncomp; c++) sum[c] += *scanline++;
+  }
+out->rows++;
+
+/* If the next input row starts a new output row, or this is the last row,
+output the averages and clear the sums. */
+
+out->inrow++;
+if (out->inrow < out->depth &&
+    (out->inrow * out->outdepth)/out->depth ==
+    ((out->inrow - 1) * out->outdepth)/out->depth)
+  return;
+
+for (x = 0; x < out->outwidth; x++)
   {
-  if ((i & 31) == 0) (void)fprintf(outfile, "\n");
-  (void)fprintf(outfile, "%02x", ((unsigned char *)scanline)[i]);
+  n = out->colcount[x] * out->rows;
+  for (c = 0; c < out->ncomp; c++)
+    {
+    int k = x * out->ncomp + c;
+    out->avg[k] = (n == 0)? 0 : (out->sums[k] + n/2)/n;
+    out->sums[k] = 0;
+    }
   }
-(void)fprintf(outfile, "\n");
+out->rows = 0;
+image_hex_row(out, out->avg, out->outwidth * out->ncomp);
 }
 #endif
 
@@ -142,68 +241,58 @@ return depth;
 
 
 /*************************************************
-*        Open the file for an image object       *
+*    Find the path and format of an image file   *
 *************************************************/
 
-/* This is used both when finding the depth of an object, and when eventually
-outputting it.
+/* This is used when finding the size of an image object and when outputting
+it, and also when looking for images to prefetch, for which no message is
+wanted. The key for the image's cache entry is the format number followed by
+the path.
 
 Arguments:
-  i          the <imageobject> item
+  j          the <imagedata> item
+  buffer     where to put the key
   msg        where to put a problem message
-  dptr       where to return the <imagedata> item
-  fnptr      where to return the filename pointer
-  piform     where to return the image format type
 
-Returns:     an open file or NULL
+Returns:     TRUE if all is well
 */
 
-static FILE *
-object_file(item *i, uschar **msg, item **dptr, uschar **fnptr, int *piform)
+static BOOL
+object_path(item *j, uschar *buffer, uschar **msg)
 {
-item *j;
 paramstr *pfile, *pform;
-FILE *f;
-uschar *s;
+uschar *s, *path;
 uschar formname[24];
-uschar buffer[1024];
-
-for (j = i->next; j != i->partner; j = j->next)
-  if (Ustrcmp(j->name, "imagedata") == 0) break;
-
-if ((*dptr = j) == i->partner)
-  {
-  *msg = US": no <imagedata> found";
-  return NULL;
-  }
+int iform;
 
 pfile = misc_param_find(j, US"fileref");
 if (pfile == NULL)
   {
   *msg = US": fileref missing";
-  return NULL;
+  return FALSE;
   }
 
+path = buffer + 1;
 if ((pfile->value)[0] == '/')
-  Ustrcpy(buffer, pfile->value);
+  Ustrcpy(path, pfile->value);
 else
   {
   uschar *slash = Ustrrchr(read_filename, '/');
   if (slash == NULL)
-    (void)sprintf(CS buffer, "./%s", pfile->value);
+    (void)sprintf(CS path, "./%s", pfile->value);
   else
-    (void)sprintf(CS buffer, "%.*s/%s", slash - read_filename, read_filename,
+    (void)sprintf(CS path, "%.*s/%s", slash - read_filename, read_filename,
       pfile->value);
   }
 
 pform = misc_param_find(j, US"format");
 if (pform == NULL)
   {
-  uschar *dot = Ustrrchr(buffer, '.');
+  uschar *dot = Ustrrchr(path, '.');
   if (dot == NULL)
     {
     *msg = US": format missing and file has no extension";
-    return NULL;
+    return FALSE;
     }
   (void)sprintf(CS formname, "%.*s", sizeof(formname) -1, dot + 1);
   }
@@ -214,45 +303,214 @@ for (s = formname; *s != 0; s++) *s = toupper(*s);
 if (Ustrcmp(formname, "EPS") == 0 ||
     Ustrcmp(formname, "PS") == 0)
   {
-  *piform = IFORM_EPS;
+  iform = IFORM_EPS;
   }
 else if (Ustrcmp(formname, "JPEG") == 0 ||
          Ustrcmp(formname, "JPG") == 0)
   {
   #if SUPPORT_JPEG
-  *piform = IFORM_JPG;
+  iform = IFORM_JPG;
   #else
   *msg = US": SDoP was not compiled with JPEG support";
-  return NULL;
+  return FALSE;
   #endif
   }
 else if (Ustrcmp(formname, "PNG") == 0)
   {
   #if SUPPORT_PNG
-  *piform = IFORM_PNG;
+  iform = IFORM_PNG;
   #else
   *msg = US": SDoP was not compiled with PNG support";
-  return NULL;
+  return FALSE;
   #endif
   }
 else
   {
   *msg = US": file format unrecognized";
+  return FALSE;
+  }
+
+buffer[0] = '0' + iform;
+return TRUE;
+}
+
+
+
+/*************************************************
+*       Find or create an image's cache entry    *
+*************************************************/
+
+/*
+Argument:  the key, as set up by object_path()
+Returns:   the cache entry
+*/
+
+static imagecache *
+image_find(uschar *key)
+{
+imagecache *ic;
+tree_node *tn = hash_search(image_table, key);
+if (tn != NULL) return (imagecache *)(tn->data.ptr);
+
+tn = misc_malloc(sizeof(tree_node) + Ustrlen(key));
+Ustrcpy(tn->name, key);
+(void)hash_insertnode(&image_table, tn);
+
+ic = misc_malloc(sizeof(imagecache));
+ic->filename = tn->name + 1;
+ic->refs = 0;
+ic->known = FALSE;
+ic->bbset = FALSE;
+ic->width = ic->depth = ic->ncomp = ic->rowbytes = 0;
+ic->data = NULL;
+ic->datalength = ic->datawidth = ic->datadepth = 0;
+tn->data.ptr = ic;
+return ic;
+}
+
+
+
+/*************************************************
+*        Find the image for an image object      *
+*************************************************/
+
+/* This is used both when finding the depth of an object, and when eventually
+outputting it. The first time an image file is used, it is read to find its
+bounding box or pixel size, which are kept, so that later calls need not open
+it.
+
+Arguments:
+  i          the <imageobject> item
+  msg        where to put a problem message
+  dptr       where to return the <imagedata> item
+  piform     where to return the image format type
+
+Returns:     the image's cache entry, or NULL
+*/
+
+static imagecache *
+object_image(item *i, uschar **msg, item **dptr, int *piform)
+{
+item *j;
+imagecache *ic;
+FILE *f;
+uschar buffer[1024];
+
+#if SUPPORT_PNG
+uschar *pngmsg;
+#endif
+
+for (j = i->next; j != i->partner; j = j->next)
+  if (Ustrcmp(j->name, "imagedata") == 0) break;
+
+if ((*dptr = j) == i->partner)
+  {
+  *msg = US": no <imagedata> found";
   return NULL;
   }
 
-*fnptr = misc_malloc(Ustrlen(buffer) + 1);
-Ustrcpy(*fnptr, buffer);
+if (!object_path(j, buffer, msg)) return NULL;
+ic = image_find(buffer);
+*piform = buffer[0] - '0';
+if (ic->known) return ic;
 
-f = Ufopen(buffer, "rb");
+f = Ufopen(ic->filename, "rb");
 if (f == NULL)
   {
-  error(74, buffer, "image object", strerror(errno));
+  error(74, ic->filename, "image object", strerror(errno));
   *msg = US": failed to open file";
   return NULL;
   }
 
-return f;
+stats.images_read++;
+
+switch(*piform)
+  {
+  case IFORM_EPS:
+  while (Ufgets(buffer, sizeof(buffer), f) != NULL)
+    {
+    if (sscanf(CS buffer, "%%%%BoundingBox: %lf %lf %lf %lf", &ic->bb[0],
+          &ic->bb[1], &ic->bb[2], &ic->bb[3]) == 4)
+      {
+      ic->bbset = TRUE;
+      break;
+      }
+    }
+  break;
+
+  #if SUPPORT_JPEG
+  case IFORM_JPG:
+  read_JPEG_file(f, TRUE, NULL);
+  break;
+  #endif
+
+  #if SUPPORT_PNG
+  case IFORM_PNG:
+  if (!read_PNG_file(f, TRUE, &pngmsg)) error(109, pngmsg);  /* Hard */
+  break;
+  #endif
+  }
+
+#if SUPPORT_JPEG || SUPPORT_PNG
+if (*piform != IFORM_EPS)
+  {
+  ic->width = image_width;
+  ic->depth = image_depth;
+  ic->ncomp = image_ncomp;
+  ic->rowbytes = image_rowbytes;
+  ic->bb[0] = 0.0;
+  ic->bb[1] = 0.0;
+  ic->bb[2] = (double)image_width;
+  ic->bb[3] = (double)image_depth;
+  ic->bbset = TRUE;
+  }
+#endif
+
+fclose(f);
+ic->known = TRUE;
+return ic;
+}
+
+
+
+/*************************************************
+*        Prefetch the images for a document      *
+*************************************************/
+
+/* This is called soon after the input has been read. It counts the number of
+<imagedata> items that use each image file, so that the output for an image
+that is used more than once can be kept, and it asks the system to start
+reading each file, so that it is in memory by the time its size is needed.
+Problems are ignored here; they are reported when the image is used.
+
+Argument:  the item list
+Returns:   TRUE
+*/
+
+BOOL
+object_prefetch(item *item_list)
+{
+item *i;
+uschar *save_filename = read_filename;
+
+for (i = item_list; i != NULL; i = i->next)
+  {
+  if (Ustrcmp(i->name, "#FILENAME") == 0)
+    read_filename = i->p.string;
+  else if (Ustrcmp(i->name, "imagedata") == 0)
+    {
+    uschar *msg;
+    uschar buffer[1024];
+    if (object_path(i, buffer, &msg))
+      {
+      imagecache *ic = image_find(buffer);
+      if (ic->refs++ == 0) sys_prefetch(ic->filename);
+      }
+    }
+  }
+
+read_filename = save_filename;
+return TRUE;
 }
 
 
@@ -266,28 +524,24 @@ parameter is given, get the depth from the bounding box. If no bounding box is
 found, but both "width" and "depth" are available, make up a bounding box.
 
 Argument:
-  f        the open object file
-  iform    the format of the file
+  ic       the image's cache entry
   idata    the <imagedata> item
   scptr    where to return the scale (fixed point)
   bb       where to return the bounding box (double)
+  quiet    TRUE to suppress error messages
 
 Returns:   the depth or -1
 */
 
 static int
-imageobject_depth(FILE *f, int iform, item *idata, int *scptr, double *bb)
+imageobject_depth(imagecache *ic, item *idata, int *scptr, double *bb,
+  BOOL quiet)
 {
 int depth = -1;
 int width = -1;
 int scale = -1;
-BOOL bbset = FALSE;
+BOOL bbset = ic->bbset;
 paramstr *p;
-uschar buffer[1024];
-
-#if SUPPORT_PNG
-uschar *msg;
-#endif
 
 p = misc_param_find(idata, US"depth");
 if (p != NULL)
@@ -305,46 +559,7 @@ if (p != NULL)
   width = misc_scale_number(width, t);
   }
 
-switch(iform)
-  {
-  case IFORM_EPS:
-  while (Ufgets(buffer, sizeof(buffer), f) != NULL)
-    {
-    if (sscanf(CS buffer, "%%%%BoundingBox: %lf %lf %lf %lf", &bb[0], &bb[1],
-          &bb[2], &bb[3]) == 4)
-      {
-      bbset = TRUE;
-      break;
-      }
-    }
-  break;
-
-  #if SUPPORT_JPEG
-  case IFORM_JPG:
-  read_JPEG_file(f, TRUE, NULL);
-  bb[0] = 0.0;
-  bb[1] = 0.0;
-  bb[2] = (double)image_width;
-  bb[3] = (double)image_depth;
-  bbset = TRUE;
-  break;
-  #endif
-
-  #if SUPPORT_PNG
-  case IFORM_PNG:
-  if (!read_PNG_file(f, &msg)) error(109, msg);  /* Hard */
-  bb[0] = 0.0;
-  bb[1] = 0.0;
-  bb[2] = (double)image_width;
-  bb[3] = (double)image_depth;
-  bbset = TRUE;
-  break;
-  #endif
-
-  default:
-  error(80, "imageobject_depth()");   /* Hard error */
-  break;
-  }
+if (bbset) memcpy(bb, ic->bb, sizeof(ic->bb));
 
 /* Find the scale */
 
@@ -352,14 +567,14 @@ p = misc_param_find(idata, US"scale");
 if (p != NULL)
   {
   scale = misc_get_number(p->value) * 10;
-  if (scale < 0) error(75, p->value, "image scale factor");
+  if (scale < 0 && !quiet) error(75, p->value, "image scale factor");
   }
 
 p = misc_param_find(idata, US"scalefit");
 if (p != NULL && Ustrcmp(p->value, "1") == 0)
   {
-  if (scale > 0) error(77);
-  if (!bbset) error(76);
+  if (scale > 0 && !quiet) error(77);
+  if (!bbset) { if (!quiet) error(76); }
     else scale = (width > 0)? (int)((double)(width)/(bb[2]-bb[0])) :
                  (depth > 0)? (int)((double)(depth)/(bb[3]-bb[1])) :
                               (int)((double)(page_linewidth)/(bb[2]-bb[0]));
@@ -431,16 +646,204 @@ if (misc_get_dimensions(n, p->value, deltas, FALSE))
 
 
 
+/*************************************************
+*      Find the size of an image's hex text      *
+*************************************************/
+
+/*
+Arguments:
+  rowbytes   the number of bytes in a row of pixels
+  rows       the number of rows
+
+Returns:     the number of bytes of text
+*/
+
+static int
+image_hex_size(int rowbytes, int rows)
+{
+return (2*rowbytes + (rowbytes + 31)/32 + 1) * rows;
+}
+
+
+
+/*************************************************
+*          Write the data for an image           *
+*************************************************/
+
+/* For an EPS file, the lines that are not comments are copied; for a JPEG or
+PNG image, the pixels are written in hex, reduced to the given size if it is
+smaller than the image. If the image is used more than once, and there is room
+within the limit, the text is kept, so that next time it can be copied out
+without reading the file again.
+
+Arguments:
+  ic         the image's cache entry
+  iform      the format of the file
+  f          the open image file, or NULL if the text has been kept
+  outwidth   the pixel width to output
+  outdepth   the pixel depth to output
+  outfile    the output file
+
+Returns:     nothing; the image file is closed
+*/
+
+static void
+image_write_data(imagecache *ic, int iform, FILE *f, int outwidth,
+  int outdepth, FILE *outfile)
+{
+imageout out;
+int size;
+BOOL reduce = outwidth != ic->width || outdepth != ic->depth;
+int outrowbytes = reduce? outwidth * ic->ncomp : ic->rowbytes;
+int rowsize = image_hex_size(outrowbytes, 1);
+BOOL failed = FALSE;
+
+#if SUPPORT_PNG
+uschar *msg;
+#endif
+
+if (f == NULL)
+  {
+  (void)fwrite(ic->data, 1, ic->datalength, outfile);
+  stats.images_reused++;
+  return;
+  }
+
+/* Find the most that the text can be, and decide whether to keep it. Only
+one version of an image's text is kept. */
+
+if (iform == IFORM_EPS)
+  {
+  (void)fseek(f, 0, SEEK_END);
+  size = (int)ftell(f);
+  rewind(f);
+  }
+else size = rowsize * outdepth;
+
+out.file = outfile;
+out.buffer = (ic->refs > 1 && ic->data == NULL && size >= 0 &&
+  size < MAXIMAGECACHE - image_kept)? misc_malloc(size + 1) : NULL;
+out.length = 0;
+out.row = (out.buffer == NULL && iform != IFORM_EPS)?
+  misc_malloc(rowsize) : NULL;
+out.rowbytes = outrowbytes;
+out.ncomp = ic->ncomp;
+out.width = ic->width;
+out.depth = ic->depth;
+out.outwidth = outwidth;
+out.outdepth = outdepth;
+out.inrow = out.rows = 0;
+out.colmap = out.colcount = out.sums = NULL;
+out.avg = NULL;
+
+/* When reducing, set up the output column for each input column, and the
+number of input columns that are averaged for each output column. */
+
+if (reduce)
+  {
+  int x;
+  out.colmap = misc_malloc(ic->width * sizeof(int));
+  out.colcount = misc_malloc(outwidth * sizeof(int));
+  out.sums = misc_malloc(outrowbytes * sizeof(int));
+  out.avg = misc_malloc(outrowbytes);
+  memset(out.colcount, 0, outwidth * sizeof(int));
+  memset(out.sums, 0, outrowbytes * sizeof(int));
+  for (x = 0; x < ic->width; x++)
+    {
+    out.colmap[x] = (x * outwidth)/ic->width;
+    out.colcount[out.colmap[x]]++;
+    }
+  }
+
+switch (iform)
+  {
+  case IFORM_EPS:
+    {
+    uschar buffer[1024];
+    while (Ufgets(buffer, sizeof(buffer), f) != NULL)
+      {
+      int len;
+      if (buffer[0] == '%') continue;
+      if (out.buffer == NULL)
+        {
+        (void)fprintf(outfile, "%s", buffer);
+        continue;
+        }
+      len = Ustrlen(buffer);
+      memcpy(out.buffer + out.length, buffer, len);
+      out.length += len;
+      }
+    }
+  break;
+
+  #if SUPPORT_JPEG
+  case IFORM_JPG:
+  failed = !read_JPEG_file(f, FALSE, (void *)(&out));  /* Closes f on error */
+  stats.images_decoded++;
+  break;
+  #endif
+
+  #if SUPPORT_PNG
+  case IFORM_PNG:
+  if (!read_PNG_file(f, FALSE, &msg)) error(109, msg);  /* Hard */
+  write_png_data((void *)(&out));
+  stats.images_decoded++;
+  break;
+  #endif
+  }
+
+if (!failed) fclose(f);
+if (out.row != NULL) misc_free(out.row, rowsize);
+
+if (reduce)
+  {
+  misc_free(out.colmap, ic->width * sizeof(int));
+  misc_free(out.colcount, outwidth * sizeof(int));
+  misc_free(out.sums, outrowbytes * sizeof(int));
+  misc_free(out.avg, outrowbytes);
+  }
+
+/* If the text has been kept, write it out. It is not kept if decoding
+failed. */
+
+if (out.buffer != NULL)
+  {
+  (void)fwrite(out.buffer, 1, out.length, outfile);
+  if (failed) misc_free(out.buffer, size + 1);
+  else
+    {
+    ic->data = out.buffer;
+    ic->datalength = out.length;
+    ic->datawidth = outwidth;
+    ic->datadepth = outdepth;
+    image_kept += size + 1;
+    DEBUG(D_object) debug_printf("Kept %d bytes of output for %s\n",
+      out.length, ic->filename);
+    }
+  }
+}
+
+
+
 /*************************************************
 *         Output an image object                 *
 *************************************************/
 
-/* This function is called from write.c to output an image object.
+/* This function is called from write.c to output an image object. If a
+maximum resolution has been set by -r, a JPEG or PNG image whose pixels would
+be drawn at a higher resolution is reduced in size; it is still drawn at the
+same size on the page. Images whose rows are not whole 8-bit pixels of one or
+three components are left alone.
+
+When a page is being tracked for a parallel writer, the image is measured but
+not written, so that its depth is taken into account as it would be if it were
+written. This is requested by a NULL output file. No errors are given, because
+the writer of the page gives them.
 
 Arguments:
   i           the <imageobject>
   ypos        the y-position on the page
-  outfile     the output file
+  outfile     the output file, or NULL to measure only
   pwidth      where to return the width
   pjustify    where to return the justification
 
@@ -450,22 +853,62 @@ Returns:      the depth of the image, or -1 if there's a problem
 int
 object_write_image(item *i, int ypos, FILE *outfile, int *pwidth, int *pjustify)
 {
-FILE *f;
+FILE *f = NULL;
 item *idata;
-int depth, bbdepth, scale, x, y, iform;
+imagecache *ic;
+int depth, bbdepth, scale, x, y, iform, outwidth, outdepth;
 uschar *msg;
-uschar *filename;
 paramstr *p;
 double bb[4];
-uschar buffer[1024];
 
-f = object_file(i, &msg, &idata, &filename, &iform);
-if (f == NULL) return -1;
+ic = object_image(i, &msg, &idata, &iform);
+if (ic == NULL) return -1;
 
 /* The values that are returned are all scaled, but we also need the scale
 value to embed in the PostScript. */
 
-depth = imageobject_depth(f, iform, idata, &scale, bb);
+depth = imageobject_depth(ic, idata, &scale, bb, outfile == NULL);
+
+/* An image is drawn at its pixel size in points, multiplied by the scale, so
+its resolution is 72000/scale dots per inch. */
+
+outwidth = ic->width;
+outdepth = ic->depth;
+
+if (image_resolution > 0 && iform != IFORM_EPS &&
+    (ic->ncomp == 1 || ic->ncomp == 3) && ic->rowbytes == ic->width * ic->ncomp)
+  {
+  double r = (double)image_resolution * scale / 72000.0;
+  if (r < 1.0)
+    {
+    outwidth = (int)(ic->width * r + 0.5);
+    outdepth = (int)(ic->depth * r + 0.5);
+    if (outwidth < 1) outwidth = 1;
+    if (outdepth < 1) outdepth = 1;
+    if (outfile != NULL)
+      {
+      stats.image_bytes_saved += image_hex_size(ic->rowbytes, ic->depth) -
+        image_hex_size(outwidth * ic->ncomp, outdepth);
+      DEBUG(D_object) debug_printf("Reducing %s from %dx%d to %dx%d\n",
+        ic->filename, ic->width, ic->depth, outwidth, outdepth);
+      }
+    }
+  }
+
+/* Unless the output for the image has been kept at this size, the file is
+needed. Open it before writing anything. */
+
+if (ic->data == NULL || ic->datawidth != outwidth ||
+    ic->datadepth != outdepth)
+  {
+  f = Ufopen(ic->filename, "rb");
+  if (f == NULL)
+    {
+    if (outfile != NULL)
+      error(74, ic->filename, "image object", strerror(errno));
+    return -1;
+    }
+  }
 
 bbdepth = (int)((bb[3] - bb[1]) * 1000);
 
@@ -497,65 +940,50 @@ moving an image about, to cope with poor bounding boxes or other problems. */
 
 adjust_image_position(i, &x, &y);
 
-/* Now we can generate the output */
+/* Now we can generate the output, unless only measuring */
+
+if (outfile == NULL)
+  {
+  if (f != NULL) (void)fclose(f);
+  return depth;
+  }
 
 (void)fprintf(outfile, "\n\n");
 
-switch (iform)
+if (iform == IFORM_EPS)
   {
-  case IFORM_EPS:
   (void)fprintf(outfile,
     "/picsave save def/a4{null pop}def\n"
     "/showpage{initgraphics}def/copypage{null pop}def\n");
   (void)fprintf(outfile, "%s ", misc_formatfixed(x));
   (void)fprintf(outfile, "%s translate\n", misc_formatfixed(y));
   (void)fprintf(outfile, "%s dup scale\n", misc_formatfixed(scale));
-  rewind(f);
-  while (Ufgets(buffer, sizeof(buffer), f) != NULL)
-    { if (buffer[0] != '%') (void)fprintf(outfile, "%s", buffer); }
+  image_write_data(ic, iform, f, outwidth, outdepth, outfile);
   (void)fprintf(outfile, "picsave restore\n");
-  break;
+  }
 
-  #if SUPPORT_JPEG
-  case IFORM_JPG:
-  (void)fprintf(outfile, "gsave\n");
-  (void)fprintf(outfile, "/picstr %d string def\n", image_width * jpeg_ncomp);
-  (void)fprintf(outfile, "%s ", misc_formatfixed(x));
-  (void)fprintf(outfile, "%s translate\n", misc_formatfixed(y));
-  (void)fprintf(outfile, "%s dup scale\n", misc_formatfixed(scale));
-  (void)fprintf(outfile, "%d %d scale\n", image_width, image_depth);
-  (void)fprintf(outfile, "%d %d %d [%d 0 0 -%d 0 %d]\n", image_width,
-    image_depth, 8, image_width, image_depth, image_depth);
-  (void)fprintf(outfile, "{currentfile picstr readhexstring pop}\n");
-  (void)fprintf(outfile, "%s\n", (jpeg_ncomp == 1)?
-    "image" : "false 3 colorimage");
-  rewind(f);
-  read_JPEG_file(f, FALSE, (void *)outfile);
-  (void)fprintf(outfile, "grestore\n");
-  break;
-  #endif
+/* JPEG and PNG images are output in the same way. The image is drawn at the
+same size, whatever its number of pixels. */
 
-  #if SUPPORT_PNG
-  case IFORM_PNG:
+else
+  {
   (void)fprintf(outfile, "gsave\n");
-  (void)fprintf(outfile, "/picstr %d string def\n", png_rowbytes);
+  (void)fprintf(outfile, "/picstr %d string def\n",
+    (outwidth == ic->width && outdepth == ic->depth)?
+      ic->rowbytes : outwidth * ic->ncomp);
   (void)fprintf(outfile, "%s ", misc_formatfixed(x));
   (void)fprintf(outfile, "%s translate\n", misc_formatfixed(y));
   (void)fprintf(outfile, "%s dup scale\n", misc_formatfixed(scale));
-  (void)fprintf(outfile, "%d %d scale\n", image_width, image_depth);
-  (void)fprintf(outfile, "%d %d %d [%d 0 0 -%d 0 %d]\n", image_width,
-    image_depth, 8, image_width, image_depth, image_depth);
+  (void)fprintf(outfile, "%d %d scale\n", ic->width, ic->depth);
+  (void)fprintf(outfile, "%d %d %d [%d 0 0 -%d 0 %d]\n", outwidth,
+    outdepth, 8, outwidth, outdepth, outdepth);
   (void)fprintf(outfile, "{currentfile picstr readhexstring pop}\n");
-  (void)fprintf(outfile, "%s\n", (png_rowbytes/image_width == 1)?
+  (void)fprintf(outfile, "%s\n", (ic->ncomp == 1)?
     "image" : "false 3 colorimage");
-  write_png_data(outfile);
+  image_write_data(ic, iform, f, outwidth, outdepth, outfile);
   (void)fprintf(outfile, "grestore\n");
-  break;
-  #endif
   }
 
-
-fclose(f);
 return depth;
 }
 
@@ -582,7 +1010,6 @@ int caption_depth = 0;
 item *j;
 item *idata;
 uschar *msg = US"";
-uschar *filename;
 
 /* If there's a caption, find its depth */
 
@@ -612,19 +1039,18 @@ for (j = i->next; j != i->partner; j = j->next)
   if (Ustrcmp(j->name, "imageobject") == 0)
     {
     int iform;
-    FILE *f = object_file(j, &msg, &idata, &filename, &iform);
-    if (f != NULL)
+    imagecache *ic = object_image(j, &msg, &idata, &iform);
+    if (ic != NULL)
       {
       double bb[4];
       int scale;
-      int depth = imageobject_depth(f, iform, idata, &scale, bb);
-      fclose(f);
+      int depth = imageobject_depth(ic, idata, &scale, bb, FALSE);
       if (depth >= 0)
         {
         *pwidth = (int)(bb[2] - bb[0]) * 1000;
         DEBUG(D_object) debug_printf(
           "Width, depth, and caption depth of object %s are %d %d %d\n",
-            filename, *pwidth, depth, caption_depth);
+            ic->filename, *pwidth, depth, caption_depth);
         return caption_depth + depth;
         }
       msg = US": failed to find depth of object";
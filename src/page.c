@@ -7,10 +7,72 @@
 /* This module contains functions for doing things to pages. */
 
 #include "sdop.h"
+#include <unistd.h>     /* For _exit() in pagination workers */
 
 
 enum { ACCEPT_OK, ACCEPT_NO, ACCEPT_SP };
 
+/* Ways in which the model for optimal page breaking can end */
+
+enum { MODEL_FORCED, MODEL_WINDOW, MODEL_UNKNOWN };
+
+/* Penalties for optimal page breaking. A page costs PB_PAGE in addition to its
+badness, so that spreading material over more pages is not free, and there are
+penalties for breaking inside a paragraph or a table. When the lookahead does
+not reach a forced page break, the depth of the last page in the window is
+charged at PB_CARRY for a full page, which is high enough that material is not
+pushed forward at the cost of needing more pages than greedy filling. */
+
+#define PB_PAGE         10
+#define PB_PARA_SPLIT   50
+#define PB_TABLE_SPLIT  30
+#define PB_CARRY        1000000.0
+
+
+/*************************************************
+*                Local structures                *
+*************************************************/
+
+/* Data about a table, found by scan_table() */
+
+typedef struct {
+  tdatastr *td;
+  item *tgroup;
+  item *tbody;
+  item *tfoot;
+  int   titledepth;
+  int   total;
+  int   rcount;
+  int   hrcount;
+  int   rdepths[MAXTABLEROWS];
+  item *ritems[MAXTABLEROWS];
+  BOOL  rseps[MAXTABLEROWS];
+} tablescan;
+
+/* One box in the vertical list that is modelled for optimal page breaking. A
+box is a line of a paragraph, a row of a table, or a media object. The space
+before a box is discarded if a page starts with it. Depths are kept as running
+totals, separately. */
+
+typedef struct {
+  int   before_min;     /* Minimum space before the box */
+  int   before_max;     /* Maximum space before the box */
+  int   penalty;        /* Penalty for a break after the box; -1 if none */
+} pagebox;
+
+/* A range of chapters whose page depths are found by a worker process when
+paginating in parallel. */
+
+typedef struct {
+  item *start;          /* The item at which the range starts */
+  int   pid;            /* The worker's process id, or -1 */
+  int   fd;             /* The parent's end of the worker's pipe */
+  FILE *limits;         /* Where the worker writes its page depths */
+  FILE *err;            /* The worker's standard error (discarded) */
+  int  *list;           /* The page depths, once collected */
+  int   count;          /* The number of page depths */
+} pagerange;
+
 
 /*************************************************
 *               Static variables                 *
@@ -22,8 +84,33 @@ static int  last_after_min;
 static int  last_after_max;
 static int  stretchable;
 static int  usedonpage;
+static int  page_limit;
 static BOOL footnote_encountered;
 
+static item *stream_formatted = NULL;
+
+/* Ranges of chapters for parallel pagination. Range 0 is done by the parent.
+In a worker, range_worker is the range it is doing. */
+
+static pagerange ranges[MAXWRITEWORKERS];
+static int  range_count = 0;
+static int  range_current = 0;
+static int  range_next = 0;
+static int  range_worker = 0;
+static BOOL range_recording = FALSE;
+static long range_boxes = 0;
+
+/* The model for optimal page breaking. Position k is the point before box k;
+the arrays that are indexed by position have one more entry than boxes. */
+
+static pagebox boxes[MAXPAGEBOXES];
+static int     box_height[MAXPAGEBOXES + 1];
+static int     box_stretch[MAXPAGEBOXES + 1];
+static int     box_footnotes[MAXPAGEBOXES + 1];
+static int     best_pages[MAXPAGEBOXES + 1];
+static double  best_demerits[MAXPAGEBOXES + 1];
+static int     best_previous[MAXPAGEBOXES + 1];
+
 
 
 
@@ -106,7 +193,7 @@ if (pg->out != NULL)
   if (tb != NULL)
     {
     int c;
-    uschar *s = tb->string;
+    uschar *s = TBTEXT(tb);
     GETCHAR(c, s);
     if (c == HARD_SPACE) return FALSE;
     }
@@ -154,43 +241,150 @@ return extra;
 
 
 /*************************************************
-*       Handle the fitting of a table            *
+*       Find the depth of a line's footnotes     *
 *************************************************/
 
-/* This function finds the depth of a table and decides whether it will fit
-on the current page, and if not, whether to push it all onto the next page or
-to split it.
+/* Scan the items that comprise each footnote that is referenced from a line in
+order to find its depth. If we hit "row", we are in a table, and need to find
+the row depth. Otherwise, just add up paragraph depths. The overhead for the
+first footnote on a page is not included.
+
+Argument:  the output line
+Returns:   the total depth of the line's footnotes
+*/
+
+static int
+footnote_depth(outputline *ol)
+{
+footnotestr *fn;
+int depth = 0;
+
+for (fn = ol->fnstr; fn != NULL; fn = fn->next)
+  {
+  tdatastr *td = NULL;
+  item *fi = fn->footnote;
+  item *pp;
+
+  for (pp = fi->next; pp != fi->partner; pp = pp->next)
+    {
+    if (Ustrcmp(pp->name, "#TDATA") == 0)
+      {
+      td = pp->p.tdata;
+      depth += td->layparm->beforemax;
+      if ((td->flags & TDF_TOPFRAME) != 0) depth += table_top_frame_space;
+      if ((td->flags & TDF_BOTFRAME) != 0) depth += table_bot_frame_space;
+      }
+    else if (Ustrcmp(pp->name, "row") == 0)
+      {
+      depth += table_row_depth(td, pp);
+      pp = pp->partner;
+      }
+    else if (Ustrcmp(pp->name, "#PCPARA") == 0)
+      {
+      outputline *fol;
+      depth += pp->p.prgrph->layparm->beforemax;
+      for (fol = pp->p.prgrph->out; fol != NULL; fol = fol->next)
+        depth += fol->depth;
+      }
+    }
+  }
+
+return depth;
+}
+
+
+
+/*************************************************
+*     Find the cumulative depths of a paragraph  *
+*************************************************/
+
+/* A paragraph may be considered more than once - when it is modelled for
+optimal page breaking, when it is fitted, and again for each part if it is
+split - so the depths of its lines, including the depths of their footnotes,
+are found once and kept. The vector holds cumulative depths: depths[n] is the
+depth of the first n lines, so the depth of any run of lines is a subtraction.
+The overhead for the first footnote on a page is not included, because it
+depends on what else is on the page; fnline is the first line that has
+footnotes.
+
+Argument:  the paragraph
+Returns:   nothing
+*/
+
+static void
+find_line_depths(paragraph *pg)
+{
+outputline *ol;
+int n = 0;
+
+if (pg->depths != NULL) return;
+
+for (ol = pg->out; ol != NULL; ol = ol->next) n++;
+if (n > MAXPARALINES) error(48, MAXPARALINES);   /* Hard */
+
+pg->depths = misc_malloc((n + 1) * sizeof(int));
+pg->lines = n;
+pg->fnline = -1;
+pg->depths[0] = 0;
+
+for (ol = pg->out, n = 0; ol != NULL; ol = ol->next, n++)
+  {
+  int depth = ol->depth;
+  if (ol->fnstr != NULL)
+    {
+    if (pg->fnline < 0) pg->fnline = n;
+    depth += footnote_depth(ol);
+    }
+  pg->depths[n+1] = pg->depths[n] + depth;
+  }
+}
+
+
+
+/*************************************************
+*    Free the cumulative depths of a paragraph   *
+*************************************************/
+
+/* This is called when a paragraph has been placed on a page.
+
+Argument:  the paragraph
+Returns:   nothing
+*/
+
+static void
+free_line_depths(paragraph *pg)
+{
+if (pg->depths == NULL) return;
+misc_free(pg->depths, (pg->lines + 1) * sizeof(int));
+pg->depths = NULL;
+}
+
+
+
+/*************************************************
+*              Scan a table's rows               *
+*************************************************/
+
+/* This function finds the depth of a table's title and of each of its rows,
+along with the items that are needed if the table has to be split. It is used
+when fitting a table, and when modelling a table for optimal page breaking.
 
 Arguments:
   ip         table item
+  ts         where to put the results
 
-Returns:     ACCEPT_OK if the whole table is accepted
-             ACCEPT_NO if none of the table is accepted
-             ACCEPT_SP if table has been split
+Returns:     nothing
 */
 
-static int
-accept_table(item *ip)
+static void
+scan_table(item *ip, tablescan *ts)
 {
-int total = 0;
-int titledepth = 0;
-int extra = 0;
-int fcount;
-int rcount = 0;
-int hrcount = 0;
-int frcount = 0;
-int rdepths[MAXTABLEROWS];
-item *ritems[MAXTABLEROWS];
-BOOL rseps[MAXTABLEROWS];
+item *j, *k;
 BOOL inhead = FALSE;
-BOOL infoot = FALSE;
-tdatastr *td = NULL;
-tdatastr *tdnew;
-item *j, *k, *fpushed, *lpushed;
-item *tgroup = NULL;
-item *tbody = NULL;
-item *tfoot = NULL;
-item *thead = NULL;
+
+ts->td = NULL;
+ts->tgroup = ts->tbody = ts->tfoot = NULL;
+ts->titledepth = ts->total = ts->rcount = ts->hrcount = 0;
 
 /* Look for a title, and find its depth */
 
@@ -204,30 +398,28 @@ if (j != ip->partner)
     {
     outputline *ol;
     for (ol = k->p.prgrph->out; ol != NULL; ol = ol->next)
-      titledepth += ol->depth;
+      ts->titledepth += ol->depth;
     }
   }
 
 /* Scan the table, counting the number of rows and finding the depth for
 each row. Save each row's item along with its depth. At the same time we
-can remember the table's data block and where it's tbody and thead and tfoot
-start. */
+can remember the table's data block and where it's tbody and tfoot start. */
 
 for (j = ip->next; j != ip->partner; j = j->next)
   {
   if (Ustrcmp(j->name, "#TDATA") == 0)
     {
-    td = j->p.tdata;
+    ts->td = j->p.tdata;
     }
 
   else if (Ustrcmp(j->name, "tbody") == 0)
     {
-    tbody = j;
+    ts->tbody = j;
     }
 
   else if (Ustrcmp(j->name, "thead") == 0)
     {
-    thead = j;
     inhead = TRUE;
     }
 
@@ -239,42 +431,77 @@ for (j = ip->next; j != ip->partner; j = j->next)
 
   else if (Ustrcmp(j->name, "tfoot") == 0)
     {
-    tfoot = j;
-    infoot = TRUE;
-    }
-
-  else if (Ustrcmp(j->name, "/") == 0 &&
-           Ustrcmp(j->partner->name, "tfoot") == 0)
-    {
-    infoot = FALSE;
+    ts->tfoot = j;
     }
 
   else if (Ustrcmp(j->name, "tgroup") == 0)
     {
-    tgroup = j;
+    ts->tgroup = j;
     }
 
   else if (Ustrcmp(j->name, "row") == 0)
     {
-    if (rcount >= MAXTABLEROWS) error(49, MAXTABLEROWS);   /* Hard */
-    ritems[rcount] = j;
-    rseps[rcount] = (j->flags & IF_ROWSEP) != 0;
-    rdepths[rcount] = table_row_depth(td, j);
-    total += rdepths[rcount++];
-    if (inhead) hrcount++;
-    if (infoot) frcount++;
+    int r = ts->rcount;
+    if (r >= MAXTABLEROWS) error(49, MAXTABLEROWS);   /* Hard */
+    ts->ritems[r] = j;
+    ts->rseps[r] = (j->flags & IF_ROWSEP) != 0;
+    ts->rdepths[r] = table_row_depth(ts->td, j);
+    ts->total += ts->rdepths[r];
+    ts->rcount++;
+    if (inhead) ts->hrcount++;
     j = j->partner;
     }
   }    /* End of scan for row depths */
 
 /* Not finding the table's data block is a hard error. */
 
-if (td == NULL) (void)error(42);
+if (ts->td == NULL) (void)error(42);
 
 /* Allow for top and bottom frame space. */
 
-if ((td->flags & TDF_TOPFRAME) != 0) total += table_top_frame_space;
-if ((td->flags & TDF_BOTFRAME) != 0) total += table_bot_frame_space;
+if ((ts->td->flags & TDF_TOPFRAME) != 0) ts->total += table_top_frame_space;
+if ((ts->td->flags & TDF_BOTFRAME) != 0) ts->total += table_bot_frame_space;
+}
+
+
+
+/*************************************************
+*       Handle the fitting of a table            *
+*************************************************/
+
+/* This function finds the depth of a table and decides whether it will fit
+on the current page, and if not, whether to push it all onto the next page or
+to split it.
+
+Arguments:
+  ip         table item
+
+Returns:     ACCEPT_OK if the whole table is accepted
+             ACCEPT_NO if none of the table is accepted
+             ACCEPT_SP if table has been split
+*/
+
+static int
+accept_table(item *ip)
+{
+int extra = 0;
+int fcount;
+tablescan ts;
+tdatastr *td;
+tdatastr *tdnew;
+item *j, *k, *fpushed, *lpushed;
+item *tgroup, *tbody, *tfoot;
+int total, titledepth, rcount, hrcount;
+
+scan_table(ip, &ts);
+td = ts.td;
+tgroup = ts.tgroup;
+tbody = ts.tbody;
+tfoot = ts.tfoot;
+total = ts.total;
+titledepth = ts.titledepth;
+rcount = ts.rcount;
+hrcount = ts.hrcount;
 
 DEBUG(D_page) debug_printf("table: titledepth=%d rows=%d tabledepth=%d "
   "last_after_min/max=%d/%d used=%d\n", titledepth, rcount, total,
@@ -299,7 +526,7 @@ if (rcount < 2) extra = find_title_extra(ip->partner, td->layparm->aftermin);
 /* If everything previously accepted, plus the intermediate space, plus this
 table, plus any extra requirement, fits on the page, accept the table. */
 
-if (usedonpage + last_after_min + total + titledepth + extra <= page_length)
+if (usedonpage + last_after_min + total + titledepth + extra <= page_limit)
   {
   usedonpage += last_after_min + total + titledepth;
   stretchable += last_after_max - last_after_min;   /* Stretchable space */
@@ -322,8 +549,8 @@ if (rcount < 4) return ACCEPT_NO;
 total = usedonpage + last_after_min + titledepth;
 for (fcount = 0; fcount < rcount - 2; fcount++)
   {
-  if (total + rdepths[fcount] > page_length) break;
-  total += rdepths[fcount];
+  if (total + ts.rdepths[fcount] > page_limit) break;
+  total += ts.rdepths[fcount];
   }
 
 DEBUG(D_page) debug_printf("table overflow: %d out of %d rows fit\n",
@@ -341,7 +568,7 @@ stretchable += last_after_max - last_after_min;
 /* Set up the first and last items to be pushed, and remove them from the
 current table. Also remove the <tfoot> part. */
 
-fpushed = ritems[fcount];
+fpushed = ts.ritems[fcount];
 
 for (lpushed = fpushed;
      lpushed->next != tbody->partner;
@@ -379,7 +606,7 @@ tdnew->flags |= TDF_CONTB;       /* Mark new table as continued */
 
 /* Cancel its top frame if the last row had no sep */
 
-if (rseps[fcount-1]) tdnew->flags |= TDF_TOPFRAME;
+if (ts.rseps[fcount-1]) tdnew->flags |= TDF_TOPFRAME;
   else tdnew->flags &= ~TDF_TOPFRAME;
 
 k = misc_malloc(sizeof(item));
@@ -444,67 +671,24 @@ paragraph *newpg;
 textblock *lastt;
 textblock *tb;
 item *app, *bpp, *ipp, *pp;
-int i;
+int i, n, bot, top;
 int extra = 0;
-int total = 0;
-int pcount = 0;
-int pdepths[MAXPARALINES];
-
-/* Set up a vector of the depth of each line, including footnote depths where
-relevant. The first footnote on a page adds an extra overhead. */
-
-for (ol = pg->out; ol != NULL; ol = ol->next)
-  {
-  footnotestr *fn;
-  int depth = ol->depth;
-  if (pcount >= MAXPARALINES) error(48, MAXPARALINES);   /* Hard */
-
-  /* Process each footnote */
-
-  for (fn = ol->fnstr; fn != NULL; fn = fn->next)
-    {
-    tdatastr *td = NULL;
-    item *fi = fn->footnote;
+int overhead = 0;
+int total, pcount;
 
-    if (!footnote_encountered)
-      {
-      depth += footnote_overhead;
-      footnote_encountered = TRUE;
-      }
-
-    /* Scan the items that comprise the footnote in order to find its depth. If
-    we hit "row", we are in a table, and need to find the row depth. Otherwise,
-    just add up paragraph depths. */
-
-    for (pp = fi->next; pp != fi->partner; pp = pp->next)
-      {
-      if (Ustrcmp(pp->name, "#TDATA") == 0)
-        {
-        td = pp->p.tdata;
-        depth += td->layparm->beforemax;
-        if ((td->flags & TDF_TOPFRAME) != 0) depth += table_top_frame_space;
-        if ((td->flags & TDF_BOTFRAME) != 0) depth += table_bot_frame_space;
-        }
-      else if (Ustrcmp(pp->name, "row") == 0)
-        {
-        depth += table_row_depth(td, pp);
-        pp = pp->partner;
-        }
-      else if (Ustrcmp(pp->name, "#PCPARA") == 0)
-        {
-        outputline *fol;
-        depth += pp->p.prgrph->layparm->beforemax;
-        for (fol = pp->p.prgrph->out; fol != NULL; fol = fol->next)
-          depth += fol->depth;
-        }
-      }
-    }
+/* Get the cumulative depths of the lines, including footnote depths where
+relevant. The first footnote on a page adds an extra overhead, which is counted
+with the first line that has footnotes. */
 
-  /* We now have the depth of the line plus the depth of the associated
-  foonotes, if any. */
+find_line_depths(pg);
+pcount = pg->lines;
+total = pg->depths[pcount];
 
-  pdepths[pcount++] = depth;
-  total += depth;
+if (pg->fnline >= 0 && !footnote_encountered)
+  {
+  overhead = footnote_overhead;
+  total += overhead;
+  footnote_encountered = TRUE;
   }
 
 /* If we are not at the top of the page adjust spacing after the previous item
@@ -540,7 +724,7 @@ paragraph. The ip item is a #PCPARA item; its predecessor is one of those that
 can contain data, such as <para>, <title>, <literallayout>, etc. After
 accepting, we set last_accepted to its partner, as the last accepted item. */
 
-if (usedonpage + last_after_min + total + extra <= page_length)
+if (usedonpage + last_after_min + total + extra <= page_limit)
   {
   usedonpage += last_after_min + total;
   stretchable += last_after_max - last_after_min;   /* Stretchable space */
@@ -548,6 +732,7 @@ if (usedonpage + last_after_min + total + extra <= page_length)
   if (isindex && isprimary(pg)) last_primary = ip;  /* Save for overflow */
   last_after_min = pg->layparm->aftermin;
   last_after_max = pg->layparm->aftermax;
+  free_line_depths(pg);
   return ACCEPT_OK;
   }
 
@@ -568,6 +753,7 @@ if (extra > 0 && usedonpage == 0 && total <= page_length)
   last_accepted = ip->prev->partner;                /* The </...> element */
   last_after_min = pg->layparm->aftermin;
   last_after_max = pg->layparm->aftermax;
+  free_line_depths(pg);
   return ACCEPT_OK;
   }
 
@@ -578,17 +764,27 @@ if (isindex) return ACCEPT_NO;
 /* Otherwise we have to decide whether and where to split the paragraph. If
 it is non-splittable or if there are fewer than 4 lines, break the page before
 this paragraph. Otherwise fit as much as possible on this page, but always
-ensure that at least two lines are left for the next page. */
+ensure that at least two lines are left for the next page. Because the depths
+are cumulative, the number of lines that fit is found by a binary chop. */
 
 if (contiguous || pcount < 4) return ACCEPT_NO;
 
 total = usedonpage + last_after_min;
-for (i = 0; i < pcount - 2; i++)
+bot = 0;
+top = pcount - 2;
+
+while (top > bot)
   {
-  if (total + pdepths[i] > page_length) break;
-  total += pdepths[i];
+  int mid = (bot + top + 1)/2;
+  int depth = pg->depths[mid];
+  if (pg->fnline >= 0 && pg->fnline < mid) depth += overhead;
+  if (total + depth > page_limit) top = mid - 1; else bot = mid;
   }
 
+i = bot;
+total += pg->depths[i];
+if (pg->fnline >= 0 && pg->fnline < i) total += overhead;
+
 /* If fewer than 2 lines fit, end the page before this paragraph. */
 
 if (i < 2) return ACCEPT_NO;
@@ -604,6 +800,24 @@ ip->flags |= IF_PARACONTA;
 newpg = misc_malloc(sizeof(paragraph));
 *newpg = *pg;
 
+/* The second part gets the cumulative depths of its own lines; those of the
+first part are no longer needed. */
+
+newpg->lines = pcount - i;
+newpg->depths = misc_malloc((newpg->lines + 1) * sizeof(int));
+for (n = 0; n <= newpg->lines; n++)
+  newpg->depths[n] = pg->depths[i + n] - pg->depths[i];
+
+newpg->fnline = -1;
+if (pg->fnline >= 0)
+  {
+  for (ol = pg->out, n = 0; ol != NULL; ol = ol->next, n++)
+    if (n >= i && ol->fnstr != NULL) break;
+  if (ol != NULL) newpg->fnline = n - i;
+  }
+
+free_line_depths(pg);
+
 /* Find last line of first part, and last textblock of the last line. There are
 occasions on which the last line is empty and has no textblocks, so check with
 the previous. */
@@ -729,7 +943,7 @@ if (usedonpage == 0 && depth > page_length)  /* Too big for a whole page */
   fudge = -depth;                            /* Force acceptance */
   }
 
-if (usedonpage + last_after_min + depth + fudge <= page_length)
+if (usedonpage + last_after_min + depth + fudge <= page_limit)
   {
   usedonpage += last_after_min + depth;
   last_accepted = i->partner;            /* The </mediaobject> element */
@@ -742,6 +956,684 @@ return ACCEPT_NO;
 }
 
 
+/*************************************************
+*     Format a chapter when streaming output     *
+*************************************************/
+
+/* When the output is being streamed, paragraphs are formatted a chapter at a
+time. If pagination reaches a chapter without stopping, it is formatted here.
+Pagination may scan the start of a chapter more than once, so remember the
+last one that was done.
+
+Argument:   the chapter (or appendix) item
+Returns:    TRUE to continue
+*/
+
+static BOOL
+stream_format(item *i)
+{
+if (i == stream_formatted) return TRUE;
+stream_formatted = i;
+return para_format(i);
+}
+
+
+
+/*************************************************
+*     Add a box to the page breaking model       *
+*************************************************/
+
+/* The running totals of depth, stretchable space, and footnotes are updated,
+so that the values for any stretch of boxes can be found by subtraction.
+
+Arguments:
+  n           the box number
+  depth       the depth of the box
+  footnote    TRUE if the box has footnotes
+  before_min  the minimum space before the box
+  before_max  the maximum space before the box
+  penalty     the penalty for a break after the box, or -1
+
+Returns:      nothing
+*/
+
+static void
+model_box(int n, int depth, BOOL footnote, int before_min, int before_max,
+  int penalty)
+{
+pagebox *b = boxes + n;
+b->before_min = before_min;
+b->before_max = before_max;
+b->penalty = penalty;
+box_height[n+1] = box_height[n] + before_min + depth;
+box_stretch[n+1] = box_stretch[n] + before_max - before_min;
+box_footnotes[n+1] = box_footnotes[n] + (footnote? 1 : 0);
+}
+
+
+
+/*************************************************
+*        Find the depth of a modelled page       *
+*************************************************/
+
+/* The space before the first box on a page is discarded, and the first
+footnote on a page adds an extra overhead.
+
+Arguments:
+  a          the position at which the page starts
+  k          the position at which it ends
+
+Returns:     the depth of the page
+*/
+
+static int
+model_depth(int a, int k)
+{
+int depth = box_height[k] - box_height[a] - boxes[a].before_min;
+if (box_footnotes[k] > box_footnotes[a]) depth += footnote_overhead;
+return depth;
+}
+
+
+
+/*************************************************
+*       Choose a page depth by optimal breaking  *
+*************************************************/
+
+/* This function is called at the start of each page when page_break_lookahead
+is greater than zero. It builds a model of what follows as a list of boxes,
+each of which is a line of a paragraph, a row of a table, or a media object,
+making the same decisions about where a page may end as the accept_xxx()
+functions do. Modelling stops at a forced page break, or when the lookahead has
+been covered. Then the breaks that minimize first the number of pages and then
+the total demerits are found, in the manner of paragraph breaking. The last
+page is free, because it will be finished by whatever follows. Only positions
+within a page's length of a break are considered for the previous break, so the
+cost is linear in the number of boxes.
+
+The result is the depth to which the current page should be filled. This is
+used instead of the page length by the accept_xxx() functions, which do the
+actual work of breaking and splitting as they do when filling pages greedily.
+It is half way between the depths up to the chosen break and up to the next
+possible break, so as to allow for small differences from the model.
+
+Arguments:
+  pp           the item after which the page starts
+  stop_at      the item at which to stop, or NULL
+  hadcolophon  TRUE if a colophon has been seen
+
+Returns:       the depth to fill the page to
+*/
+
+static int
+optimal_page_limit(item *pp, item *stop_at, BOOL hadcolophon)
+{
+item *ip;
+int a, k, next, limit;
+int n = 0;
+int end = MODEL_WINDOW;
+int window = (page_break_lookahead + 1) * page_length;
+int after_min = 0;
+int after_max = 0;
+BOOL notlast = FALSE;
+
+box_height[0] = box_stretch[0] = box_footnotes[0] = 0;
+
+for (ip = pp->next; ip != NULL; ip = ip->next)
+  {
+  uschar *name = ip->name;
+
+  if (box_height[n] > window) break;
+
+  if (Ustrcmp(name, "title") == 0 ||
+      Ustrcmp(name, "subtitle") == 0 ||
+      Ustrcmp(name, "term") == 0)
+    {
+    notlast = TRUE;
+    continue;
+    }
+
+  if (Ustrcmp(name, "/") == 0 &&
+      (Ustrcmp(ip->partner->name, "title") == 0 ||
+       Ustrcmp(ip->partner->name, "subtitle") == 0 ||
+       Ustrcmp(ip->partner->name, "term") == 0))
+    {
+    notlast = FALSE;
+    continue;
+    }
+
+  /* A forced page break ends the model. We cannot tell what a change to the
+  number of columns will do. */
+
+  if (Ustrcmp(name, "?sdop") == 0)
+    {
+    paramstr *p = misc_param_find(ip, US"format");
+    if (p != NULL && Ustrcmp(p->value, "newpage") == 0)
+      {
+      if (n > 0)
+        {
+        end = MODEL_FORCED;
+        break;
+        }
+      }
+    else if (misc_param_find(ip, US"page_columns") != NULL)
+      {
+      end = MODEL_UNKNOWN;
+      break;
+      }
+    }
+
+  /* A table can be split between rows, as long as two body rows are left on
+  each side. Its title goes with the first row, and its frames with the last,
+  because that is how accept_table() counts them. A table of fewer than two
+  rows is treated like a title. */
+
+  else if (Ustrcmp(name, "table") == 0 ||
+           Ustrcmp(name, "informaltable") == 0)
+    {
+    tablescan ts;
+    int r, frames, before_min, before_max;
+
+    scan_table(ip, &ts);
+    if (n + ts.rcount + 1 > MAXPAGEBOXES) break;
+
+    frames = ts.total;
+    for (r = 0; r < ts.rcount; r++) frames -= ts.rdepths[r];
+    before_min = (after_min > ts.td->layparm->beforemin)?
+      after_min : ts.td->layparm->beforemin;
+    before_max = (after_max > ts.td->layparm->beforemax)?
+      after_max : ts.td->layparm->beforemax;
+
+    if (ts.rcount == 0)
+      model_box(n++, ts.titledepth + frames, FALSE, before_min, before_max,
+        -1);
+
+    for (r = 0; r < ts.rcount; r++)
+      {
+      int depth = ts.rdepths[r];
+      int penalty = -1;
+
+      if (r == 0) depth += ts.titledepth;
+      if (r == ts.rcount - 1)
+        {
+        depth += frames;
+        if (ts.rcount >= 2) penalty = 0;
+        }
+      else if (ts.rcount >= 4 && r + 1 >= ts.hrcount + 2 &&
+               r + 1 <= ts.rcount - 2)
+        penalty = PB_TABLE_SPLIT;
+
+      model_box(n++, depth, FALSE, (r == 0)? before_min : 0,
+        (r == 0)? before_max : 0, penalty);
+      }
+
+    after_min = ts.td->layparm->aftermin;
+    after_max = ts.td->layparm->aftermax;
+    ip = ip->partner;
+    }
+
+  /* A media object is never split, and has no space after it. */
+
+  else if (Ustrcmp(name, "mediaobject") == 0 ||
+           Ustrcmp(name, "inlinemediaobject") == 0)
+    {
+    int dummy;
+    int depth = object_find_size(ip, &dummy);
+    if (depth > page_length || n >= MAXPAGEBOXES)
+      {
+      end = MODEL_UNKNOWN;
+      break;
+      }
+    model_box(n++, depth, FALSE, after_min, after_min, 0);
+    after_min = after_max = 0;
+    ip = ip->partner;
+    }
+
+  else if (Ustrcmp(name, "footnote") == 0)
+    {
+    ip = ip->partner;
+    }
+
+  /* A paragraph of four or more lines can be split, as long as two lines are
+  left on each side, unless it is a title or a term, which can never be
+  followed by a page break. */
+
+  else if (Ustrcmp(name, "#PCPARA") == 0)
+    {
+    paragraph *pg = ip->p.prgrph;
+    outputline *ol;
+    int i = 0;
+    int lines;
+    int before_min = (after_min > pg->layparm->beforemin)?
+      after_min : pg->layparm->beforemin;
+    int before_max = (after_max > pg->layparm->beforemax)?
+      after_max : pg->layparm->beforemax;
+
+    find_line_depths(pg);
+    lines = pg->lines;
+    if (n + lines + 1 > MAXPAGEBOXES) break;
+
+    if (lines == 0)
+      model_box(n++, 0, FALSE, before_min, before_max, notlast? -1 : 0);
+
+    for (ol = pg->out; ol != NULL; ol = ol->next)
+      {
+      int penalty = -1;
+      if (++i == lines) penalty = 0;
+        else if (lines >= 4 && i >= 2 && i <= lines - 2)
+          penalty = PB_PARA_SPLIT;
+      if (notlast) penalty = -1;
+      model_box(n++, pg->depths[i] - pg->depths[i-1], ol->fnstr != NULL,
+        (i == 1)? before_min : 0, (i == 1)? before_max : 0, penalty);
+      }
+
+    after_min = pg->layparm->aftermin;
+    after_max = pg->layparm->aftermax;
+    }
+
+  /* These are the elements that force a new page in page_format(). */
+
+  else if (ip == stop_at || Ustrcmp(name, "index") == 0)
+    {
+    end = MODEL_FORCED;
+    break;
+    }
+
+  else if (n > 0 &&
+            (Ustrcmp(name, "chapter")  == 0 ||
+             Ustrcmp(name, "preface")  == 0 ||
+               (Ustrcmp(name, "appendix") == 0 &&
+                document_type != DOC_ARTICLE)))
+    {
+    end = MODEL_FORCED;
+    break;
+    }
+
+  /* When streaming, a chapter that starts the page may not yet have been
+  formatted. Format it now, as page_format() would when it reaches it, so
+  that the model can see into it. */
+
+  else if (stream_output && misc_is_stream_boundary(ip))
+    {
+    if (!stream_format(ip))
+      {
+      end = MODEL_UNKNOWN;
+      break;
+      }
+    }
+
+  else if (n > 0 && Ustrcmp(name, "colophon") == 0 && !hadcolophon)
+    {
+    end = MODEL_FORCED;
+    break;
+    }
+  }
+
+if (ip == NULL) end = MODEL_FORCED;
+stats.page_lookahead_boxes += n;
+
+/* If what we know about fits on this page, there is no choice to make. */
+
+if (n == 0 || (end == MODEL_UNKNOWN && box_height[n] <= page_length))
+  return page_length;
+
+/* Find the best way of reaching each position at which a page may end. */
+
+best_pages[0] = 0;
+best_demerits[0] = 0.0;
+best_previous[0] = -1;
+
+for (k = 1; k <= n; k++)
+  {
+  best_pages[k] = -1;
+  if (k < n && boxes[k-1].penalty < 0) continue;
+
+  for (a = k - 1; a >= 0; a--)
+    {
+    int depth;
+    double demerits;
+
+    if (a > 0 && boxes[a-1].penalty < 0) continue;
+    depth = model_depth(a, k);
+    if (depth > page_length) break;
+    if (best_pages[a] < 0) continue;
+
+    demerits = best_demerits[a];
+
+    if (k < n)
+      {
+      double badness;
+      int shortfall = page_length - depth;
+      int stretch = box_stretch[k] - box_stretch[a] -
+        (boxes[a].before_max - boxes[a].before_min);
+
+      if (shortfall <= stretch)
+        {
+        double r = (stretch == 0)? 0.0 : (double)shortfall / stretch;
+        badness = 100.0 * r * r * r;
+        }
+      else
+        {
+        double r = (double)(shortfall - stretch) / page_length;
+        badness = 100.0 + 10000.0 * r * r;
+        }
+
+      demerits += (PB_PAGE + badness) * (PB_PAGE + badness) +
+        (double)(boxes[k-1].penalty * boxes[k-1].penalty);
+      }
+
+    else if (end != MODEL_FORCED)
+      demerits += PB_CARRY * depth / page_length;
+
+    if (best_pages[k] < 0 || best_pages[a] + 1 < best_pages[k] ||
+        (best_pages[a] + 1 == best_pages[k] && demerits < best_demerits[k]))
+      {
+      best_pages[k] = best_pages[a] + 1;
+      best_demerits[k] = demerits;
+      best_previous[k] = a;
+      }
+    }
+  }
+
+/* If the end cannot be reached (something is too big for a page) leave it to
+the accept_xxx() functions. Otherwise, find the first break on the best path,
+and the next position at which a page could end. */
+
+if (best_pages[n] < 0) return page_length;
+
+for (k = n; best_previous[k] > 0; k = best_previous[k]);
+if (k == n) return page_length;
+
+for (next = k + 1; next < n && boxes[next-1].penalty < 0; next++);
+limit = (model_depth(0, k) + model_depth(0, next)) / 2;
+if (limit > page_length) limit = page_length;
+
+DEBUG(D_page) debug_printf("optimal break: boxes=%d end=%d pages=%d "
+  "demerits=%.0f limit=%d\n", n, end, best_pages[n], best_demerits[n], limit);
+
+return limit;
+}
+
+
+
+/*************************************************
+*       Start workers for parallel pagination    *
+*************************************************/
+
+/* When page_break_lookahead is set, most of the time taken by pagination goes
+in modelling the material that follows each page, in order to choose the depth
+to which it is filled. Once that depth is known, filling the page is cheap.
+Chapters always start new pages, and the model never looks beyond the start of
+a chapter, so the depths for the pages of each chapter depend only on that
+chapter, and on settings such as the number of columns, which are changed only
+by processing instructions that pagination meets in order.
+
+With -j, the body is divided at chapter starts into ranges of roughly equal
+numbers of items. The parent does the first range itself; a worker process is
+forked for each of the others. A worker paginates greedily (which is cheap, and
+reaches each chapter in the same state) until a page starts at the beginning
+of its range. From there it chooses page depths as usual, writing each one to a
+temporary file, until a page starts at the beginning of a later range. When the
+parent reaches a page that starts at the beginning of a range, it waits for
+that range's worker and then uses its depths in order, so the pages are the
+same as when the depths are found serially. If a page never starts exactly at
+the beginning of a range, or a worker fails, the parent finds the depths
+itself.
+
+Arguments:
+  pp          the item after which the first page starts
+  stop_at     the item at which pagination will stop, or NULL
+
+Returns:      nothing; in a worker, this returns to carry on paginating
+*/
+
+static void
+start_page_workers(item *pp, item *stop_at)
+{
+item *ip;
+int r;
+int total = 0;
+int workers = write_workers;
+
+for (ip = pp->next; ip != NULL && ip != stop_at; ip = ip->next)
+  {
+  if (Ustrcmp(ip->name, "index") == 0) break;
+  total++;
+  }
+
+ranges[0].start = pp->next;
+range_count = 1;
+range_current = range_next = 0;
+
+for (ip = pp->next, r = 0; ip != NULL && ip != stop_at; ip = ip->next, r++)
+  {
+  if (Ustrcmp(ip->name, "index") == 0) break;
+  if (r >= ((long)range_count * total)/workers &&
+       (Ustrcmp(ip->name, "chapter") == 0 ||
+        Ustrcmp(ip->name, "preface") == 0 ||
+         (Ustrcmp(ip->name, "appendix") == 0 && document_type != DOC_ARTICLE)))
+    {
+    pagerange *pr = ranges + range_count;
+    if (ip == ranges[range_count - 1].start) continue;
+    pr->start = ip;
+    pr->pid = -1;
+    pr->list = NULL;
+    pr->count = 0;
+    if (++range_count >= workers) break;
+    }
+  }
+
+if (range_count < 2)
+  {
+  range_count = 0;
+  return;
+  }
+
+DEBUG(D_any) debug_printf("Paginating in %d ranges\n", range_count);
+
+for (r = 1; r < range_count; r++)
+  {
+  pagerange *pr = ranges + r;
+  pr->limits = tmpfile();
+  pr->err = tmpfile();
+  if (pr->limits == NULL || pr->err == NULL)
+    (void)error(0, US"(temporary)", "parallel pagination file",
+      strerror(errno));
+
+  pr->pid = sys_worker_start(pr->err, &(pr->fd));
+
+  /* In the worker, return to paginate from the start of the body. */
+
+  if (pr->pid == 0)
+    {
+    range_worker = r;
+    return;
+    }
+
+  /* If a worker cannot be started, the parent does its range. */
+
+  if (pr->pid < 0)
+    {
+    (void)fclose(pr->limits);
+    (void)fclose(pr->err);
+    }
+  }
+}
+
+
+
+/*************************************************
+*       Finish a parallel pagination worker      *
+*************************************************/
+
+/* The number of boxes that were modelled is added after the page depths, so
+that the statistics are the same as for serial pagination. This function does
+not return.
+
+Arguments:  none
+Returns:    nothing
+*/
+
+static void
+finish_page_worker(void)
+{
+pagerange *pr = ranges + range_worker;
+long boxes = stats.page_lookahead_boxes - range_boxes;
+(void)fwrite(&boxes, sizeof(long), 1, pr->limits);
+if (fflush(pr->limits) != 0) _exit(EXIT_FAILURE);
+sys_worker_finish(pr->fd);
+}
+
+
+
+/*************************************************
+*      Collect a parallel pagination worker      *
+*************************************************/
+
+/* Wait for a worker to finish, and read its page depths. If it failed, no
+depths are used, and the parent finds them itself. This is also used at the end
+of pagination to wait for any workers whose depths were not wanted.
+
+Argument:   the range number
+Returns:    nothing
+*/
+
+static void
+collect_page_worker(int r)
+{
+pagerange *pr = ranges + r;
+long size, boxes;
+
+if (pr->pid <= 0) return;
+
+if (sys_worker_wait(pr->pid, pr->fd) &&
+    fseek(pr->limits, 0, SEEK_END) == 0 &&
+    (size = ftell(pr->limits) - (long)sizeof(long)) > 0)
+  {
+  pr->count = size/sizeof(int);
+  pr->list = misc_malloc(pr->count * sizeof(int));
+  rewind(pr->limits);
+  if (fread(pr->list, sizeof(int), pr->count, pr->limits) !=
+        (size_t)pr->count ||
+      fread(&boxes, sizeof(long), 1, pr->limits) != 1)
+    {
+    misc_free(pr->list, pr->count * sizeof(int));
+    pr->list = NULL;
+    pr->count = 0;
+    }
+  else stats.page_lookahead_boxes += boxes;
+  }
+
+(void)fclose(pr->limits);
+(void)fclose(pr->err);
+pr->pid = -1;
+
+DEBUG(D_any) debug_printf("Pagination worker %d: %d pages\n", r, pr->count);
+}
+
+
+
+/*************************************************
+*    Choose a page depth for parallel paging     *
+*************************************************/
+
+/* This is called at the start of each page instead of optimal_page_limit()
+when there are ranges for parallel pagination. It does the work described for
+start_page_workers() above.
+
+Arguments:
+  pp           the item after which the page starts
+  stop_at      the item at which to stop, or NULL
+  hadcolophon  TRUE if a colophon has been seen
+
+Returns:       the depth to fill the page to
+*/
+
+static int
+range_page_limit(item *pp, item *stop_at, BOOL hadcolophon)
+{
+int r, limit;
+
+for (r = 1; r < range_count; r++)
+  if (pp->next == ranges[r].start) break;
+
+/* In a worker, fill pages greedily until its range starts, and stop when
+another one starts. */
+
+if (range_worker > 0)
+  {
+  if (r == range_worker)
+    {
+    range_recording = TRUE;
+    range_boxes = stats.page_lookahead_boxes;
+    }
+  else if (r < range_count && range_recording) finish_page_worker();
+
+  if (!range_recording) return page_length;
+  limit = (page_columns == 1)?
+    optimal_page_limit(pp, stop_at, hadcolophon) : page_length;
+  if (fwrite(&limit, sizeof(int), 1, ranges[range_worker].limits) != 1)
+    _exit(EXIT_FAILURE);
+  return limit;
+  }
+
+/* In the parent, switch to a worker's depths at the start of its range. */
+
+if (r < range_count)
+  {
+  collect_page_worker(r);
+  range_current = r;
+  range_next = 0;
+  }
+
+if (range_current > 0 && range_next < ranges[range_current].count)
+  {
+  limit = ranges[range_current].list[range_next++];
+  DEBUG(D_page) debug_printf("limit=%d from worker %d\n", limit,
+    range_current);
+  return limit;
+  }
+
+return (page_columns == 1)?
+  optimal_page_limit(pp, stop_at, hadcolophon) : page_length;
+}
+
+
+
+/*************************************************
+*           End parallel pagination              *
+*************************************************/
+
+/* In a worker, this is reached if the end of the body is reached while it is
+recording. In the parent, any workers that have not been collected are waited
+for, and the depths are freed.
+
+Arguments:  none
+Returns:    nothing
+*/
+
+static void
+end_page_workers(void)
+{
+int r;
+
+if (range_worker > 0)
+  {
+  if (range_recording) finish_page_worker();
+  _exit(EXIT_FAILURE);
+  }
+
+for (r = 1; r < range_count; r++)
+  {
+  pagerange *pr = ranges + r;
+  collect_page_worker(r);
+  if (pr->list != NULL) misc_free(pr->list, pr->count * sizeof(int));
+  }
+range_count = 0;
+}
+
+
+
 /*************************************************
 *                Create pages                    *
 *************************************************/
@@ -749,7 +1641,8 @@ return ACCEPT_NO;
 /* This function scans the item list for tables and formatted paragraphs, and
 does the pagination to make pages. For each page, a #PDATA item is inserted
 into the list. We stop either when we hit the end of the list, or when we hit
-an <index> item.
+an <index> item. When the output is being streamed, we also stop at the start of
+a chapter that has not been formatted, and after each page of the main text.
 
 Arguments:
   item_list   the start of the item list to be processed
@@ -804,21 +1697,31 @@ if (item_list->name[0] == 0)
   }
 
 /* If we are continuing pagination after hitting <index>, or if we are
-formatting an index, search back for the #PDATA item that must precede. */
+formatting an index, search back for the #PDATA item that must precede. When
+streaming, pagination may also continue from the #PDATA item that starts a new
+page; whether a colophon has been seen is then remembered in its flags. */
 
 else
   {
-  for (pp = item_list->prev; pp != NULL; pp = pp->prev)
+  for (pp = item_list; pp != NULL; pp = pp->prev)
     {
     if (Ustrcmp(pp->name, "#PDATA") == 0) break;
     }
   if (pp == NULL) error(63);    /* Hard */
   pd = pp->p.pdata;
-  hadcolophon = Ustrcmp(item_list->name, "colophon") == 0;
+  hadcolophon = (pp == item_list)? (pp->flags & IF_NOHEADFOOT) != 0 :
+    Ustrcmp(item_list->name, "colophon") == 0;
   if (hadcolophon) pp->flags |= IF_NOHEADFOOT;
   pp = item_list;               /* Start page just after the given item */
   }
 
+/* Start workers to find the page depths for ranges of chapters, if
+required. */
+
+if (write_workers > 1 && page_break_lookahead > 0 && !isindex &&
+    !stream_output)
+  start_page_workers(pp, stop_at);
+
 /* Scan the input and insert page boundaries where required. */
 
 for (;;)   /* Loop for each page */
@@ -836,6 +1739,15 @@ for (;;)   /* Loop for each page */
 
   DEBUG(D_page) debug_printf("Page %d\n", pagenumber);
 
+  /* Choose how much to put on this page. Optimal breaking is not used for
+  indexes or for multiple columns. */
+
+  if (range_count > 0)
+    page_limit = range_page_limit(pp, stop_at, hadcolophon);
+  else
+    page_limit = (page_break_lookahead > 0 && page_columns == 1 && !isindex)?
+      optimal_page_limit(pp, stop_at, hadcolophon) : page_length;
+
   /* Loop for multiple columns */
 
   for (;;)
@@ -984,9 +1896,27 @@ for (;;)   /* Loop for each page */
         {
         if (last_accepted != NULL) last_accepted = ip->prev;
         forced = TRUE;
+
+        /* When streaming, return after this page if the next chapter has not
+        yet been formatted, so that the pages so far can be written. If there
+        is no page to finish, format the chapter now and carry on. */
+
+        if (stream_output && misc_is_stream_boundary(ip))
+          {
+          if (last_accepted != NULL) stop = TRUE;
+            else if (!stream_format(ip)) return FALSE;
+          }
         break;
         }
 
+      /* When streaming, a chapter that does not cause a new page (because the
+      page is empty) is formatted when it is reached. */
+
+      else if (stream_output && misc_is_stream_boundary(ip))
+        {
+        if (!stream_format(ip)) return FALSE;
+        }
+
       else if (usedonpage != 0 &&
                Ustrcmp(name, "colophon") == 0 &&
                !hadcolophon)
@@ -1004,6 +1934,7 @@ for (;;)   /* Loop for each page */
 
     if (backup_last_accepted != NULL)
       {
+      stats.page_backtracks++;
       last_accepted = backup_last_accepted;
       last_after_min = backup_last_after_min;
       last_after_max = backup_last_after_max;
@@ -1205,11 +2136,24 @@ for (;;)   /* Loop for each page */
       ppp->prev = pp;
       pp->next = ppp;
       }
+
+    /* When streaming the main text, return after each page, so that it can
+    be written straight away. The caller carries on from the new #PDATA item,
+    so this is done only for callers that can. */
+
+    else if (stream_output && !isindex && !stop && ip != NULL &&
+             next_list != NULL)
+      {
+      ip = pp;
+      break;
+      }
     }
 
   if (stop) break;     /* Hit an <index> element when processing main text, */
   }                    /* or </index> when processing an index. */
 
+if (range_count > 0) end_page_workers();
+
 /* If next_list is not NULL, return where we got to, moving on one if it's the
 end of an index. */
 
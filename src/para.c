@@ -9,13 +9,6 @@
 #include "sdop.h"
 
 
-/* Looseness parameters for analyzing lines. */
-
-#define L_BAD     95
-#define L_ACCEPT  60
-#define L_VGOOD   30
-
-
 /*************************************************
 *          Local static variables                *
 *************************************************/
@@ -211,6 +204,7 @@ pg->out = NULL;                                  /* No output yet */
 pg->intxtblk = NULL;                             /* No input yet */
 pg->justify = J_UNSET;                           /* Use value from layout */
 pg->extra_leading = extra_leading;               /* The dynamic value */
+pg->depths = NULL;                               /* Found when paginating */
 tbptr = &(pg->intxtblk);                         /* Where to chain the input */
 
 /* The maximum width is computed from the page width and the number of columns
@@ -1011,6 +1005,7 @@ int startoffset;
 int hyphenwidth;
 int nbhcount = 0;
 int nbh[128];
+int widths[MAXHYWORD];
 uschar buffer[128];
 uschar singular[128];
 uschar *bp = buffer;
@@ -1026,7 +1021,7 @@ while (*hp != 0 && !isspace(*hp) && bp < bend)
   if (c == NO_BREAK_HERE) nbh[nbhcount++] = bp - buffer;
     else bp += misc_ord2utf8(c, bp);
   }
-if (bp >= bend) return FALSE;
+if (bp >= bend || hp - *ah_p >= MAXHYWORD) return FALSE;
 *bp = 0;
 nbh[nbhcount] = 1000; /* Bigger than any possible offset */
 
@@ -1065,9 +1060,13 @@ English words. */
 DEBUG(D_hyphen) debug_printf("startoffset=%d prepared word is '%s'\n",
   startoffset, singular);
 
-/* Now seek hyphenation points, in order from right to left. */
+/* Now seek hyphenation points, in order from right to left. The width of
+each leading part of the word is found once, so that each point can be tried
+without measuring the word again. */
 
 hyphenwidth = font_charwidth('-', tb->vfont, NULL);
+(void)font_widthindex(*ah_p, hp - *ah_p, tb->vfont,
+  (tb->pin_flags & PIN_KERN) != 0, widths);
 
 for (;;)
   {
@@ -1089,13 +1088,7 @@ for (;;)
     nbhskipped += 2;  /* Allow for NBH in original word */
     }
   if (ho == nbh[k]) continue;
-  hlw = *ah_lw + hyphenwidth;
-  for (hp = *ah_p; hp < *ah_p + startoffset + ho + nbhskipped; )
-    {
-    int c;
-    GETCHARINC(c, hp);
-    hlw += font_charwidth(c, tb->vfont, NULL);
-    }
+  hlw = *ah_lw + hyphenwidth + widths[startoffset + ho + nbhskipped];
   if (hlw <= maxlinewidth)
     {
     ho += nbhskipped;
@@ -1194,6 +1187,7 @@ if ((tb->pin_flags & PIN_FNKEYDEF) != 0)
   ntbanchor = &(ntb->next);
   ntb->next = NULL;
   ntb->lastin = tb;
+  ntb->slice = NULL;
   tb = tb->next;
   if (tb == NULL) error(32);     /* Hard error */
   }
@@ -1282,6 +1276,66 @@ for (;;)
     hyphenwidth = font_charwidth('-', tb->vfont, NULL);
     }
 
+  /* Most text consists of runs of printing ASCII characters within words. For
+  these, none of the special handling below applies, except for a hyphen or an
+  "fi" ligature, and the only thing to do is to add up their kerned widths. So
+  when we are in the middle of a word in a standardly encoded font, measure
+  such a run directly from the font's width and kern tables, stopping before
+  any character that would overflow the line, which is then handled in the
+  normal way below. If the font is of fixed pitch and has no kerning, each
+  character has the same width, so the number that fit can be computed. */
+
+  if (stdencoding && !lastwasspace && !firstcharinline && ASCII_PLAIN(*p))
+    {
+    uschar *runstart = p;
+    vfontstr *vf = tb->vfont;
+    afontstr *af = vf->afont;
+
+    if (af->asciiwidth != WIDTH_UNKNOWN && (!kerning || af->kerncount == 0))
+      {
+      int n;
+      int fw = MUL(af->asciiwidth, vf->size);
+      while (ASCII_PLAIN(*p)) p++;
+      n = p - runstart;
+      if (fill && fw > 0)
+        {
+        int nfit = (maxlinewidth >= linewidth)?
+          (maxlinewidth - linewidth)/fw : 0;
+        if (nfit < n)
+          {
+          n = nfit;
+          p = runstart + n;
+          }
+        }
+      linewidth += n * fw;
+      if (n > 0) lastc = kerning? p[-1] : -1;
+      }
+
+    else for (;;)
+      {
+      int pc = *p;
+      if (!ASCII_PLAIN(pc) || (pc == 'f' && p[1] == 'i' && fiok)) break;
+      w = af->widths[pc];
+      if (w == WIDTH_UNKNOWN) break;
+      w = MUL(w, vf->size);
+      k = 0;
+      if (kerning && lastc >= 0)
+        k = (lastc < 128 && af->asciikerns != NULL)?
+          MUL(af->asciikerns[(lastc << 7) | pc], vf->size) :
+          font_kernwidth(lastc, pc, vf);
+      if (fill && linewidth + w + k > maxlinewidth) break;
+      linewidth += w + k;
+      lastc = kerning? pc : -1;
+      p++;
+      }
+
+    if (p > runstart)
+      {
+      last_tb = tb;
+      continue;
+      }
+    }
+
   /* Get the next character. Certain characters are handled specially, provided
   that the font is standardly encoded. Some Unicode characters do not exist in
   PostScript fonts but may be substituted. Arrange to use the appropriate
@@ -1346,18 +1400,13 @@ for (;;)
 
   if (chtype == CHTYPE_UNKNOWN)
     {
-    uschar utf[8];
-    tree_node *t;
-    utf[misc_ord2utf8(c, utf)] = 0;
+    BOOL firsttime = hash_code_search(unknown_char_table, c) == NULL;
 
     /* Warn once for each unknown character */
 
-    t = tree_search(unknown_char_tree, utf);
-    if (t == NULL)
+    if (firsttime)
       {
-      tree_node *tt = misc_malloc(sizeof(tree_node) + 6);
-      Ustrcpy(tt->name, utf);
-      (void)tree_insertnode(&(unknown_char_tree), tt);
+      (void)hash_code_insert(&unknown_char_table, c);
       if (warn_unsupported_chars)
         (void)error(30, c, tb->vfont->afont->name);    /* Warning */
       }
@@ -1389,7 +1438,7 @@ for (;;)
         }
       else
         {
-        if (t == NULL) (void)error(103, i, c, tb->vfont->afont->name);
+        if (firsttime) (void)error(103, i, c, tb->vfont->afont->name);
         c = cw = i;
         }
       }
@@ -1693,26 +1742,36 @@ for (; ctb != NULL; ctb = ctb->next)
 
   /* Create a new textblock and add it into the line's chain, provided it
   has some text in it. (It can be empty if it was just a newline that got
-  removed above.) */
+  removed above.) The text is not copied, except for footnote keys, whose
+  numbers are filled in when the page is written. */
 
   if (length > 0)
     {
-    ntb = misc_malloc(sizeof(textblock) + length);
+    if ((ctb->pin_flags & (PIN_FNKEYREF|PIN_FNREFREF)) == 0)
+      {
+      ntb = misc_malloc(sizeof(textblock));
+      ntb->slice = ctb->string + startoffset;
+      }
+    else
+      {
+      ntb = misc_malloc(sizeof(textblock) + length);
+      ntb->slice = NULL;
+      memcpy(ntb->string, ctb->string + startoffset, length);
+      ntb->string[length] = 0;
+
+      /* Turn intermediate (filling) newlines into spaces. */
+
+      while ((nlp = Ustrchr(ntb->string, '\n')) != NULL) *nlp = ' ';
+      }
+
     *ntbanchor = ntb;
     ntbanchor = &(ntb->next);
     ntb->next = NULL;
     ntb->lastin = last_tb;
-
-    memcpy(ntb->string, ctb->string + startoffset, length);
-    ntb->string[length] = 0;
     ntb->length = length;
     ntb->vfont = ctb->vfont;
     ntb->pin_flags = ctb->pin_flags;
     ntb->colour = ctb->colour;
-
-    /* Turn intermediate (filling) newlines into spaces. */
-
-    while ((nlp = Ustrchr(ntb->string, '\n')) != NULL) *nlp = ' ';
     }
 
   /* If we've dealt with the current (non-NULL) text block, break. Otherwise,
@@ -1781,9 +1840,9 @@ for (ol1 = pg->out;
      ol1 != NULL && (ol2 = ol1->next) != NULL && ol2->next != NULL;
      ol1 = ol2)
   {
-  int c, len, nw, nsw, sc, sw, w, l1, l1n, l2;
+  int len, nw, nsw, sc, sw, w, l1, l1n, l2;
   textblock *tb, *tbnew;
-  uschar *p, *q, *pend;
+  uschar *p, *q, *pend, *text;
 
   /* Loop, because it may be possible to move more than one word from one
   line to another. */
@@ -1819,23 +1878,19 @@ for (ol1 = pg->out;
 
     for (tb = ol1->txtblk; tb->next != NULL; tb = tb->next);
 
-    p = pend = tb->string + tb->length;
-    w = 0;
-
-    while (p > tb->string && p[-1] != ' ')
-      {
-      p--;
-      BACKCHAR(p);
-      GETCHAR(c, p);
-      w += font_charwidth(c, tb->vfont, NULL);
-      }
+    text = TBTEXT(tb);
+    p = pend = text + tb->length;
+    while (p > text && p[-1] != ' ' && p[-1] != '\n') p--;
 
-    if (p <= tb->string)
+    if (p <= text)
       {
       DEBUG(D_para) debug_printf("No space found in last textblock\n");
       break;
       }
 
+    w = font_widthindex(p, pend - p, tb->vfont,
+      (tb->pin_flags & PIN_KERN) != 0, NULL);
+
     DEBUG(D_para)
       {
       debug_printf("Last word (width %s) is: ", misc_formatfixed(w));
@@ -1856,7 +1911,7 @@ for (ol1 = pg->out;
 
     q = p - 1;
     sc = 1;
-    while (q > tb->string && q[-1] == ' ')
+    while (q > text && (q[-1] == ' ' || q[-1] == '\n'))
       {
       q--;
       sc++;
@@ -1876,7 +1931,8 @@ for (ol1 = pg->out;
 
     /* OK, we can move the word onto the next line. */
 
-    *q = 0;  /* End the first line early */
+    stats.polish_moves++;
+    if (tb->slice == NULL) *q = 0;  /* End the first line early */
     tb->length -= pend - q;
 
     /* Adjust values in first line */
@@ -1886,10 +1942,25 @@ for (ol1 = pg->out;
     ol1->scount -= sc;
     if (ol1->stretch > 0) ol1->stretch += w + sc*sw;
 
-    /* Add in a new textblock at the front of the second line */
+    /* Add in a new textblock at the front of the second line. It is the word
+    followed by a space, so if the word is in an input block, and is followed
+    there by a space or a newline, it need not be copied. */
 
     len = pend - p + 1;
-    tbnew = misc_malloc(sizeof(textblock) + len);
+    if (tb->slice != NULL && (*pend == ' ' || *pend == '\n'))
+      {
+      tbnew = misc_malloc(sizeof(textblock));
+      tbnew->slice = p;
+      }
+    else
+      {
+      tbnew = misc_malloc(sizeof(textblock) + len);
+      tbnew->slice = NULL;
+      memcpy(tbnew->string, p, len - 1);
+      tbnew->string[len-1] = ' ';
+      tbnew->string[len] = 0;
+      }
+
     tbnew->next = ol2->txtblk;
     ol2->txtblk = tbnew;
     tbnew->lastin = tb->lastin;     /* May not be 100% right, but... */
@@ -1898,10 +1969,6 @@ for (ol1 = pg->out;
     tbnew->colour = tb->colour;
     tbnew->length = len;
 
-    memcpy(tbnew->string, p, len - 1);
-    tbnew->string[len-1] = ' ';
-    tbnew->string[len] = 0;
-
     ol2->width += w + sw;
     ol2->swidth += sw;
     ol2->scount++;
@@ -2000,6 +2067,11 @@ for (i = item_list->next; i != NULL; i = i->next)
 
   if (i == stop_at || Ustrcmp(i->name, "index") == 0) break;
 
+  /* When the output is being streamed, stop at the start of the next chapter.
+  It is formatted when pagination reaches it. */
+
+  if (stream_output && misc_is_stream_boundary(i)) break;
+
   /* The only reason for recognizing table entries here is so that we can
   suppress "overlong line" warnings for columns that are not in fact going to
   overprint anything. This is helpful for sources that use one-line tables for
@@ -2182,6 +2254,7 @@ for (i = item_list->next; i != NULL; i = i->next)
         if (overflow > 0)
           {
           read_linenumber = prev_read_linenumber;
+          i->flags |= IF_OVERFLOW;
           (void)error(62, misc_formatfixed(overflow), colnumber);
           }
         }
@@ -2350,7 +2423,10 @@ for (i = item_list->next; i != NULL; i = i->next)
           avail += table_left_col_space + td->coldata[k].width +
                    table_right_col_space;
         if (ol->width > avail)
+          {
+          ol->flags |= OLF_OVERFLOW;
           (void)error(62, misc_formatfixed(overflow), colnumber);
+          }
         else
           skipped_warning = TRUE;
         }
@@ -2371,6 +2447,7 @@ for (i = item_list->next; i != NULL; i = i->next)
                  (td->coldata[colnumber-1].width - prev_widest_line)/
                    ((prev_justify == J_CENTRE)? 2 : 1))
         {
+        ol->flags |= OLF_OVERFLOW;
         if (colnumber > 0)
           (void)error(62, misc_formatfixed(overflow), colnumber);  /* table */
         else
@@ -2401,22 +2478,18 @@ for (i = item_list->next; i != NULL; i = i->next)
 
       for (oltb = ol->txtblk; oltb != NULL; oltb = oltb->next)
         {
-        uschar *wanted;
-        uschar utf8buf[8];
-        utf8buf[misc_ord2utf8(pg->charval, utf8buf)] = 0;
+        int c = -1;
+        uschar *p = TBTEXT(oltb);
+        uschar *pend = p + oltb->length;
 
-        wanted = Ustrstr(oltb->string, utf8buf);
-
-        if (wanted == NULL)
-          w += font_stringwidth(oltb->string, oltb->vfont);
-        else
+        while (p < pend)
           {
-          int save = *wanted;
-          *wanted = 0;
-          w += font_stringwidth(oltb->string, oltb->vfont);
-          *wanted = save;
-          break;
+          GETCHARINC(c, p);
+          if (c == pg->charval) break;
+          if (c == '\n') c = ' ';
+          w += font_charwidth(c, oltb->vfont, NULL);
           }
+        if (c == pg->charval) break;
         }
 
       /* If we didn't find the character, we'll have the width of the entire
@@ -53,7 +53,6 @@ static piparam hfparam_list[] = {
   { US"chapter_skip_head", NULL, &chapter_skip_head, PI_YESNO }
 };
 
-static int hfparam_list_count = sizeof(hfparam_list)/sizeof(piparam);
 
 /* Multicolumning data */
 
@@ -62,7 +61,6 @@ static piparam mcparam_list[] = {
   { US"page_column_separation", NULL, &page_colsep,  PI_DIMENSION, 0 }
 };
 
-static int mcparam_list_count = sizeof(mcparam_list)/sizeof(piparam);
 
 /* Things that change while creating pages */
 
@@ -70,7 +68,6 @@ static piparam cpparam_list[] = {
   { US"index_headings",         NULL, &index_headings_enabled, PI_YESNO, 0 }
 };
 
-static int cpparam_list_count = sizeof(cpparam_list)/sizeof(piparam);
 
 /* Ordered list parameters */
 
@@ -78,7 +75,6 @@ static piparam olparam_list[] = {
   { US"orderedlist_format",     NULL, &olist_format,        PI_STRING, 0 }
 };
 
-static int olparam_list_count = sizeof(olparam_list)/sizeof(piparam);
 
 /* Figure, example, and table title format parameters */
 
@@ -91,7 +87,6 @@ static piparam figtabparam_list[] = {
   { US"table_title_format",       NULL, &table_title_format,               PI_STRING,      0 }
 };
 
-static int figtabparam_list_count = sizeof(figtabparam_list)/sizeof(piparam);
 
 /* Figure and example title layout paramters */
 
@@ -102,7 +97,6 @@ static piparam figexlayoutparam_list[] = {
   { US"figure_title_width",       NULL, &figure_title_width,               PI_DIMOROBJ,    0 }
 };
 
-static int figexlayoutparam_list_count = sizeof(figexlayoutparam_list)/sizeof(piparam);
 
 /* Table title layout parameters */
 
@@ -112,7 +106,6 @@ static piparam tablelayoutparam_list[] = {
   { US"table_title_width",        NULL, &table_title_width,                PI_DIMOROBJ,    0 }
 };
 
-static int tablelayoutparam_list_count = sizeof(tablelayoutparam_list)/sizeof(piparam);
 
 /* General layout parameters that apply throughout the document. */
 
@@ -136,7 +129,6 @@ static piparam layparm_list[] = {
   { US"vlist_title_indent",       NULL, &vlisttitle_layparm,               PI_INDENT,      0 }
 };
 
-static int layparm_list_count = sizeof(layparm_list)/sizeof(piparam);
 
 /* Layout parameters that can change during paragraph creation. */
 
@@ -144,7 +136,6 @@ static piparam dynamic_layparm_list[] = {
   { US"extra_leading",            NULL, &extra_leading,                    PI_SDIMENSION,   0 },
 };
 
-static int dynamic_layparm_list_count = sizeof(dynamic_layparm_list)/sizeof(piparam);
 
 /* Subscript and superscript font sizes can be changed when assigning fonts. */
 
@@ -153,7 +144,6 @@ static piparam subsupparam_list[] = {
   { US"superscript_small",        NULL, &superscript_small,                PI_YESNO,        0 }
 };
 
-static int subsupparam_list_count = sizeof(subsupparam_list)/sizeof(piparam);
 
 /* Subscript and superscript positions can change during their assignment. */
 
@@ -162,7 +152,6 @@ static piparam subsuplevel_list[] = {
   { US"superscript_up",           NULL, &superscript_up,                   PI_INTEGER,      0 }
 };
 
-static int subsuplevel_list_count = sizeof(subsuplevel_list)/sizeof(piparam);
 
 /* Global overall data that is set once and for all at the start of processing
 and cannot vary for different parts of the document. */
@@ -213,6 +202,7 @@ static piparam glparam_list[] = {
   { US"margin_left_verso",        NULL, &margin_left_verso,                PI_DIMENSION,   0 },
   { US"monospace_family",         NULL, &(type_families[2]),               PI_STRING,      0 },
   { US"option_font",              NULL, &option_fs,                        PI_FONT,        0 },
+  { US"page_break_lookahead",     NULL, &page_break_lookahead,             PI_INTEGER,     0 },
   { US"page_foot_line_width",     NULL, &page_foot_linewidth,              PI_DIMENSION,   0 },
   { US"page_full_length",         NULL, &page_full_length,                 PI_DIMENSION,   0 },
   { US"page_head_line_width",     NULL, &page_head_linewidth,              PI_DIMENSION,   0 },
@@ -250,7 +240,6 @@ static piparam glparam_list[] = {
                                         &warn_unsupported_chars,           PI_YESNO,  0 }
 };
 
-static int glparam_list_count = sizeof(glparam_list)/sizeof(piparam);
 
 
 /* Data for values of type PI_FONT, which map to font flags. */
@@ -317,6 +306,40 @@ static pftype pftype_list[] = {
 static int pftype_list_count = sizeof(pftype_list)/sizeof(pftype);
 
 
+/* The parameter tables, indexed by the PL_xxx values, which are held in
+pisetting blocks. PL_FLAGS is not a table of piparams; its entry 0 is
+table_warn_overflow and the others are the entries in pftype_list. */
+
+enum { PL_HEADFOOT, PL_COLUMNS, PL_PAGING, PL_OLIST, PL_FIGTAB, PL_FIGEXLAYOUT,
+       PL_TABLELAYOUT, PL_LAYOUT, PL_DYNLAYOUT, PL_SUBSUP, PL_SUBSUPLEVEL,
+       PL_GLOBAL, PL_FLAGS };
+
+typedef struct pilist {
+  piparam *params;         /* the table */
+  int      count;          /* its length */
+} pilist;
+
+static pilist pilists[] = {
+  { hfparam_list,          sizeof(hfparam_list)/sizeof(piparam) },
+  { mcparam_list,          sizeof(mcparam_list)/sizeof(piparam) },
+  { cpparam_list,          sizeof(cpparam_list)/sizeof(piparam) },
+  { olparam_list,          sizeof(olparam_list)/sizeof(piparam) },
+  { figtabparam_list,      sizeof(figtabparam_list)/sizeof(piparam) },
+  { figexlayoutparam_list, sizeof(figexlayoutparam_list)/sizeof(piparam) },
+  { tablelayoutparam_list, sizeof(tablelayoutparam_list)/sizeof(piparam) },
+  { layparm_list,          sizeof(layparm_list)/sizeof(piparam) },
+  { dynamic_layparm_list,  sizeof(dynamic_layparm_list)/sizeof(piparam) },
+  { subsupparam_list,      sizeof(subsupparam_list)/sizeof(piparam) },
+  { subsuplevel_list,      sizeof(subsuplevel_list)/sizeof(piparam) },
+  { glparam_list,          sizeof(glparam_list)/sizeof(piparam) }
+};
+
+/* Hash of all the parameter names. Each node's data holds the PL_xxx value and
+the index within the table. */
+
+static hash_table *piname_table = NULL;
+
+
 
 /*************************************************
 *          Parse a string describing a font      *
@@ -332,13 +355,15 @@ Arguments:
   pleading      where to put the leading
   pfamily       where to put the family
   ptype         where to put the type
+  give_error    if TRUE, generate an error message for a bad string
 
 Returns:        TRUE if no problem
-                FALSE if an error has been generated
+                FALSE otherwise
 */
 
 static BOOL
-parse_font(uschar *s, int *psize, int *pleading, int *pfamily, int *ptype)
+parse_font(uschar *s, int *psize, int *pleading, int *pfamily, int *ptype,
+  BOOL give_error)
 {
 int k;
 
@@ -355,7 +380,7 @@ for (k = 0; k < 2; k++)
     else
       *pleading = misc_get_fp(s, &s);
     }
-  if (*s != 0 && *s++ != ',') return error(91);
+  if (*s != 0 && *s++ != ',') return give_error? error(91) : FALSE;
   }
 
 while (isspace(*s)) s++;
@@ -368,12 +393,12 @@ if (*s != ',')
     if (Ustrncmp(s, fdata_family[k].name, fdata_family[k].length) == 0)
       {
       s += fdata_family[k].length;
-      if (*s != 0 && *s++ != ',') return error(91);
+      if (*s != 0 && *s++ != ',') return give_error? error(91) : FALSE;
       *pfamily = fdata_family[k].value;
       break;
       }
     }
-  if (k == fdata_family_count) return error(91);
+  if (k == fdata_family_count) return give_error? error(91) : FALSE;
   }
 else s++;
 
@@ -386,172 +411,272 @@ for (k = 0; k < fdata_type_count; k++)
     {
     s += fdata_type[k].length;
     while (isspace(*s)) s++;
-    if (*s != 0) return error(91);
+    if (*s != 0) return give_error? error(91) : FALSE;
     *ptype = fdata_type[k].value;
     break;
     }
   }
-if (k == fdata_type_count) return error(91);
+if (k == fdata_type_count) return give_error? error(91) : FALSE;
 
 return TRUE;
 }
 
 
 /*************************************************
-*     Check list of parameters and set values    *
+*        Decode a parameter value                *
 *************************************************/
 
-/* Given an <?sdop?> processesing element, scan a list of parameters, and for
-any that are mentioned in the element, set their values. It is possible,
-however, for some to be overriden on the command line, in which case internal
-setting does not happen.
+/* This is called when a ?sdop item is read, without error messages, so that
+values can be checked and converted once, and again when a value that could
+not be decoded is applied, to generate the error message at the time it was
+always given. String values are not handled here.
 
 Arguments:
-  i          the ?sdop element
-  pilist     the list to scan
-  count      the length of the list
+  pp          the parameter's table entry
+  s           the value string
+  v           where to put the decoded value (int[4])
+  give_error  if TRUE, generate an error message for a bad value
 
-Returns:     nothing
+Returns:      TRUE if the value is valid
 */
 
-static void
-check_pin_list(item *i, piparam *pilist, int count)
+static BOOL
+decode_value(piparam *pp, uschar *s, int *v, BOOL give_error)
 {
-int j, k, x;
-uschar *s;
+int k;
+uschar *t;
 
-for (j = 0; j < count; j++)
+switch(pp->type)
   {
-  int typesize, typeleading, typefamily, typetype;
-  paramstr *p = misc_param_find(i, pilist[j].name);
-
-  if (p == NULL ||                   /* Parameter not set here, or */
-      (pilist[j].orptr != NULL &&    /* there's a command line override and */
-        *(pilist[j].orptr)))         /* it is set. */
-    continue;
+  case PI_COLOUR:
+  return misc_get_colour(s, v, give_error);
 
-  switch(pilist[j].type)
+  case PI_FONT:
+  for (k = 0; k < fstype_list_count; k++)
     {
-    case PI_COLOUR:
-    (void)misc_get_colour(p->value, (int *)(pilist[j].pointer));
-    break;
-
-    case PI_FONT:
-    for (k = 0; k < fstype_list_count; k++)
+    if (Ustrcmp(s, fstype_list[k].name) == 0)
       {
-      if (Ustrcmp(p->value, fstype_list[k].name) == 0)
-        {
-        *((int *)(pilist[j].pointer)) = fstype_list[k].type;
-        DEBUG(D_param) debug_printf("%s=%s\n", p->name, p->value);
-        break;
-        }
+      v[0] = fstype_list[k].type;
+      return TRUE;
       }
-    if (k >= fstype_list_count) error(31, p->value, p->name);
-    break;
+    }
+  return give_error? error(31, s, pp->name) : FALSE;
 
-    case PI_FULLFONT:
-    if (parse_font(p->value, &typesize, &typeleading, &typefamily,
-        &typetype))
-      {
-      vfontstr *v = (vfontstr *)(pilist[j].pointer);
-      if (typesize > 0) v->size = typesize;
-      if (typeleading >= 0) v->leading = typeleading;
-      if (typefamily >= 0) v->family = typefamily;
-      if (typetype >= 0) v->type = typetype;
-      }
-    break;
+  case PI_FULLFONT:
+  case PI_FULLFONT4:
+  case PI_FULLFONT8:
+  return parse_font(s, &v[0], &v[1], &v[2], &v[3], give_error);
 
-    case PI_FULLFONT4:
-    case PI_FULLFONT8:
-    if (parse_font(p->value, &typesize, &typeleading, &typefamily,
-        &typetype))
-      {
-      vfontstr **vv;
-      int fontcount = (pilist[j].type == PI_FULLFONT4)? 4 : 8;
-      if (typetype >= 0) error(90);
-      for (vv = (vfontstr **)(pilist[j].pointer); fontcount-- > 0; vv++)
-        {
-        vfontstr *v = *vv;
-        if (typesize > 0) v->size = typesize;
-        if (typeleading >= 0) v->leading = typeleading;
-        if (typefamily >= 0 && fontcount < 4) v->family = typefamily;
-        }
-      }
-    break;
+  case PI_DIMOROBJ:
+  if (Ustrcmp(s, "object") == 0)
+    {
+    v[0] = -1;
+    return TRUE;
+    }
+  /* Fall through */
+  /* vvvvvvvvvvvv */
+  case PI_DIMENSION:
+  v[0] = misc_get_dimension(s);
+  if (v[0] >= 0) return TRUE;
+  return give_error? error(51, "dimension", s) : FALSE;
+
+  case PI_SDIMENSION:
+  t = s;
+  k = 1;
+  if (*t == '-') { k = -1; t++; }
+    else if (*t == '+') t++;
+  v[0] = misc_get_dimension(t);
+  if (v[0] < 0) return give_error? error(51, "dimension", s) : FALSE;
+  v[0] *= k;
+  return TRUE;
+
+  case PI_INDENT:
+  return misc_get_dimensions(3, s, v, give_error);
+
+  case PI_INTEGER:
+  v[0] = misc_get_number(s);
+  if (v[0] >= 0) return TRUE;
+  return give_error? error(51, "number", s) : FALSE;
+
+  case PI_FP:
+  v[0] = misc_get_fp(s, &t);
+  if (v[0] > 0 && *t == 0) return TRUE;
+  return give_error? error(51, "point size", pp->name) : FALSE;
+
+  case PI_YESNO:
+  if (Ustrcmp(s, US"yes") == 0) v[0] = TRUE;
+  else if (Ustrcmp(s, US"no") == 0) v[0] = FALSE;
+  else return give_error? error(31, s, pp->name) : FALSE;
+  return TRUE;
+
+  case PI_ALIGN:
+  if (Ustrcmp(s, "left") == 0) v[0] = J_LEFT;
+  else if (Ustrcmp(s, "right") == 0) v[0] = J_RIGHT;
+  else if (Ustrcmp(s, "centre") == 0) v[0] = J_CENTRE;
+  else if (Ustrcmp(s, "center") == 0) v[0] = J_CENTRE;
+  else if (Ustrcmp(s, "both") == 0) v[0] = J_BOTH;
+  else return give_error? error(87, s) : FALSE;
+  return TRUE;
+  }
 
-    case PI_DIMOROBJ:
-    if (Ustrcmp(p->value, "object") == 0)
-      {
-      *((int *)(pilist[j].pointer)) = -1;
-      break;
-      }
-    /* Fall through */
-    /* vvvvvvvvvvvv */
-    case PI_DIMENSION:
-    x = misc_get_dimension(p->value);
-    if (x < 0) error(51, "dimension", p->value); else
-      {
-      *((int *)(pilist[j].pointer)) = x;
-      DEBUG(D_param) debug_printf("%s=%d\n", pilist[j].name, x);
-      }
-    break;
+return FALSE;
+}
 
-    case PI_SDIMENSION:
-      {
-      int sign = 1;
-      uschar *t = p->value;
-      if (*t == '-') { sign = -1; t++; }
-        else if (*t == '+') t++;
-      x = misc_get_dimension(t);
-      if (x < 0) error(51, "dimension", p->value); else
-        {
-        *((int *)(pilist[j].pointer)) = x*sign;
-        DEBUG(D_param) debug_printf("%s=%d\n", pilist[j].name, x*sign);
-        }
-      }
-    break;
 
-    case PI_INDENT:
-     {
-     int d[3];
-     if (misc_get_dimensions(3, p->value, &d[0], TRUE))
-       {
-       layoutparam *lp = (layoutparam *)(pilist[j].pointer);
-       lp->indent1 = d[0];
-       lp->indent  = d[1];
-       lp->endent  = d[2];
-       }
-     }
-    break;
 
-    case PI_INTEGER:
-    x = misc_get_number(p->value);
-    if (x < 0) error(51, "number", p->value); else
-      {
-      *((int *)(pilist[j].pointer)) = x;
-      DEBUG(D_param) debug_printf("%s=%d\n", pilist[j].name, x);
-      }
-    break;
+/*************************************************
+*       Decode the settings in a ?sdop item      *
+*************************************************/
+
+/* This function is called from the input reader for each ?sdop item. Each
+attribute that is the name of a parameter in one of the tables is looked up in
+a hash, and a setting block is made for it, with its value decoded if possible.
+The settings are chained off the first parameter in table order, which is the
+order in which they used to be found by scanning the tables. If an attribute is
+repeated, only the first is used, as before. The hash is built on the first
+call.
 
-    case PI_FP:
-    x = misc_get_fp(p->value, &s);
-    if (x <= 0 || *s != 0) error(51, "point size", pilist[j].name); else
+Argument:   the ?sdop item
+Returns:    nothing
+*/
+
+void
+pin_decode(item *i)
+{
+paramstr *p;
+
+if (i->p.param == NULL) return;
+
+if (piname_table == NULL)
+  {
+  int j, k;
+  for (j = 0; j <= PL_FLAGS; j++)
+    {
+    int count = (j < PL_FLAGS)? pilists[j].count : pftype_list_count + 1;
+    for (k = 0; k < count; k++)
       {
-      *((int *)(pilist[j].pointer)) = x;
-      DEBUG(D_param) debug_printf("%s=%d\n", pilist[j].name, x);
+      uschar *name = (j < PL_FLAGS)? pilists[j].params[k].name :
+        (k == 0)? US"table_warn_overflow" : pftype_list[k-1].name;
+      tree_node *tn = misc_malloc(sizeof(tree_node) + Ustrlen(name));
+      Ustrcpy(tn->name, name);
+      tn->data.val[0] = j;
+      tn->data.val[1] = k;
+      (void)hash_insertnode(&piname_table, tn);
       }
-    break;
+    }
+  }
+
+for (p = i->p.param; p != NULL; p = p->next)
+  {
+  int list, index;
+  pisetting *s, **sp;
+  tree_node *tn = hash_search(piname_table, p->name);
+
+  if (tn == NULL) continue;
+  list = tn->data.val[0];
+  index = tn->data.val[1];
+
+  for (sp = &(i->p.param->settings); (s = *sp) != NULL; sp = &(s->next))
+    {
+    if (s->list > list || (s->list == list && s->index >= index)) break;
+    }
+  if (s != NULL && s->list == list && s->index == index) continue;
+
+  *sp = misc_malloc(sizeof(pisetting));
+  (*sp)->next = s;
+  s = *sp;
+  s->param = p;
+  s->list = list;
+  s->index = index;
+
+  if (list != PL_FLAGS)
+    s->decoded = decode_value(&(pilists[list].params[index]), p->value,
+      s->value, FALSE);
+  else if (index > 0)
+    s->decoded = Ustrcmp(p->value, US"yes") == 0 ||
+      Ustrcmp(p->value, US"no") == 0;
+  else s->decoded = FALSE;
+
+  if (s->decoded && list == PL_FLAGS)
+    s->value[0] = Ustrcmp(p->value, US"yes") == 0;
+  }
+}
 
+
+
+/*************************************************
+*      Find the first setting for a table        *
+*************************************************/
+
+/*
+Arguments:
+  i          the ?sdop item
+  list       the PL_xxx value
+
+Returns:     the first setting for the table, or NULL
+*/
+
+static pisetting *
+first_setting(item *i, int list)
+{
+pisetting *s;
+if (i->p.param == NULL) return NULL;
+for (s = i->p.param->settings; s != NULL; s = s->next)
+  {
+  if (s->list == list) return s;
+  if (s->list > list) break;
+  }
+return NULL;
+}
+
+
+
+/*************************************************
+*     Check list of parameters and set values    *
+*************************************************/
+
+/* Given an <?sdop?> processesing element, apply its settings for one of the
+parameter tables. It is possible, however, for some to be overriden on the
+command line, in which case internal setting does not happen. Values that could
+not be decoded when the item was read are decoded again here so as to generate
+the error message.
+
+Arguments:
+  i          the ?sdop element
+  list       the PL_xxx value for the table
+
+Returns:     nothing
+*/
+
+static void
+check_pin_list(item *i, int list)
+{
+pisetting *ps;
+
+for (ps = first_setting(i, list); ps != NULL && ps->list == list;
+     ps = ps->next)
+  {
+  int k;
+  int *v = ps->value;
+  uschar *s;
+  paramstr *p = ps->param;
+  piparam *pp = &(pilists[list].params[ps->index]);
+
+  p->seen = TRUE;
+  if (pp->orptr != NULL && *(pp->orptr)) continue;  /* Command line override */
+
+  switch(pp->type)
+    {
     case PI_STRING:
-    *((uschar **)(pilist[j].pointer)) = p->value;
-    DEBUG(D_param) debug_printf("%s=\"%s\"\n", pilist[j].name, p->value);
-    break;
+    *((uschar **)(pp->pointer)) = p->value;
+    DEBUG(D_param) debug_printf("%s=\"%s\"\n", pp->name, p->value);
+    continue;
 
     case PI_STRING_LIST:
       {
-      uschar **lp = (uschar **)(pilist[j].pointer);
+      uschar **lp = (uschar **)(pp->pointer);
       s = p->value;
-      for (k = 0; k < pilist[j].num; k++)
+      for (k = 0; k < pp->num; k++)
         {
         uschar *t;
         for (t = s; *t != 0 && *t != ','; t++)
@@ -564,35 +689,87 @@ for (j = 0; j < count; j++)
           }
         *t = 0;
         DEBUG(D_param)
-          debug_printf("%s[%d]=\"%s\"\n", pilist[j].name, k, lp[k]);
+          debug_printf("%s[%d]=\"%s\"\n", pp->name, k, lp[k]);
         if (*s == ',') s++;
         }
-      if (*s != 0) error(52, p->value, pilist[j].num);
+      if (*s != 0) error(52, p->value, pp->num);
       }
+    continue;
+    }
+
+  /* Other types have a decoded value; if there isn't one, generate the error
+  message. */
+
+  if (!ps->decoded)
+    {
+    int dummy[4];
+    (void)decode_value(pp, p->value, dummy, TRUE);
+    continue;
+    }
+
+  switch(pp->type)
+    {
+    case PI_COLOUR:
+    memcpy(pp->pointer, v, 3 * sizeof(int));
     break;
 
-    case PI_YESNO:
-    if (Ustrcmp(p->value, US"yes") == 0)
+    case PI_FULLFONT:
       {
-      *((BOOL *)(pilist[j].pointer)) = TRUE;
-      DEBUG(D_param) debug_printf("%s=true\n", pilist[j].name);
+      vfontstr *vf = (vfontstr *)(pp->pointer);
+      if (v[0] > 0) vf->size = v[0];
+      if (v[1] >= 0) vf->leading = v[1];
+      if (v[2] >= 0) vf->family = v[2];
+      if (v[3] >= 0) vf->type = v[3];
       }
-    else if (Ustrcmp(p->value, US"no") == 0)
+    break;
+
+    case PI_FULLFONT4:
+    case PI_FULLFONT8:
       {
-      *((BOOL *)(pilist[j].pointer)) = FALSE;
-      DEBUG(D_param) debug_printf("%s=false\n", pilist[j].name);
+      vfontstr **vv;
+      int fontcount = (pp->type == PI_FULLFONT4)? 4 : 8;
+      if (v[3] >= 0) error(90);
+      for (vv = (vfontstr **)(pp->pointer); fontcount-- > 0; vv++)
+        {
+        vfontstr *vf = *vv;
+        if (v[0] > 0) vf->size = v[0];
+        if (v[1] >= 0) vf->leading = v[1];
+        if (v[2] >= 0 && fontcount < 4) vf->family = v[2];
+        }
       }
-    else
-      error(31, p->value, p->name);
+    break;
+
+    case PI_INDENT:
+      {
+      layoutparam *lp = (layoutparam *)(pp->pointer);
+      lp->indent1 = v[0];
+      lp->indent  = v[1];
+      lp->endent  = v[2];
+      }
+    break;
+
+    case PI_YESNO:
+    *((BOOL *)(pp->pointer)) = v[0];
+    DEBUG(D_param) debug_printf("%s=%s\n", pp->name, v[0]? "true" : "false");
+    break;
+
+    case PI_FONT:
+    *((int *)(pp->pointer)) = v[0];
+    DEBUG(D_param) debug_printf("%s=%s\n", pp->name, p->value);
     break;
 
     case PI_ALIGN:
-    if (Ustrcmp(p->value, "left") == 0) *((int *)(pilist[j].pointer)) = J_LEFT;
-    else if (Ustrcmp(p->value, "right") == 0) *((int *)(pilist[j].pointer)) = J_RIGHT;
-    else if (Ustrcmp(p->value, "centre") == 0) *((int *)(pilist[j].pointer)) = J_CENTRE;
-    else if (Ustrcmp(p->value, "center") == 0) *((int *)(pilist[j].pointer)) = J_CENTRE;
-    else if (Ustrcmp(p->value, "both") == 0) *((int *)(pilist[j].pointer)) = J_BOTH;
-    else error(87, p->value);
+    *((int *)(pp->pointer)) = v[0];
+    break;
+
+    case PI_DIMOROBJ:
+    *((int *)(pp->pointer)) = v[0];
+    if (v[0] >= 0) DEBUG(D_param) debug_printf("%s=%d\n", pp->name, v[0]);
+    break;
+
+    default:      /* Integer values */
+    *((int *)(pp->pointer)) = v[0];
+    DEBUG(D_param) debug_printf("%s=%d\n", pp->name, v[0]);
     break;
     }
   }
@@ -637,28 +814,28 @@ Returns:    the modified flags
 unsigned int
 pin_change_flags(item *i, unsigned int f)
 {
-int j;
-paramstr *p;
+pisetting *s = first_setting(i, PL_FLAGS);
 
-if ((p = misc_param_find(i, US"table_warn_overflow")) != NULL)
+if (s != NULL && s->index == 0)
   {
-  if (Ustrcmp(p->value, "always") == 0)
+  uschar *value = s->param->value;
+  s->param->seen = TRUE;
+  if (Ustrcmp(value, "always") == 0)
     f |= PIN_HARDOF;
-  else if (Ustrcmp(p->value, "never") == 0)
+  else if (Ustrcmp(value, "never") == 0)
     f &= ~ (PIN_HARDOF | PIN_SOFTOF);
-  else if (Ustrcmp(p->value, "overprint") == 0)
+  else if (Ustrcmp(value, "overprint") == 0)
     f = (f & ~PIN_HARDOF) | PIN_SOFTOF;
-  else (void)error(31, p->value, "table_warn_overflow");
+  else (void)error(31, value, "table_warn_overflow");
   }
 
-else for (j = 0; j < pftype_list_count; j++)
+else for (; s != NULL && s->list == PL_FLAGS; s = s->next)
   {
-  if ((p = misc_param_find(i, pftype_list[j].name)) != NULL)
-    {
-    if (Ustrcmp(p->value, US"yes") == 0) f |= pftype_list[j].flagvalue;
-    else if (Ustrcmp(p->value, US"no") == 0) f &= ~pftype_list[j].flagvalue;
-    else (void)error(31, p->value, pftype_list[j].name);
-    }
+  pftype *pf = &(pftype_list[s->index - 1]);
+  s->param->seen = TRUE;
+  if (!s->decoded) (void)error(31, s->param->value, pf->name);
+    else if (s->value[0]) f |= pf->flagvalue;
+      else f &= ~pf->flagvalue;
   }
 
 return f;
@@ -702,7 +879,7 @@ Returns:    nothing
 void
 pin_change_layparm(item *i)
 {
-check_pin_list(i, layparm_list, layparm_list_count);
+check_pin_list(i, PL_LAYOUT);
 
 /* Some indents need copying into alternate blocks (which are typically used so
 they can have different spacing settings). */
@@ -728,7 +905,7 @@ Returns:    nothing
 void
 pin_change_font_assign(item *i)
 {
-check_pin_list(i, subsupparam_list, subsupparam_list_count);
+check_pin_list(i, PL_SUBSUP);
 }
 
 
@@ -747,7 +924,7 @@ Returns:    nothing
 void
 pin_change_columns(item *i)
 {
-check_pin_list(i, mcparam_list, mcparam_list_count);
+check_pin_list(i, PL_COLUMNS);
 }
 
 
@@ -765,7 +942,7 @@ Returns:    nothing
 void
 pin_dynamic_layparm(item *i)
 {
-check_pin_list(i, dynamic_layparm_list, dynamic_layparm_list_count);
+check_pin_list(i, PL_DYNLAYOUT);
 }
 
 
@@ -784,7 +961,7 @@ Returns:    nothing
 void
 pin_dynamic_subsuper(item *i)
 {
-check_pin_list(i, subsuplevel_list, subsuplevel_list_count);
+check_pin_list(i, PL_SUBSUPLEVEL);
 if (subscript_down > 127)
   {
   subscript_down = 127;
@@ -814,7 +991,7 @@ Returns:    nothing
 void
 pin_paging_changes(item *i)
 {
-check_pin_list(i, cpparam_list, cpparam_list_count);
+check_pin_list(i, PL_PAGING);
 }
 
 
@@ -836,7 +1013,7 @@ pin_figtab_format_changes(item *i)
 {
 uschar *oldfnf = figure_number_format;
 uschar *oldtnf = table_number_format;
-check_pin_list(i, figtabparam_list, figtabparam_list_count);
+check_pin_list(i, PL_FIGTAB);
 if (figure_number_format != oldfnf)
   {
   uschar *p;
@@ -866,7 +1043,7 @@ if (example_number_format != oldtnf)
 void
 pin_figex_layout_changes(item *i)
 {
-check_pin_list(i, figexlayoutparam_list, figexlayoutparam_list_count);
+check_pin_list(i, PL_FIGEXLAYOUT);
 }
 
 
@@ -875,7 +1052,7 @@ check_pin_list(i, figexlayoutparam_list, figexlayoutparam_list_count);
 void
 pin_table_layout_changes(item *i)
 {
-check_pin_list(i, tablelayoutparam_list, tablelayoutparam_list_count);
+check_pin_list(i, PL_TABLELAYOUT);
 }
 
 
@@ -896,7 +1073,7 @@ Returns:    nothing
 void
 pin_headfoot(item *i)
 {
-check_pin_list(i, hfparam_list, hfparam_list_count);
+check_pin_list(i, PL_HEADFOOT);
 }
 
 
@@ -922,7 +1099,7 @@ int length;
 uschar *p, *pp, *np, *value;
 uschar *old_olist_format = olist_format;
 
-check_pin_list(i, olparam_list, olparam_list_count);
+check_pin_list(i, PL_OLIST);
 if (olist_format == old_olist_format) return;
 
 length = 1;
@@ -997,7 +1174,7 @@ for (i = item_list; i != NULL; i = i->next)
   {
   if (Ustrcmp(i->name, US"?sdop") != 0) continue;
   read_linenumber = i->linenumber;
-  check_pin_list(i, glparam_list, glparam_list_count);
+  check_pin_list(i, PL_GLOBAL);
   (void)misc_yesno_vector(i, US"toc_chapter_blanks", toc_chapter_blanks, 2);
   pin_change_layparm(i);
   }
@@ -1092,7 +1269,11 @@ return TRUE;
 *************************************************/
 
 /* This function scans an item list and processes <?sdop if(n)def="xxx"?> items
-by cutting out unwanted sections.
+by cutting out unwanted sections. Most conditionals are handled while the input
+is being read; those that are left are ones that depend on variable entities,
+whose values are final once the main list reaches this point, and ones that do
+not end in the file in which they start. Anything that is read after that, such
+as the title page template, is fully handled by the reader.
 
 Argument:   the first processing item
 Returns:    TRUE
@@ -1104,14 +1285,22 @@ pin_cutcond(item *item_list)
 item *i, *ii;
 
 DEBUG(D_any) debug_printf("Processing conditional sections\n");
+entity_variables_set = TRUE;
 
 for (i = item_list; i != NULL; i = i->next)
   {
   BOOL cond;
   uschar *cname, *evalue;
+  uschar *cutfilename = NULL;
   paramstr *p;
   int nest;
 
+  if (Ustrcmp(i->name, US"#FILENAME") == 0)
+    {
+    read_filename = i->p.string;
+    continue;
+    }
+
   if (Ustrcmp(i->name, US"?sdop") != 0) continue;
 
   p = misc_param_find(i, US"ifdef");
@@ -1128,11 +1317,13 @@ for (i = item_list; i != NULL; i = i->next)
   entity_find_byname(p->value, &evalue, TRUE, US"");
 
   /* Find the matching endif; we need to do this always so that it is marked
-  as used, and also so that any skipped nested ifdefs are also so marked. */
+  as used, and also so that any skipped nested ifdefs are also so marked. Note
+  the start of any included file, in case the text is cut. */
 
   nest = 1;
   for (ii = i->next; ii != NULL; ii = ii->next)
     {
+    if (Ustrcmp(ii->name, US"#FILENAME") == 0) cutfilename = ii->p.string;
     if (Ustrcmp(ii->name, US"?sdop") != 0) continue;
     p = misc_param_find(ii, US"endif");
     if (p != NULL)
@@ -1162,6 +1353,7 @@ for (i = item_list; i != NULL; i = i->next)
     }
   else
     {
+    if (cutfilename != NULL) read_filename = cutfilename;
     i = i->prev;
     i->next = ii->next;
     if (ii->next != NULL) ii->next->prev = i;
@@ -24,17 +24,19 @@ static png_bytep *row_pointers;
 *************************************************/
 
 /* This function reads a PNG file into main memory, passing back some
-information about the image. It must *not* close the file.
+information about the image. It must *not* close the file. When only the size
+of the image is wanted, the image data is not read.
 
 Arguments:
-  f        the open file
-  msg      where to return an error message
+  f                the open file
+  image_data_only  TRUE if only the size is wanted
+  msg              where to return an error message
 
 Returns:   TRUE on success, FALSE on failure
 */
 
 int
-read_PNG_file(FILE *f, uschar **msg)
+read_PNG_file(FILE *f, BOOL image_data_only, uschar **msg)
 {
 int i;
 uschar hdr[8];
@@ -74,6 +76,12 @@ png_set_sig_bytes(png_ptr, 8);
 png_read_info(png_ptr, info_ptr);
 give_png_image_data(info_ptr->width, info_ptr->height, info_ptr->rowbytes);
 
+if (image_data_only)
+  {
+  png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+  return TRUE;
+  }
+
 if (setjmp(png_jmpbuf(png_ptr)))
   {
   *msg = US"failure to read PNG image data";
@@ -94,29 +102,25 @@ return TRUE;
 *           Output PNG data                      *
 *************************************************/
 
-/* This function output the PNG rows in hex, and then frees the pointers and
-the data.
+/* This function passes the PNG rows to the same function that outputs the
+rows of a JPEG image, and then frees the pointers and the data.
 
-Argument:  the output file
+Argument:  token to pass to put_scanline_someplace()
 Returns:   nothing
 */
 
 void
-write_png_data(FILE *outfile)
+write_png_data(void *token)
 {
-int i, j;
+int i;
 for (i = 0; i < info_ptr->height; i++)
   {
-  for (j = 0; j < info_ptr->rowbytes; j++)
-    {
-    if ((j & 31) == 0) (void)fprintf(outfile, "\n");
-    (void)fprintf(outfile, "%02x", (unsigned int)row_pointers[i][j]);
-    }
-  (void)fprintf(outfile, "\n");
+  put_scanline_someplace(row_pointers[i], info_ptr->rowbytes, token);
   free(row_pointers[i]);
   }
 
 free(row_pointers);
+png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 }
 
 #endif
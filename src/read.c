@@ -7,8 +7,8 @@
 
 /* This module contains functions for reading a source file and parsing it into
 a sequence of chained item blocks. Chapters and sections are numbered as we
-encounter them. When an element has an id parameter, we add the id to a tree
-for later referencing. */
+encounter them. When an element has an id parameter, we add the id to a
+hash table for later referencing. */
 
 
 #include "sdop.h"
@@ -31,9 +31,26 @@ static int  insection = 0;
 static int  insubsection = 0;
 static int  inappendix = 0;
 
-static FILE *infile;
+static FILE *infile = NULL;
 static uschar *linebuffer;
 
+/* Conditional processing instructions are decided while the file is being
+read, unless they depend on variable entities whose values are not yet known,
+in which case they are left for pin_cutcond(). So are those that do not end in
+the file in which they start. */
+
+static int  cond_deferred = 0;       /* Nesting of those left in the list */
+static int  cond_kept = 0;           /* Open ones whose text is kept */
+static int  cond_skip = 0;           /* Nesting of those being skipped */
+static item *cond_kept_items[NESTSTACKSIZE];  /* The open kept ones */
+static item *cond_skip_item;         /* The one being skipped */
+static BOOL cond_skip_new = FALSE;   /* Skipping has just started */
+static int  cond_skip_line;          /* Line of the one being skipped */
+static int  cond_skip_nextline;      /* Line number at cond_skip_offset */
+static long cond_skip_offset;        /* File offset of the following line */
+static uschar *cond_skip_name;       /* "ifdef" or "ifndef" */
+static uschar cond_skip_rest[LINEBUFSIZE];  /* Rest of its line */
+
 
 
 /*************************************************
@@ -66,16 +83,16 @@ while (top > bot)
   if (c < 0) top = mid; else bot = mid + 1;
   }
 
-/* Element is not recognized; insert in tree if not already there. */
+/* Element is not recognized; insert in table if not already there. */
 
 if (c != 0)
   {
-  tn = tree_search(unknown_element_tree, new->name);
+  tn = hash_search(unknown_element_table, new->name);
   if (tn == NULL)
     {
     tn = misc_malloc(sizeof(tree_node) + Ustrlen(new->name));
     Ustrcpy(tn->name, new->name);
-    (void)tree_insertnode(&unknown_element_tree, tn);
+    (void)hash_insertnode(&unknown_element_table, tn);
     }
   return;
   }
@@ -114,14 +131,14 @@ for (param = new->p.param; param != NULL; param = param->next)
     (void)sprintf(CS buffer, "+%s:%s", param->name, new->name);
     }
 
-  /* Add to unknown tree */
+  /* Add to unknown table */
 
-  tn = tree_search(unknown_element_tree, buffer);
+  tn = hash_search(unknown_element_table, buffer);
   if (tn == NULL)
     {
     tn = misc_malloc(sizeof(tree_node) + Ustrlen(buffer));
     Ustrcpy(tn->name, buffer);
-    (void)tree_insertnode(&unknown_element_tree, tn);
+    (void)hash_insertnode(&unknown_element_table, tn);
     }
   }
 }
@@ -156,14 +173,21 @@ uschar *temp = NULL;
 /* If we are handling CDATA, search till end of line or ]]>. If there are any
 ampersands in the string, we have to convert them into &amp; because there is
 no memory that this data is literal, and it will be scanned later for entities.
-*/
+The C library's string searching functions are used for scanning, because they
+are usually much faster than a byte-by-byte loop. */
 
 if (*iscdata)
   {
   int ampcount = 0;
-  while (*p != 0 && Ustrncmp(p, "]]>", 3) != 0)
-    if (*p++ == '&') ampcount++;
+  uschar *amp = pp;
+  p = Ustrstr(pp, "]]>");
+  if (p == NULL) p = pp + Ustrlen(pp);
   len = p - pp;
+  while ((amp = memchr(amp, '&', p - amp)) != NULL)
+    {
+    ampcount++;
+    amp++;
+    }
 
   if (*p != 0)
     {
@@ -195,7 +219,7 @@ if (*iscdata)
 
 else
   {
-  while (*p != 0 && *p != '<') p++;
+  p += strcspn(CS p, "<");
   len = p - pp;
   }
 
@@ -256,6 +280,116 @@ return p + extra;
 
 
 
+/*************************************************
+*        Handle a conditional while reading      *
+*************************************************/
+
+/* This function is called for each sdop processing instruction as it is read.
+Those of the form <?sdop ifdef="xxx"?> or <?sdop ifndef="xxx"?> are decided on
+the spot when the value of the entity is already final, which is always the
+case except for the variable entities that come from <bookinfo> and global
+processing instructions, before pin_cutcond() has been called for the main
+list. A conditional that is true is discarded, as is the matching endif. When
+one is false, skipping is started: until the matching endif, nothing is read
+but comments, CDATA, and processing instructions, and the last of these are
+discarded, so that the skipped text is never parsed into items and included
+files within it are never read. If the endif is not in the same file, the
+skipped text has to be read after all, so skipping is done only when the input
+file is seekable. Conditionals whose endif is not in the same file are put back
+into the list at the end of the file, for pin_cutcond() to handle after the
+included files have been read.
+
+Anything else, including a conditional within one that is left in the list, or
+a processing instruction that contains other settings, is left for
+pin_cutcond() to handle in the old way. An endif that matches no conditional is
+left in the list, to be reported as unused.
+
+Argument:   the processing instruction item, which is the last item read
+Returns:    TRUE if the item has been discarded
+*/
+
+static BOOL
+read_conditional(item *new)
+{
+BOOL cond;
+BOOL sole = new->p.param != NULL && new->p.param->next == NULL;
+uschar *evalue;
+paramstr *p;
+
+/* While skipping, every processing instruction is discarded, after noting
+any change to the nesting of conditionals. */
+
+if (cond_skip > 0)
+  {
+  if (misc_param_find(new, US"endif") != NULL) cond_skip--;
+    else if (misc_param_find(new, US"ifdef") != NULL ||
+             misc_param_find(new, US"ifndef") != NULL) cond_skip++;
+  }
+
+/* An endif ends the innermost conditional. */
+
+else if ((p = misc_param_find(new, US"endif")) != NULL)
+  {
+  if (cond_deferred > 0)
+    {
+    cond_deferred--;
+    return FALSE;
+    }
+  if (cond_kept <= 0) return FALSE;
+  cond_kept--;
+  if (!sole) return FALSE;
+  }
+
+/* Test for a conditional, and whether it can be decided now. */
+
+else
+  {
+  p = misc_param_find(new, US"ifdef");
+  if (p != NULL) cond = TRUE; else
+    {
+    p = misc_param_find(new, US"ifndef");
+    if (p == NULL) return FALSE;   /* Neither ifdef nor ifndef */
+    cond = FALSE;
+    }
+
+  if (cond_deferred > 0 || infile == NULL || !sole ||
+      cond_kept >= NESTSTACKSIZE ||
+      (!entity_variables_set && entity_is_variable(p->value)))
+    {
+    cond_deferred++;
+    return FALSE;
+    }
+
+  entity_find_byname(p->value, &evalue, TRUE, US"");
+
+  if ((*evalue == 0) != cond) cond_kept_items[cond_kept++] = new; else
+    {
+    cond_skip_offset = ftell(infile);
+    if (cond_skip_offset < 0)
+      {
+      cond_deferred++;
+      return FALSE;
+      }
+    cond_skip = 1;
+    cond_skip_new = TRUE;
+    cond_skip_item = new;
+    cond_skip_line = new->linenumber;
+    cond_skip_nextline = read_linenumber;
+    cond_skip_name = p->name;
+    }
+  }
+
+/* Discard the item, which is at the end of what has been read so far. It is
+not freed, because it may have to be put back. */
+
+read_addto = new->prev;
+read_addto->next = new->next;
+if (new->next != NULL) new->next->prev = read_addto;
+return TRUE;
+}
+
+
+
 /*************************************************
 *             Handle DocBook markup item         *
 *************************************************/
@@ -311,7 +445,7 @@ if (*(++p) == '?')
     {
     for (;;)
       {
-      while (*(++p) != 0 && *p != '>');
+      p += strcspn(CS p + 1, ">") + 1;
       if (*p == '>')
         {
         p++;
@@ -360,19 +494,20 @@ else if (*p == '!')
 
   if (Ustrncmp(p, "!--", 3) != 0)
     {
-    while (*(++p) != 0 && *p != '>');
+    p += strcspn(CS p + 1, ">") + 1;
     if (*p == '>') p++;
     return p;
     }
 
-  /* Handle comments */
+  /* Handle comments. Only '-' and '<' can start the end of a comment or a
+  nested one, so skip quickly over anything else. */
 
   nestcount = 1;
   p += 3;
 
   while (nestcount > 0)
     {
-    while (*p != 0)
+    while (*(p += strcspn(CS p, "-<")) != 0)
       {
       if (Ustrncmp(p, "-->", 3) == 0)
         {
@@ -526,6 +661,7 @@ else
     {
     param = lastparam = misc_malloc(sizeof(paramstr) + 8);
     param->next = NULL;
+    param->settings = NULL;
     param->seen = TRUE;
     Ustrcpy(param->name, "#number");
     pp = param->value;
@@ -583,12 +719,13 @@ else
     quote = *p++;
     pp = p;
 
-    while (*p != 0 && *p != quote) p++;
+    p += strcspn(CS p, (quote == '"')? "\"" : "'");
     if (*p != quote) { (void)error(8, quote, attname, quote); break; }
 
     dlen = p - pp;
     newparam = misc_malloc(sizeof(paramstr) + dlen);
     newparam->next = NULL;
+    newparam->settings = NULL;
     newparam->seen = FALSE;
     Ustrcpy(newparam->name, attname);
     Ustrncpy(newparam->value, pp, dlen);
@@ -599,13 +736,13 @@ else
     lastparam = newparam;
     while (isspace(*(++p)));
 
-    /* If the attribute is "id", add it to the id tree */
+    /* If the attribute is "id", add it to the id table */
 
     if (Ustrcmp(attname, "id") == 0)
       {
       tn = misc_malloc(sizeof(tree_node) + dlen);
       Ustrcpy(tn->name, newparam->value);
-      if (!tree_insertnode(&id_tree, tn)) (void)error(11, tn->name);
+      if (!hash_insertnode(&id_table, tn)) (void)error(11, tn->name);
       }
     }
 
@@ -617,7 +754,7 @@ else
 
   /* Skip to end of element (in case jumped out after an error) */
 
-  while (*p != 0 && *p != '>') p++;
+  p += strcspn(CS p, ">");
   if (*p == 0) (void)error(5, name); else p++;
 
   /* Create the new element, crossreference it's id, note if it or any of its
@@ -639,6 +776,7 @@ else
 
   if (tn != NULL) tn->data.ptr = new;
   if (new->name[0] != '?') check_supported(new);
+    else if (procinst && !read_conditional(new)) pin_decode(new);
 
   if (!ended)
     {
@@ -659,6 +797,62 @@ return p;
 
 
 
+/*************************************************
+*       Skip input after a false conditional     *
+*************************************************/
+
+/* This function is called while skipping is in progress, for the rest of the
+line that contains a false conditional, and then for each subsequent line until
+the matching endif is found. Comments and processing instructions are handled
+by read_element() so that nesting is tracked and so that comments that contain
+markup are not misinterpreted; CDATA is passed over here. Everything else is
+ignored. The first time, the rest of the line is saved, in case it has to be
+read again.
+
+Arguments:
+  p            pointer in input line
+  nest_stack   the nesting stack
+  nest_ptrptr  pointer to the stack pointer
+
+Returns:       pointer past the endif, or to the end of the line
+*/
+
+static uschar *
+read_skip(uschar *p, item **nest_stack, int *nest_ptrptr)
+{
+if (cond_skip_new)
+  {
+  Ustrcpy(cond_skip_rest, p);
+  cond_skip_new = FALSE;
+  }
+
+while (cond_skip > 0 && *(p += strcspn(CS p, "<")) != 0)
+  {
+  if (p[1] == '?' || Ustrncmp(p, "<!--", 4) == 0)
+    p = read_element(p, nest_stack, nest_ptrptr);
+
+  else if (Ustrncmp(p, "<![CDATA[", 9) == 0)
+    {
+    int startline = read_linenumber;
+    uschar *pp;
+    p += 9;
+    while ((pp = Ustrstr(p, "]]>")) == NULL)
+      {
+      p = Ufgets(linebuffer, LINEBUFSIZE, infile);
+      read_linenumber++;
+      if (p == NULL) (void)error(88, startline);  /* Hard */
+      }
+    p = pp + 3;
+    }
+
+  else p++;
+  }
+
+return p;
+}
+
+
+
 /*************************************************
 *       Read a string of elements and text       *
 *************************************************/
@@ -693,7 +887,12 @@ while (*p != 0)
     {
     if (misc_istext_elname(p+1)) hadtext = TRUE;
     p = read_element(p, nest_stack, nest_stackptr);
-    if (!hadtext) while (isspace(*p)) p++;
+    if (!hadtext) p += strspn(CS p, WHITESPACE);
+    if (cond_skip > 0)
+      {
+      p = read_skip(p, nest_stack, nest_stackptr);
+      if (!hadtext) p += strspn(CS p, WHITESPACE);
+      }
     }
   else
     {
@@ -706,6 +905,98 @@ while (*p != 0)
 
 
 
+/*************************************************
+*            Read the lines of a file            *
+*************************************************/
+
+/* This function is called from read_file2() below to read lines from the
+current input file until its end, and process them.
+
+Arguments:
+  buffer1        the line buffer, of size LINEBUFSIZE
+  buffer2        a work buffer of the same size
+  nest_stack     the nesting stack
+  nest_stackptr  pointer to the stack pointer
+
+Returns:         nothing
+*/
+
+static void
+read_lines(uschar *buffer1, uschar *buffer2, item **nest_stack,
+  int *nest_stackptr)
+{
+uschar *p;
+
+while ((p = Ufgets(buffer1, LINEBUFSIZE, infile)) != NULL)
+  {
+  uschar *pp = p + Ustrlen(p);
+
+  /* Retain the newline on the end of the line, but remove any white space
+  that precedes it. */
+
+  while (pp > p + 1)
+    {
+    if (!isspace(pp[-2])) break;
+    (pp--)[-2] = '\n';
+    }
+  *pp = 0;
+
+  read_linenumber++;
+
+  /* Unless we are in <literallayout>, remove leading whitespace before
+  processing the line. This is an optimization just to save storing all those
+  leading spaces when the input is indented. The later code would in fact work
+  without it. */
+
+  if (!inliterallayout) p += strspn(CS p, WHITESPACE);
+
+  /* If a false conditional is being skipped, look for its endif. */
+
+  if (cond_skip > 0)
+    {
+    p = read_skip(p, nest_stack, nest_stackptr);
+    if (!inliterallayout) p += strspn(CS p, WHITESPACE);
+    }
+
+  /* The <quote> and </quote> elements get converted into quote characters, and
+  so are not like other elements. We do the conversion here so that they do not
+  interrupt strings of data. Otherwise, there can be problems when </quote> is
+  at the end of a line (because of the way newline is handled). These elements
+  are presumed not to be very common, so I've done this quite crudely, but a
+  single search rules out most lines. */
+
+  while (Ustrstr(p, "quote>") != NULL &&
+         ((pp = Ustrstr(p, "<quote>")) != NULL ||
+          (pp = Ustrstr(p, "</quote>")) != NULL))
+    {
+    int len;
+    uschar *c, *pn;
+    if (pp[1] == '/')
+      {
+      c = US"&#x201D;";
+      len = 8;
+      }
+    else
+      {
+      c = US"&#x201C;";
+      len = 7;
+      }
+    memcpy(buffer2, p, pp - p);
+    pn = buffer2 + (pp - p);
+    memcpy(pn, c, 8);
+    Ustrcpy(pn + 8, pp + len);
+    Ustrcpy(buffer1, buffer2);
+    p = buffer1;
+    }
+
+  /* Now process the input line */
+
+  read_string(p, nest_stack, nest_stackptr);
+  }
+}
+
+
+
 /*************************************************
 *         Read the input file into memory        *
 *************************************************/
@@ -729,7 +1020,6 @@ BOOL
 read_file2(uschar *filename, item **nest_stack, int *nest_stackptr)
 {
 item *fn;
-uschar *p;
 uschar buffer1[LINEBUFSIZE];
 uschar buffer2[LINEBUFSIZE];
 
@@ -767,66 +1057,63 @@ Ustrcpy(fn->p.string, read_filename);
 read_addto->next = fn;
 read_addto = fn;
 
-/* Now process the lines of the file */
+/* Conditionals are decided while reading only if they end in the file in
+which they start. */
 
-while ((p = Ufgets(buffer1, sizeof(buffer1), infile)) != NULL)
-  {
-  uschar *pp = p + Ustrlen(p);
+cond_deferred = cond_kept = cond_skip = 0;
 
-  /* Retain the newline on the end of the line, but remove any white space
-  that precedes it. */
+/* Now process the lines of the file. If the end of the file is reached while
+skipping, the endif is not in this file. The text is not skipped after all, so
+go back to just after the conditional and read it again. For the main file and
+the files it includes, the conditional is put back in the list, to be decided
+by pin_cutcond() when all the files have been read; it gives the error if the
+endif is missing. Later, nothing else is read into the list, so the endif is
+missing, and the error is given here. */
 
-  while (pp > p + 1)
+read_lines(buffer1, buffer2, nest_stack, nest_stackptr);
+
+while (cond_skip > 0)
+  {
+  cond_skip = 0;
+  if (!entity_variables_set)
     {
-    if (!isspace(pp[-2])) break;
-    (pp--)[-2] = '\n';
+    item *i = cond_skip_item;
+    i->prev = read_addto;
+    i->next = read_addto->next;
+    if (i->next != NULL) i->next->prev = i;
+    read_addto->next = i;
+    read_addto = i;
+    cond_deferred = 1;
     }
-  *pp = 0;
-
-  read_linenumber++;
-
-  /* Unless we are in <literallayout>, remove leading whitespace before
-  processing the line. This is an optimization just to save storing all those
-  leading spaces when the input is indented. The later code would in fact work
-  without it. */
-
-  if (!inliterallayout) while (isspace(*p)) p++;
-
-  /* The <quote> and </quote> elements get converted into quote characters, and
-  so are not like other elements. We do the conversion here so that they do not
-  interrupt strings of data. Otherwise, there can be problems when </quote> is
-  at the end of a line (because of the way newline is handled). These elements
-  are presumed not to be very common, so I've done this quite crudely. */
-
-  while ((pp = Ustrstr(p, "<quote>")) != NULL ||
-         (pp = Ustrstr(p, "</quote>")) != NULL)
+  else
     {
-    int len;
-    uschar *c, *pn;
-    if (pp[1] == '/')
-      {
-      c = US"&#x201D;";
-      len = 8;
-      }
-    else
-      {
-      c = US"&#x201C;";
-      len = 7;
-      }
-    memcpy(buffer2, p, pp - p);
-    pn = buffer2 + (pp - p);
-    memcpy(pn, c, 8);
-    Ustrcpy(pn + 8, pp + len);
-    Ustrcpy(buffer1, buffer2);
-    p = buffer1;
+    read_linenumber = cond_skip_line;
+    (void)error(68, cond_skip_name);
     }
+  if (fseek(infile, cond_skip_offset, SEEK_SET) != 0) break;
+  read_linenumber = cond_skip_nextline;
+  Ustrcpy(buffer1, cond_skip_rest);
+  read_string(buffer1, nest_stack, nest_stackptr);
+  read_lines(buffer1, buffer2, nest_stack, nest_stackptr);
+  }
 
-  /* Now process the input line */
+/* True conditionals whose endif has not been found are put back where they
+were, so that pin_cutcond() can match them with their endifs. The innermost is
+done first, so that those that followed the same item stay in order. Once
+pin_cutcond() has been called for the main list, they are not needed. */
 
-  read_string(p, nest_stack, nest_stackptr);
-  }
+if (!entity_variables_set)
+  while (cond_kept > 0)
+    {
+    item *i = cond_kept_items[--cond_kept];
+    i->next = i->prev->next;
+    if (i->next != NULL) i->next->prev = i;
+    i->prev->next = i;
+    if (read_addto == i->prev) read_addto = i;
+    }
 
 (void)fclose(infile);
+infile = NULL;
 read_linenumber = 0;
 return TRUE;
 }
@@ -55,10 +55,11 @@ for (i = item_list; i != NULL; i = i->next)
 
   /* Now see if the reference was set. */
 
-  tn = tree_search(id_tree, p->value);
+  tn = hash_search(id_table, p->value);
   if (tn == NULL)
     {
     (void)error(12, p->value);
+    stats_unresolved_xref(p->value);
     continue;
     }
   refitem = (item *)tn->data.ptr;
@@ -4,7 +4,9 @@
 
 /* Copyright (c) Philip Hazel, 2009 */
 
-/* This module contains the main program and initialization functions. */
+/* This module contains the main program and initialization functions. When it
+is compiled as part of the library (see libsdop.c), SDOP_LIBRARY is defined,
+and the main program and render server are omitted. */
 
 #include "sdop.h"
 
@@ -16,6 +18,8 @@
 
 static uschar *sdop_filename = NULL;
 static uschar *out_filename = NULL;
+static BOOL    server_mode = FALSE;
+static BOOL    show_memory_hwm = FALSE;
 
 static bit_table debug_options[] = {
   { US"all",             D_all },
@@ -223,6 +227,12 @@ int i;
 (void)fprintf(stderr,
   "Usage: sdop [options] [input file]\n"
   "  -d<debug-options>         produce debug output (no space after -d)\n"
+  "  -F <directory>            embed subsets of the fonts found in <directory>\n"
+  "  -Fc <directory>           keep font subsets in <directory> for re-use\n"
+  "  -j <n>                    use <n> parallel processes for body pages\n"
+  "  -m                        write body pages as soon as they are paginated\n"
+  "  -M                        show the memory high-water mark\n"
+  "  -n                        lay out only; write a JSON report, not PostScript\n"
   "  -o <output-file>          specify output file\n"
   "  -p <pagelist>             output these main body pages\n"
   "  -pf <pagelist>            output these frontmatter pages\n");
@@ -230,7 +240,10 @@ int i;
 (void)fprintf(stderr,
   "  -q                        suppress warnings for unsupported DocBook features\n"
   "  -qc                       suppress warnings for unsupported characters\n"
+  "  -r <dpi>                  reduce images to at most <dpi> dots per inch\n"
   "  -S <directories>          list of additional SDoP share directories\n"
+  "  -server                   run as a render server, reading jobs from stdin\n"
+  "  -stats <file>             write timings and counters as JSON (- for stderr)\n"
   "  -w                        warn for unsupported DocBook features (default)\n"
   "  -wc                       warn for unsupported characters (default)\n"
   "  -v                        show version information\n"
@@ -287,6 +300,53 @@ for (i = 1; i < argc; i++)
     debug_selector |= D_any;
     if (!decode_debug(arg+2)) return FALSE;
     }
+  else if (Ustrcmp(arg, "-F") == 0)
+    {
+    font_directory = US argv[++i];
+    if (font_directory == NULL) { usage(); return FALSE; }
+    if (Ustrlen(font_directory) > MAXFONTPATH)
+      {
+      (void)fprintf(stderr, "sdop: the -F path must be no longer than %d "
+        "characters\n", MAXFONTPATH);
+      return FALSE;
+      }
+    }
+  else if (Ustrcmp(arg, "-Fc") == 0)
+    {
+    font_cache = US argv[++i];
+    if (font_cache == NULL) { usage(); return FALSE; }
+    if (Ustrlen(font_cache) > MAXFONTPATH)
+      {
+      (void)fprintf(stderr, "sdop: the -Fc path must be no longer than %d "
+        "characters\n", MAXFONTPATH);
+      return FALSE;
+      }
+    }
+  else if (Ustrcmp(arg, "-j") == 0)
+    {
+    char *endptr;
+    uschar *n = US argv[++i];
+    if (n == NULL) { usage(); return FALSE; }
+    write_workers = Ustrtol(n, &endptr, 10);
+    if (*endptr != 0 || write_workers < 1 || write_workers > MAXWRITEWORKERS)
+      {
+      (void)fprintf(stderr, "sdop: -j must be followed by a number in the "
+        "range 1-%d\n", MAXWRITEWORKERS);
+      return FALSE;
+      }
+    }
+  else if (Ustrcmp(arg, "-m") == 0)
+    {
+    stream_output = TRUE;
+    }
+  else if (Ustrcmp(arg, "-M") == 0)
+    {
+    show_memory_hwm = TRUE;
+    }
+  else if (Ustrcmp(arg, "-n") == 0 || Ustrcmp(arg, "--layout-only") == 0)
+    {
+    layout_only = TRUE;
+    }
   else if (Ustrcmp(arg, "-o") == 0)
     {
     out_filename = US argv[++i];
@@ -302,6 +362,27 @@ for (i = 1; i < argc; i++)
     warn_unsupported = FALSE;
     warn_unsupported_set = TRUE;
     }
+  else if (Ustrcmp(arg, "-r") == 0)
+    {
+    char *endptr;
+    uschar *n = US argv[++i];
+    if (n == NULL) { usage(); return FALSE; }
+    image_resolution = Ustrtol(n, &endptr, 10);
+    if (*endptr != 0 || image_resolution < 1)
+      {
+      (void)fprintf(stderr, "sdop: -r must be followed by a positive number\n");
+      return FALSE;
+      }
+    }
+  else if (Ustrcmp(arg, "-server") == 0)
+    {
+    server_mode = TRUE;
+    }
+  else if (Ustrcmp(arg, "-stats") == 0)
+    {
+    stats_filename = US argv[++i];
+    if (stats_filename == NULL) { usage(); return FALSE; }
+    }
   else if (Ustrcmp(arg, "-S") == 0)
     {
     if (argv[++i] == NULL) { usage(); return FALSE; }
@@ -354,18 +435,23 @@ if (argc > i + 1)
   return FALSE;
   }
 
+/* Nothing is written in layout-only mode, so there is nothing to stream. */
+
+if (layout_only) stream_output = FALSE;
+
 /* This will set NULL if there is no file name. If there is a file name and no
-output file is specified, default it to the input name with a .ps extension. */
+output file is specified, default it to the input name with a .ps extension,
+or .json for a layout report. */
 
 sdop_filename = US argv[i];
 if (sdop_filename != NULL && out_filename == NULL)
   {
   uschar *p;
   int len = Ustrlen(sdop_filename);
-  out_filename = misc_malloc(len + 4);
+  out_filename = misc_malloc(len + 6);
   Ustrcpy(out_filename, sdop_filename);
   if ((p = Ustrrchr(out_filename, '.')) != NULL) len = p - out_filename;
-  Ustrcpy(out_filename + len, ".ps");
+  Ustrcpy(out_filename + len, layout_only? ".json" : ".ps");
   }
 
 return TRUE;
@@ -379,7 +465,10 @@ return TRUE;
 static BOOL
 sdop_init_hyphen(void)
 {
+static BOOL done = FALSE;
 uschar hfilename[256];
+if (done) return TRUE;                 /* Already done by the render server */
+done = TRUE;
 if (misc_find_share(US"HyphenData", hfilename, FALSE))
   {
   main_hyphenfile = Ufopen(hfilename, "rb");
@@ -430,36 +519,43 @@ return TRUE;
 
 
 /*************************************************
-*      Print unknown element/attribute tree      *
+*      Print unknown element/attribute table     *
 *************************************************/
 
-/* Prints the tree of unknown elements and attributes, calling itself
-recursively to get them in order.
+/* Prints the table of unknown elements and attributes. The table is unordered,
+so a sorted vector of its nodes is obtained, to get them in order.
 
-Argument:    a tree node
+Argument:    the table
 Returns:     nothing
 */
 
 static void
-print_unknown_tree(tree_node *tn)
+print_unknown_table(hash_table *t)
 {
-if (tn->left != NULL) print_unknown_tree(tn->left);
-if (tn->name[0] == '+')
+int i, count;
+tree_node **v = hash_sorted(t, &count);
+
+for (i = 0; i < count; i++)
   {
-  uschar *eptr = Ustrrchr(tn->name, ':');
-  uschar *vptr = Ustrchr(tn->name, '=');
-  if (vptr == NULL)
-    fprintf(stderr, "%.*s in <%s>\n", eptr - tn->name - 1, tn->name + 1,
-      eptr + 1);
+  tree_node *tn = v[i];
+  if (tn->name[0] == '+')
+    {
+    uschar *eptr = Ustrrchr(tn->name, ':');
+    uschar *vptr = Ustrchr(tn->name, '=');
+    if (vptr == NULL)
+      fprintf(stderr, "%.*s in <%s>\n", eptr - tn->name - 1, tn->name + 1,
+        eptr + 1);
+    else
+      fprintf(stderr, "%.*s=\"%.*s\" in <%s>\n", vptr - tn->name - 1,
+        tn->name + 1, eptr - vptr - 1, vptr + 1, eptr + 1);
+    }
   else
-    fprintf(stderr, "%.*s=\"%.*s\" in <%s>\n", vptr - tn->name - 1,
-      tn->name + 1, eptr - vptr - 1, vptr + 1, eptr + 1);
-  }
-else
-  {
-  fprintf(stderr, "<%s>\n", tn->name);
+    {
+    fprintf(stderr, "<%s>\n", tn->name);
+    }
   }
-if (tn->right != NULL) print_unknown_tree(tn->right);
+
+if (v != NULL) misc_free(v, count * sizeof(tree_node *));
 }
 
 
@@ -515,27 +611,24 @@ return TRUE;
 
 
 /*************************************************
-*          Entry point and main program          *
+*              Process a document                *
 *************************************************/
 
-/* Decode the command line, set up dummy first items for the input file and
-head/foot/toc templates, initialize some data, then run the various phases of
-the program. */
+/* Set up dummy first items for the input file and head/foot/toc templates,
+initialize some data, then run the various phases of the program.
 
-int
-main(int argc, char **argv)
+Arguments:  none
+Returns:    TRUE if all went well
+*/
+
+static BOOL
+render_document(void)
 {
 item *format_from;
-BOOL yield;
-uschar *share = (uschar *)getenv("SDOP_SHARE");
-
-if (share != NULL)
-  {
-  sdop_share = misc_malloc(Ustrlen(share) + 1);
-  Ustrcpy(sdop_share, share);
-  }
-
-yield = sdop_decode_arg(argc, argv);
+item *i;
+BOOL post_index = FALSE;
+BOOL yield = TRUE;
+double start = sys_wallclock();
 
 main_item_list  = misc_dummy_item();
 title_item_list = misc_dummy_item();
@@ -562,38 +655,43 @@ page_columns_init = 1;
 page_colsep_init = DEFAULT_PAGE_COLSEP;
 
 yield = yield &&
-  sdop_init_hyphen() &&
-  read_main_file(sdop_filename) &&
-  read_includes(main_item_list, sdop_filename) &&
-  remove_ignored(main_item_list) &&
-  book_getdata(main_item_list) &&
-  pin_global(main_item_list) &&
-  sdop_init_templates() &&
-  compute_defaults() &&
-  pin_cutcond(main_item_list) &&
-  number_titles(main_item_list) &&
-  toc_save_raw_titles(main_item_list) &&
-  pin_process_inserts(main_item_list) &&
-  entity_expand(main_item_list) &&
-  url_check(main_item_list) &&
-  footnote_insert_keys(main_item_list) &&
-  ref_resolve(main_item_list) &&
-  font_assign(main_item_list, FONTS_MAIN) &&
-  font_loadalltables() &&
-  para_identify(main_item_list, FONTS_MAIN, NULL) &&
-  table_identify(main_item_list, NULL) &&
-  revision_check(main_item_list) &&
-  para_format(main_item_list) &&
-  preface_process() &&
-  page_format(main_item_list, &format_from, main_even_pages, FALSE,
-    &main_page_count, US"body");
+  PHASE("sdop_init_hyphen", sdop_init_hyphen()) &&
+  PHASE("read_main_file", read_main_file(sdop_filename)) &&
+  PHASE("read_includes", read_includes(main_item_list, sdop_filename)) &&
+  PHASE("remove_ignored", remove_ignored(main_item_list)) &&
+  PHASE("book_getdata", book_getdata(main_item_list)) &&
+  PHASE("pin_global", pin_global(main_item_list)) &&
+  PHASE("sdop_init_templates", sdop_init_templates()) &&
+  PHASE("compute_defaults", compute_defaults()) &&
+  PHASE("pin_cutcond", pin_cutcond(main_item_list)) &&
+  PHASE("number_titles", number_titles(main_item_list)) &&
+  PHASE("toc_save_raw_titles", toc_save_raw_titles(main_item_list)) &&
+  PHASE("pin_process_inserts", pin_process_inserts(main_item_list)) &&
+  PHASE("object_prefetch", object_prefetch(main_item_list)) &&
+  PHASE("entity_expand", entity_expand(main_item_list)) &&
+  PHASE("url_check", url_check(main_item_list)) &&
+  PHASE("footnote_insert_keys", footnote_insert_keys(main_item_list)) &&
+  PHASE("ref_resolve", ref_resolve(main_item_list)) &&
+  PHASE("font_assign", font_assign(main_item_list, FONTS_MAIN)) &&
+  PHASE("font_loadalltables", font_loadalltables()) &&
+  PHASE("para_identify", para_identify(main_item_list, FONTS_MAIN, NULL)) &&
+  PHASE("table_identify", table_identify(main_item_list, NULL)) &&
+  PHASE("revision_check", revision_check(main_item_list)) &&
+  PHASE("para_format", para_format(main_item_list)) &&
+  PHASE("preface_process", preface_process()) &&
+  PHASE("page_format", page_format(main_item_list, &format_from,
+    main_even_pages, FALSE, &main_page_count, US"body"));
 
 /* This loop processes a sequence of indexes and following body text. If there
 are no entries for an index, the <index> element will be removed from the
-chain. */
+chain. When the output is being streamed, pagination also stops at the start
+of each chapter and after each page; the pages so far are written, and the
+loop then carries on with the next chapter or page. */
 
 while (yield)
   {
+  if (stream_output)
+    (void)PHASE("write_stream_pages", write_stream_pages(FALSE, format_from));
   if (format_from == NULL) break;                /* No (more) text or indexes */
   if (Ustrcmp(format_from->name, "index") == 0)  /* Process an index */
     {
@@ -601,18 +699,19 @@ while (yield)
     page_colsep_save = page_colsep;              /* from end of main text. */
     page_columns_init = 1;                       /* Start index with default */
     page_colsep_init = DEFAULT_PAGE_COLSEP;      /* so the title is right. */
-    yield = index_make(main_item_list, format_from);
+    yield = PHASE("index_make", index_make(main_item_list, format_from));
     if (yield)
       {
       if (format_from->prev->next == format_from)
         {
-        yield = font_assign(format_from, FONTS_INDEX) &&
-          font_loadalltables() &&
-          para_identify(format_from, FONTS_INDEX, NULL) &&
-          table_identify(format_from, NULL) &&
-          para_format(format_from) &&
-          page_format(format_from, &format_from, main_even_pages, TRUE,
-            &main_page_count, US"index");
+        yield = PHASE("font_assign", font_assign(format_from, FONTS_INDEX)) &&
+          PHASE("font_loadalltables", font_loadalltables()) &&
+          PHASE("para_identify",
+            para_identify(format_from, FONTS_INDEX, NULL)) &&
+          PHASE("table_identify", table_identify(format_from, NULL)) &&
+          PHASE("para_format", para_format(format_from)) &&
+          PHASE("page_format", page_format(format_from, &format_from,
+            main_even_pages, TRUE, &main_page_count, US"index"));
         }
       else
         {
@@ -625,20 +724,48 @@ while (yield)
       }
     page_columns_init = page_columns_save;       /* Reset for post-index text */
     page_colsep_init = page_colsep_save;
+    post_index = TRUE;
     }
-  else                                           /* Process post-index text */
+  else if (post_index)                           /* Process post-index text */
     {
+    post_index = FALSE;
     yield = yield &&
-      font_assign(format_from, FONTS_MAIN) &&
-      font_loadalltables() &&
-      para_identify(format_from, FONTS_MAIN, NULL) &&
-      table_identify(format_from, NULL) &&
-      para_format(format_from) &&
-      page_format(format_from, &format_from, main_even_pages, FALSE,
-        &main_page_count, US"body");
+      PHASE("font_assign", font_assign(format_from, FONTS_MAIN)) &&
+      PHASE("font_loadalltables", font_loadalltables()) &&
+      PHASE("para_identify",
+        para_identify(format_from, FONTS_MAIN, NULL)) &&
+      PHASE("table_identify", table_identify(format_from, NULL)) &&
+      PHASE("para_format", para_format(format_from)) &&
+      PHASE("page_format", page_format(format_from, &format_from,
+        main_even_pages, FALSE, &main_page_count, US"body"));
+    }
+  else if (Ustrcmp(format_from->name, "#PDATA") == 0)  /* Next page */
+    {
+    page_columns_init = page_columns;
+    page_colsep_init = page_colsep;
+    yield = PHASE("page_format", page_format(format_from, &format_from,
+      main_even_pages, FALSE, &main_page_count, US"body"));
+    }
+  else                                           /* Next streamed chapter */
+    {
+    page_columns_init = page_columns;
+    page_colsep_init = page_colsep;
+    yield = PHASE("para_format", para_format(format_from)) &&
+      PHASE("page_format", page_format(format_from, &format_from,
+        main_even_pages, FALSE, &main_page_count, US"body"));
     }
   }
 
+/* The count that page_format() keeps includes pages that are started but
+never filled, such as one before each index. For the layout report and the
+statistics, count the body pages that are written instead: each #PDATA item
+that is followed by something, as in write_file(). The items are still there
+when the pages have been streamed. */
+
+main_page_count = 0;
+for (i = main_item_list; i != NULL && i->next != NULL; i = i->next)
+  if (Ustrcmp(i->name, "#PDATA") == 0) main_page_count++;
+
 /* Reset the multicolumn initial values to the defaults before creating the
 title pages and the TOC for a book. */
 
@@ -648,18 +775,24 @@ page_colsep_init = DEFAULT_PAGE_COLSEP;
 if (document_type != DOC_ARTICLE)
   {
   yield = yield &&
-    book_title_make() &&
-    toc_make(main_item_list, preface_item_list);
+    PHASE("book_title_make", book_title_make()) &&
+    PHASE("toc_make", toc_make(main_item_list, preface_item_list));
   }
 
+/* In layout-only mode, write the report instead of the output. Processing
+instructions that affect only the output will not have been looked at, so
+there is no check for unrecognized ones. */
+
+if (yield && layout_only)
+  yield = stats_layout_report(sdop_filename, out_filename, start);
+
 /* If all is well, write the output and then check for unrecognized processing
 instructions. If something has gone wrong, don't do this check because we may
 not have looked at some of them. */
 
-if (yield)
+else if (yield)
   {
-  item *i;
-  yield = write_file(out_filename);
+  yield = PHASE("write_file", write_file(out_filename));
   for (i = main_item_list; i != NULL; i = i->next)
     {
     paramstr *p;
@@ -679,26 +812,194 @@ if (yield)
 
 if (warn_unsupported)
   {
-  if (unknown_element_tree != NULL)
+  if (unknown_element_table != NULL)
     {
     fprintf(stderr, "sdop: Ignored unrecognized elements and attributes:\n");
-    print_unknown_tree(unknown_element_tree);
+    print_unknown_table(unknown_element_table);
     }
   }
 
-DEBUG(D_any)
+if (show_memory_hwm || (debug_selector & D_any) != 0)
   {
-  debug_printf("Memory HWM = ");
+  uschar buffer[24];
   if (memory_hwm >= 1000000)
-    debug_printf("%d,%03d,%03d\n", memory_hwm/1000000,
+    (void)sprintf(CS buffer, "%d,%03d,%03d", memory_hwm/1000000,
       (memory_hwm%1000000)/1000, memory_hwm%1000);
   else if (memory_hwm >= 1000)
-    debug_printf("%d,%03d\n", memory_hwm/1000, memory_hwm%1000);
+    (void)sprintf(CS buffer, "%d,%03d", memory_hwm/1000, memory_hwm%1000);
   else
-    debug_printf("%d\n", memory_hwm);
+    (void)sprintf(CS buffer, "%d", memory_hwm);
+  DEBUG(D_any) debug_printf("Memory HWM = %s\n", buffer);
+  if (show_memory_hwm)
+    (void)fprintf(stderr, "sdop: memory high-water mark = %s bytes\n", buffer);
+  }
+
+if (stats_filename != NULL) stats_write(sdop_filename, yield);
+return yield;
+}
+
+
+
+/*************************************************
+*     Load data that is common to all documents  *
+*************************************************/
+
+/* This is used by the render server and the library interface, which process
+many documents. The hyphenation index, the metrics for the standard fonts, the
+collation tables, and the PostScript header are loaded once, before any
+documents are processed. Processes that are forked to handle documents share
+this data with their parent.
+
+Arguments:  none
+Returns:    TRUE if all went well
+*/
+
+static BOOL
+sdop_load_common(void)
+{
+if (!sdop_init_hyphen() || !font_preload() || !write_load_psheader())
+  return FALSE;
+index_init_collation();
+return TRUE;
+}
+
+
+
+#ifndef SDOP_LIBRARY
+/*************************************************
+*            Run one render server job           *
+*************************************************/
+
+/* This function is called in a child process (see sys_run_job()) for each job
+that the server reads. The options given when the server was started are the
+defaults; the job's options are decoded on top of them. A job must name its
+input and output files, because the standard input and output are used for
+talking to the server's client.
+
+Arguments:  as for main()
+Returns:    the exit code for the job
+*/
+
+static int
+server_job(int argc, char **argv)
+{
+pages_odd = pages_even = FALSE;
+if (!sdop_decode_arg(argc, argv)) return EXIT_FAILURE;
+if (server_mode || sdop_filename == NULL || Ustrcmp(sdop_filename, "-") == 0 ||
+    Ustrcmp(out_filename, "-") == 0)
+  {
+  (void)fprintf(stderr, "sdop: a server job must name its input and output "
+    "files, and may not use -server\n");
+  return EXIT_FAILURE;
+  }
+return render_document()? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+
+/*************************************************
+*               Render server                    *
+*************************************************/
+
+/* In server mode, the data that does not depend on the document (the
+hyphenation index, the metrics for the usual fonts, the collation tables, the
+PostScript header, and the locations of shared files) is loaded once. Then
+each line of the standard input is a job: a list of options and file names,
+separated by white space, just as they would be given on the command line.
+Each job runs in a child process, starting with a pristine copy of the
+server's data, so none of the global variables need to be reset afterwards.
+When a job finishes, a line containing its exit code and the elapsed time in
+milliseconds is written to the standard output. A job with too many arguments
+is not run; its line gives EXIT_FAILURE and a time of zero.
+
+Arguments:  none
+Returns:    the exit code for the server
+*/
+
+static int
+sdop_server(void)
+{
+uschar line[4096];
+
+server_mode = FALSE;
+if (!sdop_load_common()) return EXIT_FAILURE;
+
+DEBUG(D_any) debug_printf("Render server ready\n");
+
+while (sys_read_line(line, sizeof(line)))
+  {
+  int rc;
+  int jobargc = 1;
+  char *jobargv[64];
+  int maxargc = (int)(sizeof(jobargv)/sizeof(char *)) - 1;
+  double start;
+  uschar *p = line;
+
+  jobargv[0] = "sdop";
+  for (;;)
+    {
+    while (isspace(*p)) p++;
+    if (*p == 0) break;
+    if (jobargc >= maxargc) break;
+    jobargv[jobargc++] = CS p;
+    while (*p != 0 && !isspace(*p)) p++;
+    if (*p != 0) *p++ = 0;
+    }
+  jobargv[jobargc] = NULL;
+  if (jobargc == 1) continue;              /* Ignore blank lines */
+
+  if (*p != 0)
+    {
+    (void)fprintf(stderr, "sdop: a server job may not have more than %d "
+      "arguments\n", maxargc - 1);
+    (void)fprintf(stdout, "%d %.3f\n", EXIT_FAILURE, 0.0);
+    (void)fflush(stdout);
+    continue;
+    }
+
+  start = sys_wallclock();
+  rc = sys_run_job(server_job, jobargc, jobargv);
+  (void)fprintf(stdout, "%d %.3f\n", rc, (sys_wallclock() - start) * 1000.0);
+  (void)fflush(stdout);
+  }
+
+return EXIT_SUCCESS;
+}
+
+
+
+/*************************************************
+*          Entry point and main program          *
+*************************************************/
+
+/* Decode the command line, then either process a document or run as a render
+server. */
+
+int
+main(int argc, char **argv)
+{
+uschar *share = (uschar *)getenv("SDOP_SHARE");
+
+if (share != NULL)
+  {
+  sdop_share = misc_malloc(Ustrlen(share) + 1);
+  Ustrcpy(sdop_share, share);
+  }
+
+if (!sdop_decode_arg(argc, argv)) return EXIT_FAILURE;
+
+if (server_mode)
+  {
+  if (sdop_filename != NULL)
+    {
+    (void)fprintf(stderr, "sdop: no input file may be given with -server\n");
+    return EXIT_FAILURE;
+    }
+  return sdop_server();
   }
 
-return yield? EXIT_SUCCESS : EXIT_FAILURE;
+return render_document()? EXIT_SUCCESS : EXIT_FAILURE;
 }
+#endif  /* SDOP_LIBRARY */
 
 /* End of sdop.c */
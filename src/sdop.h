@@ -43,11 +43,18 @@ headers, but they might as well be together with those above. */
 
 #define MAXPARALINES       1024
 #define MAXTABLEROWS       1024
+#define MAXPAGEBOXES       4096
 
 #define MAXHEADFOOTPARA      32
 #define MAXSECTDEPTH         10
+#define MAXHYWORD           256
 
 #define MAXLISTNEST          10
+#define MAXWRITEWORKERS      64
+#define MAXIMAGECACHE  16000000
+
+#define FONTFILESIZE        256
+#define MAXFONTPATH         200
 
 #define DEFAULT_PAGE_COLSEP  16000
 
@@ -162,6 +169,11 @@ outputting details of head/foot/toc template files every time. */
 
 #define D_all         (0xffffffff & ~D_internal)
 
+/* Time a phase of processing for the -stats option. The value is that of the
+expression, which must be a BOOL. */
+
+#define PHASE(name,x)  (stats_begin(US name), stats_end(x))
+
 
 /* Flags in items */
 
@@ -176,6 +188,7 @@ outputting details of head/foot/toc template files every time. */
 #define IF_TABTITLE    0x00000100   /* This para is a table title */
 #define IF_RULEABOVE   0x00000200   /* This para has a rule above */
 #define IF_RULEBELOW   0x00000400   /* This para has a rule below */
+#define IF_OVERFLOW    0x00000800   /* A cell overflow was reported here */
 
 
 /* Flags in table structures */
@@ -225,6 +238,14 @@ for the percentage to go up/down for subscripts or superscripts. */
 #define OLF_HYPHENATED 0x00000001
 #define OLF_ADD_HYPHEN 0x00000002
 #define OLF_RULE       0x00000004
+#define OLF_OVERFLOW   0x00000008
+
+/* Looseness parameters for analyzing lines. The looseness of a line is the
+amount by which it is stretched, as a percentage of the width of its spaces. */
+
+#define L_BAD     95
+#define L_ACCEPT  60
+#define L_VGOOD   30
 
 
 /* List numerations */
@@ -303,6 +324,10 @@ enum { LP_FORMALPARA,   LP_PARA,         LP_BLOCKQUOTE,   LP_SIDEBAR,
     ) \
   )
 
+/* Macro for getting the text of a formatted line's textblock */
+
+#define TBTEXT(tb) (((tb)->slice != NULL)? (tb)->slice : (tb)->string)
+
 /* Macros for loading UTF-8 characters */
 
 /* Get the next UTF-8 character, not advancing the pointer. */
@@ -362,6 +387,15 @@ it is. */
 
 #define BACKCHAR(ptr) while((*ptr & 0xc0) == 0x80) ptr--;
 
+/* Test for a printing ASCII character other than hyphen, which is the kind of
+character that needs no special treatment when measuring text. */
+
+#define ASCII_PLAIN(c) ((c) > 0x20 && (c) < 0x7f && (c) != '-')
+
+/* The characters for which isspace() is true, for use with strspn(). */
+
+#define WHITESPACE " \t\n\v\f\r"
+
 /* UCD access macros - copied from PCRE */
 
 #define UCD_BLOCK_SIZE 128
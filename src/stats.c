@@ -0,0 +1,599 @@
+/*************************************************
+*          sdop - Simple DocBook Processor       *
+*************************************************/
+
+/* Copyright (c) Philip Hazel, 2009 */
+
+/* This module contains functions for the -stats option, which records the
+wall clock and CPU time taken by each phase of processing, and writes them,
+together with counts of events on hot paths, as JSON. The counters themselves
+are in the global "stats" structure, and are always maintained, as they are
+cheap. It also contains the function that writes the JSON layout report for
+the -n option. */
+
+#include "sdop.h"
+
+
+#define MAXPHASES      100      /* Different phase names */
+#define MAXPHASEDEPTH    8      /* Nesting of phases */
+#define PHASENAMESIZE   64
+#define WORSTPARAS      10      /* Loosest paragraphs in the layout report */
+
+
+typedef struct {
+  uschar name[PHASENAMESIZE];
+  int    calls;
+  double wall;
+  double cpu;
+} phasestr;
+
+static phasestr phases[MAXPHASES];
+static int      phase_count = 0;
+
+static struct {
+  int    phase;               /* Index in phases */
+  double wall;                /* Start times */
+  double cpu;
+} phase_stack[MAXPHASEDEPTH];
+
+static int      phase_depth = 0;
+
+/* Unresolved cross-references, for the layout report */
+
+typedef struct xrefstr {
+  struct xrefstr *next;
+  uschar *filename;
+  int     linenumber;
+  uschar  id[1];
+} xrefstr;
+
+static xrefstr *xref_list = NULL;
+static xrefstr **xref_last = &xref_list;
+
+/* Data for a top-level division (chapter, appendix, etc.) and for a paragraph
+in the layout report */
+
+typedef struct divstr {
+  struct divstr *next;
+  uschar *name;
+  uschar *number;
+  int     linenumber;
+  int     first_page;
+  int     last_page;
+  int     paragraphs;
+  int     lines;
+  int     loose_lines;
+  int     overfull_lines;
+  int     widowed_headings;
+} divstr;
+
+typedef struct {
+  uschar *filename;
+  int     linenumber;
+  int     page;
+  int     looseness;
+} parastr;
+
+
+
+/*************************************************
+*          Get the CPU time in seconds           *
+*************************************************/
+
+static double
+cpu_time(void)
+{
+return (double)clock()/CLOCKS_PER_SEC;
+}
+
+
+
+/*************************************************
+*              Start timing a phase              *
+*************************************************/
+
+/* A phase that starts while another is being timed is recorded under a name
+made from both names, for example "write_file/body". Each time a phase with
+the same (full) name is timed, its times are added to the previous ones.
+
+Argument:   the name of the phase
+Returns:    nothing
+*/
+
+void
+stats_begin(uschar *name)
+{
+int i;
+uschar fullname[2*PHASENAMESIZE];
+
+if (stats_filename == NULL && !layout_only) return;
+if (phase_depth >= MAXPHASEDEPTH) { phase_depth++; return; }
+
+if (phase_depth == 0) Ustrncpy(fullname, name, PHASENAMESIZE - 1);
+  else (void)sprintf(CS fullname, "%s/%s",
+    phases[phase_stack[phase_depth-1].phase].name, name);
+fullname[PHASENAMESIZE - 1] = 0;
+
+for (i = 0; i < phase_count; i++)
+  if (Ustrcmp(phases[i].name, fullname) == 0) break;
+
+if (i >= phase_count)
+  {
+  if (phase_count >= MAXPHASES) i = MAXPHASES - 1;  /* Lump the rest */
+  else
+    {
+    Ustrcpy(phases[i].name, fullname);
+    phases[i].calls = 0;
+    phases[i].wall = phases[i].cpu = 0.0;
+    phase_count++;
+    }
+  }
+
+phase_stack[phase_depth].phase = i;
+phase_stack[phase_depth].wall = sys_wallclock();
+phase_stack[phase_depth].cpu = cpu_time();
+phase_depth++;
+}
+
+
+
+/*************************************************
+*              Finish timing a phase             *
+*************************************************/
+
+/* This is called with the result of the phase, which it returns, so that it
+can be used in a chain of function calls (see the PHASE macro).
+
+Argument:   the result of the phase
+Returns:    the same
+*/
+
+BOOL
+stats_end(BOOL yield)
+{
+phasestr *ph;
+
+if ((stats_filename == NULL && !layout_only) || phase_depth <= 0) return yield;
+if (--phase_depth >= MAXPHASEDEPTH) return yield;
+
+ph = phases + phase_stack[phase_depth].phase;
+ph->calls++;
+ph->wall += sys_wallclock() - phase_stack[phase_depth].wall;
+ph->cpu += cpu_time() - phase_stack[phase_depth].cpu;
+return yield;
+}
+
+
+
+/*************************************************
+*          Write a JSON string value             *
+*************************************************/
+
+/*
+Arguments:
+  f          the output file
+  s          the string
+
+Returns:     nothing
+*/
+
+static void
+json_string(FILE *f, uschar *s)
+{
+(void)fputc('"', f);
+for (; *s != 0; s++)
+  {
+  if (*s == '"' || *s == '\\') (void)fprintf(f, "\\%c", *s);
+    else if (*s < 32) (void)fprintf(f, "\\u%04x", *s);
+    else (void)fputc(*s, f);
+  }
+(void)fputc('"', f);
+}
+
+
+
+/*************************************************
+*          Write the phase timings               *
+*************************************************/
+
+/*
+Argument:   the output file
+Returns:    nothing
+*/
+
+static void
+write_phases(FILE *f)
+{
+int i;
+(void)fprintf(f, "  \"phases\": [\n");
+for (i = 0; i < phase_count; i++)
+  {
+  (void)fprintf(f, "    { \"name\": ");
+  json_string(f, phases[i].name);
+  (void)fprintf(f, ", \"calls\": %d, \"wall_ms\": %.3f, \"cpu_ms\": %.3f }%s\n",
+    phases[i].calls, phases[i].wall * 1000.0, phases[i].cpu * 1000.0,
+    (i == phase_count - 1)? "" : ",");
+  }
+(void)fprintf(f, "  ]");
+}
+
+
+
+/*************************************************
+*            Write the statistics                *
+*************************************************/
+
+/* The statistics are written to the file named by the -stats option, or to
+the standard error if the name is "-".
+
+Arguments:
+  input      the input file name, or NULL for the standard input
+  yield      the overall result of processing
+
+Returns:     nothing
+*/
+
+void
+stats_write(uschar *input, BOOL yield)
+{
+FILE *f;
+
+if (stats_filename == NULL) return;
+
+if (Ustrcmp(stats_filename, "-") == 0) f = stderr; else
+  {
+  f = Ufopen(stats_filename, "wb");
+  if (f == NULL)
+    {
+    (void)fprintf(stderr, "sdop: failed to open %s for statistics: %s\n",
+      stats_filename, strerror(errno));
+    return;
+    }
+  }
+
+(void)fprintf(f, "{\n  \"version\": \"%s\",\n  \"input\": ", SDOP_VERSION);
+json_string(f, (input == NULL)? US"-" : input);
+(void)fprintf(f, ",\n  \"ok\": %s,\n", yield? "true" : "false");
+(void)fprintf(f, "  \"body_pages\": %d,\n", main_page_count);
+(void)fprintf(f, "  \"memory_hwm\": %d,\n", memory_hwm);
+
+write_phases(f);
+(void)fprintf(f, ",\n  \"counters\": {\n");
+(void)fprintf(f, "    \"font_charwidth_calls\": %ld,\n", stats.charwidth_calls);
+(void)fprintf(f, "    \"font_charwidth_slow\": %ld,\n", stats.charwidth_slow);
+(void)fprintf(f, "    \"font_kernwidth_calls\": %ld,\n", stats.kernwidth_calls);
+(void)fprintf(f, "    \"hyphen_dictionary_reads\": %ld,\n", stats.hyphen_reads);
+(void)fprintf(f, "    \"hash_search_calls\": %ld,\n", stats.hash_searches);
+(void)fprintf(f, "    \"hash_code_search_calls\": %ld,\n",
+  stats.hash_code_searches);
+(void)fprintf(f, "    \"misc_malloc_calls\": %ld,\n", stats.malloc_calls);
+(void)fprintf(f, "    \"misc_malloc_bytes\": %ld,\n", stats.malloc_bytes);
+(void)fprintf(f, "    \"para_polish_moves\": %ld,\n", stats.polish_moves);
+(void)fprintf(f, "    \"page_format_backtracks\": %ld,\n",
+  stats.page_backtracks);
+(void)fprintf(f, "    \"page_lookahead_boxes\": %ld,\n",
+  stats.page_lookahead_boxes);
+(void)fprintf(f, "    \"images_decoded\": %ld,\n", stats.images_decoded);
+(void)fprintf(f, "    \"images_read\": %ld,\n", stats.images_read);
+(void)fprintf(f, "    \"images_reused\": %ld,\n", stats.images_reused);
+(void)fprintf(f, "    \"image_bytes_saved\": %ld,\n", stats.image_bytes_saved);
+(void)fprintf(f, "    \"fonts_embedded\": %ld,\n", stats.fonts_embedded);
+(void)fprintf(f, "    \"fonts_cached\": %ld\n", stats.fonts_cached);
+(void)fprintf(f, "  }\n}\n");
+
+if (f != stderr) (void)fclose(f);
+}
+
+
+/*************************************************
+*       Note an unresolved cross-reference       *
+*************************************************/
+
+/* This is called from ref_resolve() as well as giving an error, because the
+error messages stop after a while, and the report should list all of them.
+
+Argument:   the id that was not found
+Returns:    nothing
+*/
+
+void
+stats_unresolved_xref(uschar *id)
+{
+xrefstr *x = misc_malloc(sizeof(xrefstr) + Ustrlen(id));
+x->next = NULL;
+x->filename = read_filename;
+x->linenumber = read_linenumber;
+Ustrcpy(x->id, id);
+*xref_last = x;
+xref_last = &(x->next);
+}
+
+
+
+/*************************************************
+*       Write a JSON file name and line          *
+*************************************************/
+
+static void
+json_where(FILE *f, uschar *filename, int linenumber)
+{
+(void)fprintf(f, "\"file\": ");
+json_string(f, (filename == NULL)? US"-" : filename);
+(void)fprintf(f, ", \"line\": %d", linenumber);
+}
+
+
+
+/*************************************************
+*          Write the layout report               *
+*************************************************/
+
+/* This is called instead of write_file() in layout-only mode (-n), after the
+pagination of the body, index, title, and TOC is complete. The main item list
+is scanned, counting pages and gathering line metrics for each top-level
+division and for the document as a whole. The looseness of a line that is
+stretched for justification is its stretch as a percentage of the width of its
+spaces (see para.c); a line that is at least L_BAD is counted as loose, and
+each paragraph is classified by its loosest line. A heading that is the last
+thing on a page is reported as widowed. The report is written as JSON.
+
+Arguments:
+  input      the input file name, or NULL for the standard input
+  filename   the output file name, NULL or "-" for the standard output
+  start      the wall clock time at the start of processing
+
+Returns:     TRUE if the file was written
+*/
+
+BOOL
+stats_layout_report(uschar *input, uschar *filename, double start)
+{
+int i, page = 0;
+int paragraphs = 0, lines = 0, justified = 0, loose = 0, overfull = 0;
+int classes[4] = { 0, 0, 0, 0 };
+int worst_count = 0;
+parastr worst[WORSTPARAS];
+divstr *divisions = NULL;
+divstr **divlast = &divisions;
+divstr *div = NULL;
+divstr *d;
+item *ip;
+item *title_end = NULL;
+item *footnote_end = NULL;
+item *last_title = NULL;
+uschar *title_filename = NULL;
+uschar *fname = input;
+xrefstr *x;
+FILE *f;
+BOOL first;
+
+if (filename == NULL || Ustrcmp(filename, "-") == 0) f = stdout; else
+  {
+  f = Ufopen(filename, "wb");
+  if (f == NULL)
+    return error(0, filename, "layout report", strerror(errno));  /* Hard */
+  }
+
+(void)fprintf(f, "{\n  \"version\": \"%s\",\n  \"input\": ", SDOP_VERSION);
+json_string(f, (input == NULL)? US"-" : input);
+(void)fprintf(f, ",\n  \"pages\": { \"title\": %d, \"toc\": %d, "
+  "\"preface\": %d, \"body\": %d },\n", title_page_count, toc_page_count,
+  preface_page_count, main_page_count);
+
+/* Scan the body, listing widowed headings as they are found. */
+
+(void)fprintf(f, "  \"widowed_headings\": [");
+first = TRUE;
+
+for (ip = main_item_list; ip != NULL; ip = ip->next)
+  {
+  uschar *name = ip->name;
+
+  if (Ustrcmp(name, "#FILENAME") == 0)
+    {
+    fname = ip->p.string;
+    continue;
+    }
+
+  /* At the start of a new page, check whether the previous one ended with a
+  heading. */
+
+  if (Ustrcmp(name, "#PDATA") == 0)
+    {
+    if (last_title != NULL)
+      {
+      (void)fprintf(f, "%s\n    { ", first? "" : ",");
+      json_where(f, title_filename, last_title->linenumber);
+      (void)fprintf(f, ", \"page\": %d }", page);
+      if (div != NULL) div->widowed_headings++;
+      first = FALSE;
+      last_title = NULL;
+      }
+    page++;
+    continue;
+    }
+
+  if (ip == title_end) title_end = NULL;
+  if (ip == footnote_end) footnote_end = NULL;
+
+  if (Ustrcmp(name, "title") == 0 || Ustrcmp(name, "subtitle") == 0)
+    {
+    if (ip->partner != ip) title_end = ip->partner;
+    }
+
+  else if (Ustrcmp(name, "footnote") == 0)
+    {
+    if (ip->partner != ip) footnote_end = ip->partner;
+    }
+
+  else if (Ustrcmp(name, "chapter") == 0 ||
+           Ustrcmp(name, "appendix") == 0 ||
+           Ustrcmp(name, "preface") == 0 ||
+           Ustrcmp(name, "index") == 0 ||
+           Ustrcmp(name, "glossary") == 0 ||
+           Ustrcmp(name, "bibliography") == 0 ||
+           Ustrcmp(name, "colophon") == 0)
+    {
+    paramstr *p = misc_param_find(ip, US"#number");
+    div = misc_malloc(sizeof(divstr));
+    memset(div, 0, sizeof(divstr));
+    div->name = name;
+    div->number = (p == NULL)? NULL : p->value;
+    div->linenumber = ip->linenumber;
+    div->first_page = div->last_page = page;
+    *divlast = div;
+    divlast = &(div->next);
+    }
+
+  /* A cell overflow into the next column is noted on the end of the entry */
+
+  else if ((ip->flags & IF_OVERFLOW) != 0)
+    {
+    overfull++;
+    if (div != NULL) div->overfull_lines++;
+    }
+
+  else if (Ustrcmp(name, "mediaobject") == 0 ||
+           Ustrcmp(name, "inlinemediaobject") == 0)
+    {
+    if (footnote_end == NULL) last_title = NULL;
+    if (div != NULL) div->last_page = page;
+    }
+
+  else if (Ustrcmp(name, "#PCPARA") == 0)
+    {
+    outputline *ol;
+    int worst_looseness = -1;
+    int paralines = 0, paraloose = 0, paraoverfull = 0;
+
+    for (ol = ip->p.prgrph->out; ol != NULL; ol = ol->next)
+      {
+      paralines++;
+      if ((ol->flags & OLF_OVERFLOW) != 0) paraoverfull++;
+
+      /* This is the test that write_file() uses for stretching a line. */
+
+      if (ol->stretch > 0 && ol->scount > 0 && ol->swidth > 0 &&
+          ((ol->next != NULL && (ol->next->flags & OLF_RULE) == 0) ||
+           ol->stretch <= 6000 || (ip->flags & IF_PARACONTA) != 0))
+        {
+        int looseness = (ol->stretch * 100)/ol->swidth;
+        justified++;
+        if (looseness >= L_BAD) paraloose++;
+        if (looseness > worst_looseness) worst_looseness = looseness;
+        }
+      }
+
+    /* The second part of a paragraph that is split over pages is not a new
+    paragraph. */
+
+    if ((ip->flags & IF_PARACONTB) == 0) paragraphs++;
+    lines += paralines;
+    loose += paraloose;
+    overfull += paraoverfull;
+
+    if (div != NULL)
+      {
+      if ((ip->flags & IF_PARACONTB) == 0) div->paragraphs++;
+      div->lines += paralines;
+      div->loose_lines += paraloose;
+      div->overfull_lines += paraoverfull;
+      div->last_page = page;
+      }
+
+    /* Classify the paragraph by its loosest line, and keep a list of the
+    loosest paragraphs, in order. */
+
+    if (worst_looseness >= 0)
+      {
+      classes[(worst_looseness < L_VGOOD)? 0 :
+              (worst_looseness < L_ACCEPT)? 1 :
+              (worst_looseness < L_BAD)? 2 : 3]++;
+
+      if (worst_count < WORSTPARAS ||
+          worst_looseness > worst[WORSTPARAS-1].looseness)
+        {
+        int k = (worst_count < WORSTPARAS)? worst_count++ : WORSTPARAS - 1;
+        for (; k > 0 && worst[k-1].looseness < worst_looseness; k--)
+          worst[k] = worst[k-1];
+        worst[k].filename = fname;
+        worst[k].linenumber = ip->linenumber;
+        worst[k].page = page;
+        worst[k].looseness = worst_looseness;
+        }
+      }
+
+    /* Remember a heading that could end a page; anything else on the page
+    after it (other than a footnote) cancels it. */
+
+    if (title_end != NULL)
+      {
+      last_title = ip;
+      title_filename = fname;
+      }
+    else if (footnote_end == NULL) last_title = NULL;
+    }
+  }
+
+(void)fprintf(f, "%s],\n", first? "" : "\n  ");
+
+/* The divisions */
+
+(void)fprintf(f, "  \"divisions\": [");
+for (d = divisions; d != NULL; d = d->next)
+  {
+  (void)fprintf(f, "%s\n    { \"element\": \"%s\", \"number\": ",
+    (d == divisions)? "" : ",", d->name);
+  if (d->number == NULL) (void)fprintf(f, "null");
+    else json_string(f, d->number);
+  (void)fprintf(f, ", \"line\": %d, \"first_page\": %d, \"pages\": %d,\n"
+    "      \"paragraphs\": %d, \"lines\": %d, \"loose_lines\": %d, "
+    "\"overfull_lines\": %d, \"widowed_headings\": %d }", d->linenumber,
+    d->first_page, d->last_page - d->first_page + 1, d->paragraphs, d->lines,
+    d->loose_lines, d->overfull_lines, d->widowed_headings);
+  }
+(void)fprintf(f, "%s],\n", (divisions == NULL)? "" : "\n  ");
+
+/* The paragraph summary */
+
+(void)fprintf(f, "  \"paragraphs\": {\n    \"count\": %d, \"lines\": %d, "
+  "\"justified_lines\": %d, \"loose_lines\": %d, \"overfull_lines\": %d,\n",
+  paragraphs, lines, justified, loose, overfull);
+(void)fprintf(f, "    \"by_loosest_line\": { \"very_good\": %d, \"good\": %d, "
+  "\"acceptable\": %d, \"loose\": %d },\n", classes[0], classes[1],
+  classes[2], classes[3]);
+(void)fprintf(f, "    \"loosest\": [");
+for (i = 0; i < worst_count; i++)
+  {
+  (void)fprintf(f, "%s\n      { ", (i == 0)? "" : ",");
+  json_where(f, worst[i].filename, worst[i].linenumber);
+  (void)fprintf(f, ", \"page\": %d, \"looseness\": %d }", worst[i].page,
+    worst[i].looseness);
+  }
+(void)fprintf(f, "%s]\n  },\n", (worst_count == 0)? "" : "\n    ");
+
+/* Unresolved cross-references */
+
+(void)fprintf(f, "  \"unresolved_xrefs\": [");
+for (x = xref_list; x != NULL; x = x->next)
+  {
+  (void)fprintf(f, "%s\n    { \"id\": ", (x == xref_list)? "" : ",");
+  json_string(f, x->id);
+  (void)fprintf(f, ", ");
+  json_where(f, x->filename, x->linenumber);
+  (void)fprintf(f, " }");
+  }
+(void)fprintf(f, "%s],\n", (xref_list == NULL)? "" : "\n  ");
+
+/* Timing */
+
+(void)fprintf(f, "  \"time_ms\": %.3f,\n", (sys_wallclock() - start) * 1000.0);
+write_phases(f);
+(void)fprintf(f, "\n}\n");
+
+if (f != stdout) (void)fclose(f);
+  else (void)fflush(f);
+return TRUE;
+}
+
+/* End of stats.c */
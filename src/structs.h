@@ -30,6 +30,36 @@ typedef struct tree_node {
   uschar  name[1];             /* node name - variable length */
 } tree_node;
 
+/* Open-addressing hash table of named nodes. The nodes are the same as those
+used in trees; each node's name is held once, in the node, and the slot keeps
+the full hash value so that most mismatches are rejected without a string
+comparison. */
+
+typedef struct hash_slot {
+  unsigned int hash;           /* full hash value of the name */
+  tree_node *node;             /* the node, or NULL if slot is unused */
+} hash_slot;
+
+typedef struct hash_table {
+  hash_slot *slots;            /* vector of slots */
+  int size;                    /* number of slots (a power of 2) */
+  int count;                   /* number of nodes in the table */
+} hash_table;
+
+/* Open-addressing hash table keyed by an integer code point. The data is held
+directly in the slots. */
+
+typedef struct code_node {
+  int code;                    /* code point, or -1 if slot is unused */
+  int val[2];                  /* integer data (2 values) */
+} code_node;
+
+typedef struct code_table {
+  code_node *slots;            /* vector of slots */
+  int size;                    /* number of slots (a power of 2) */
+  int count;                   /* number of codes in the table */
+} code_table;
+
 /* Items in a kerning table */
 
 typedef struct kerntablestr {
@@ -58,10 +88,13 @@ typedef struct u2sencod {
 typedef struct afontstr {
   struct afontstr *next;
   int *widths;                 /* width table for low-valued characters */
-  tree_node *widths_tree;      /* tree for other characters */
+  code_table *widths_table;    /* hash table for other characters */
   kerntablestr *kerns;         /* kern table */
   int kerncount;               /* size of same */
+  short int *asciikerns;       /* dense kern table for ASCII pairs, or NULL */
+  int asciiwidth;              /* common printing ASCII width, if fixed pitch */
   int psnumber;                /* PostScript base font number */
+  unsigned int glyphs[16];     /* bit map of codes printed, in both halves */
   BOOL stdencoding;            /* Set from the AFM file */
   BOOL fixedpitch;             /* Set from the AFM file */
   BOOL hasfi;                  /* Set from the AFM file */
@@ -96,10 +129,25 @@ typedef struct fontelstr {
   int *fs;
 } fontelstr;
 
+/* A setting in a <?sdop?> processing instruction. When the instruction is read,
+each attribute that names a known parameter is looked up and its value is
+decoded, if possible. The settings for an item are chained in the order of the
+parameter tables, and the chain hangs off the item's first parameter. */
+
+typedef struct pisetting {
+  struct pisetting *next;
+  struct paramstr *param;      /* the attribute */
+  short int list;              /* which parameter table */
+  short int index;             /* entry in that table */
+  BOOL decoded;                /* TRUE if value[] is valid */
+  int value[4];                /* the decoded value */
+} pisetting;
+
 /* This is the structure for parameters that hang off items that are elements */
 
 typedef struct paramstr {
   struct paramstr *next;
+  pisetting *settings;         /* see above; NULL if none */
   uschar name[DBPARAMNAMESIZE];
   uschar seen;
   uschar value[1];
@@ -109,12 +157,18 @@ typedef struct paramstr {
 used for raw input data (hanging off a #PCDATA item), and for formatted lines
 (hanging off an outputline structure). Input data is in single textblocks. The
 chain facility is used to chain the input blocks of a paragraph together, and
-also for chaining the textblocks that make up a formatted output line. */
+also for chaining the textblocks that make up a formatted output line. The text
+of a formatted line is not usually copied: its slice field points to the text
+within an input block, which is not zero-terminated at the end of the slice,
+and which may contain newlines that are to be printed as spaces. Otherwise,
+slice is NULL and the text is in the textblock. The slice field is set only in
+formatted lines; TBTEXT() gets the text of either kind. */
 
 typedef struct textblock {
   struct textblock *next;      /* Chain for paragraphs and formatted lines */
   struct textblock *lastin;    /* Last input textblock in an output one */
   vfontstr *vfont;             /* Point to virtual font */
+  uschar *slice;               /* Output text that is in an input block */
   unsigned int pin_flags;      /* Processing instruction flags */
   int colour;                  /* Three 10-bit fields (values 0-1000) */
   int length;                  /* Length of string */
@@ -169,6 +223,9 @@ typedef struct paragraph {
   int justify;                 /* Overriding justify */
   int charval;                 /* Character for "char" justification */
   int charoff;                 /* Percentage offset for "char" justification */
+  int *depths;                 /* Cumulative line depths, for pagination */
+  int lines;                   /* Number of lines in depths */
+  int fnline;                  /* First line with footnotes, or -1 */
 } paragraph;
 
 /* The structure for holding information about a column in a table */
@@ -324,6 +381,49 @@ typedef struct colourstr {
   int B;
 } colourstr;
 
+/* Data for an image file. The size is found when the file is first used, so
+that it is read only once however often the size is needed. The output text
+for an image that is used more than once is also kept, up to a limit on the
+total. */
+
+typedef struct imagecache {
+  uschar *filename;           /* the file's path */
+  int     refs;               /* number of <imagedata> items that use it */
+  BOOL    known;              /* TRUE when the size has been found */
+  BOOL    bbset;              /* TRUE if there is a bounding box */
+  double  bb[4];              /* bounding box, unscaled */
+  int     width;              /* pixel width */
+  int     depth;              /* pixel depth */
+  int     ncomp;              /* components per pixel */
+  int     rowbytes;           /* bytes in a row of pixels */
+  uschar *data;               /* output text, or NULL */
+  int     datalength;         /* length of output text */
+  int     datawidth;          /* pixel width of output text */
+  int     datadepth;          /* pixel depth of output text */
+} imagecache;
+
+/* Counters of events on hot paths, for the -stats option */
+
+typedef struct {
+  long charwidth_calls;       /* font_charwidth() */
+  long charwidth_slow;        /* ... not found in the low-character table */
+  long kernwidth_calls;       /* font_kernwidth() */
+  long hyphen_reads;          /* lines read from the hyphenation dictionary */
+  long hash_searches;         /* hash_search() (ids, entities, etc.) */
+  long hash_code_searches;    /* hash_code_search() (character widths) */
+  long malloc_calls;          /* misc_malloc() */
+  long malloc_bytes;
+  long polish_moves;          /* words moved by para_polish() */
+  long page_backtracks;       /* backtracks after <title> or <term> */
+  long page_lookahead_boxes;  /* boxes modelled for optimal page breaks */
+  long images_decoded;        /* JPEG or PNG images decoded for output */
+  long images_read;           /* image files read to find their size */
+  long images_reused;         /* images output from kept text */
+  long image_bytes_saved;     /* output bytes saved by reducing images */
+  long fonts_embedded;        /* font subsets embedded in the output */
+  long fonts_cached;          /* ... of which were found in the cache */
+} statsstr;
+
 /* Unicode character database (UCD) */
 
 typedef struct {
@@ -10,7 +10,13 @@ the only supported system is Unix. */
 #include "sdop.h"
 
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <unistd.h>
 
 
@@ -25,4 +31,408 @@ struct stat statbuf;
 return stat(CCS name, &statbuf) == 0;
 }
 
+
+
+
+/*************************************************
+*        Find the size and time of a file        *
+*************************************************/
+
+/* This is used to identify a font program when caching subsets of it.
+
+Arguments:
+  name       the file name
+  size       where to put the size
+  mtime      where to put the modification time
+
+Returns:     TRUE if the file exists
+*/
+
+BOOL
+sys_filestamp(uschar *name, long *size, long *mtime)
+{
+struct stat statbuf;
+if (stat(CCS name, &statbuf) != 0) return FALSE;
+*size = (long)statbuf.st_size;
+*mtime = (long)statbuf.st_mtime;
+return TRUE;
+}
+
+
+
+/*************************************************
+*             Get the process id                 *
+*************************************************/
+
+/* This is used to make unique names for temporary files.
+
+Arguments:   none
+Returns:     the process id
+*/
+
+int
+sys_pid(void)
+{
+return (int)getpid();
+}
+
+
+
+/*************************************************
+*       Start reading a file in the background   *
+*************************************************/
+
+/* This is called for image files soon after the input has been read, so that
+the system can be reading them while the text is being formatted. Nothing is
+done if the file cannot be opened; any error is reported when it is used.
+
+Argument:  the file name
+Returns:   nothing
+*/
+
+void
+sys_prefetch(uschar *name)
+{
+int fd = open(CCS name, O_RDONLY);
+if (fd < 0) return;
+#ifdef POSIX_FADV_WILLNEED
+(void)posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+(void)close(fd);
+}
+
+
+
+
+/*************************************************
+*          Read a line from the standard input   *
+*************************************************/
+
+/* The render server reads its jobs with this function rather than via stdio,
+because a job runs in a child process, and when the child exits, the C library
+may adjust the file position of buffered input streams that it shares with the
+parent. A line that is too long is truncated.
+
+Arguments:
+  buffer     where to put the line, without its terminating newline
+  size       size of the buffer
+
+Returns:     TRUE if a line was read, FALSE at end of file
+*/
+
+BOOL
+sys_read_line(uschar *buffer, int size)
+{
+int n = 0;
+BOOL any = FALSE;
+
+for (;;)
+  {
+  uschar c;
+  int rc = read(0, &c, 1);
+  if (rc < 0 && errno == EINTR) continue;
+  if (rc <= 0) break;
+  any = TRUE;
+  if (c == '\n') break;
+  if (n < size - 1) buffer[n++] = c;
+  }
+
+buffer[n] = 0;
+return any;
+}
+
+
+
+/*************************************************
+*           Run a job in a child process         *
+*************************************************/
+
+/* The render server runs each job in a forked copy of itself, so that the
+job starts with the data that was loaded when the server started up, and with
+all the global variables at their initial values. Anything that the job
+changes is thrown away when it finishes.
+
+Arguments:
+  fn         the function that runs the job
+  argc       argument count for the job
+  argv       argument vector for the job
+
+Returns:     the exit status of the job, or -1 if it could not be run or
+               did not exit normally
+*/
+
+int
+sys_run_job(int (*fn)(int, char **), int argc, char **argv)
+{
+int status;
+pid_t pid;
+
+(void)fflush(stdout);
+(void)fflush(stderr);
+
+pid = fork();
+if (pid < 0) return -1;
+
+if (pid == 0)
+  {
+  int rc = fn(argc, argv);
+  (void)fflush(stdout);
+  (void)fflush(stderr);
+  _exit(rc);
+  }
+
+while (waitpid(pid, &status, 0) < 0)
+  if (errno != EINTR) return -1;
+
+return WIFEXITED(status)? WEXITSTATUS(status) : -1;
+}
+
+
+
+/*************************************************
+*              Get the wall clock time           *
+*************************************************/
+
+/*
+Arguments:   none
+Returns:     the time in seconds, as a double
+*/
+
+double
+sys_wallclock(void)
+{
+struct timeval tv;
+(void)gettimeofday(&tv, NULL);
+return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+
+/*************************************************
+*      Run a job with piped input and output     *
+*************************************************/
+
+/* This is used by the library interface. As for sys_run_job(), the job runs
+in a forked copy of the calling process, but its standard input and output are
+connected to a socket. The given data is written to the job's input, and
+whatever it writes is passed to the sink function as it arrives. A socket is
+used instead of pipes so that the MSG_NOSIGNAL flag can stop a job that exits
+before reading all its input from raising SIGPIPE in the caller.
+
+The caller's streams are not flushed, because it may be using them in other
+threads. Instead, the job throws away anything buffered for the standard
+output, and at the end flushes only the standard output and error. It closes
+all the other descriptors it inherits, so that it does not hold open the
+sockets of other jobs that are running at the same time, and cannot write what
+is buffered for the caller's other files. A job that is abandoned is killed,
+so that the caller does not wait for it to finish.
+
+Arguments:
+  fn         the function that runs the job
+  argc       argument count for the job
+  argv       argument vector for the job
+  in         the input data
+  inlen      the length of the input data
+  sink       function to call with output data; it returns non-zero to abandon
+               the job
+  sinkdata   opaque data for the sink
+
+Returns:     the exit status of the job, or -1 if it could not be run, did not
+               exit normally, or was abandoned
+*/
+
+int
+sys_run_filter(int (*fn)(int, char **), int argc, char **argv,
+  const char *in, size_t inlen, int (*sink)(void *, const char *, size_t),
+  void *sinkdata)
+{
+int status;
+int fds[2];
+BOOL abandoned = FALSE;
+pid_t pid;
+
+if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) return -1;
+
+pid = fork();
+if (pid < 0)
+  {
+  (void)close(fds[0]);
+  (void)close(fds[1]);
+  return -1;
+  }
+
+if (pid == 0)
+  {
+  int fd, rc;
+  long maxfd = sysconf(_SC_OPEN_MAX);
+  fd = open("/dev/null", O_WRONLY);
+  if (fd < 0 || dup2(fd, 1) < 0) _exit(EXIT_FAILURE);
+  (void)fflush(stdout);
+  if (dup2(fds[1], 0) < 0 || dup2(fds[1], 1) < 0) _exit(EXIT_FAILURE);
+  if (maxfd < 0) maxfd = 1024;
+  for (fd = 3; fd < maxfd; fd++) (void)close(fd);
+  rc = fn(argc, argv);
+  (void)fflush(stdout);
+  (void)fflush(stderr);
+  _exit(rc);
+  }
+
+(void)close(fds[1]);
+if (inlen == 0) (void)shutdown(fds[0], SHUT_WR);
+
+/* Write the input and read the output until the job closes its end. */
+
+for (;;)
+  {
+  int n;
+  char buffer[8192];
+  struct pollfd pfd;
+
+  pfd.fd = fds[0];
+  pfd.events = (inlen > 0)? POLLIN|POLLOUT : POLLIN;
+  if (poll(&pfd, 1, -1) < 0)
+    {
+    if (errno == EINTR) continue;
+    break;
+    }
+
+  if ((pfd.revents & POLLOUT) != 0)
+    {
+    n = send(fds[0], in, (inlen > sizeof(buffer))? sizeof(buffer) : inlen,
+      MSG_NOSIGNAL);
+    if (n < 0)
+      {
+      if (errno != EINTR && errno != EAGAIN) inlen = 0;
+      }
+    else
+      {
+      in += n;
+      inlen -= n;
+      }
+    if (inlen == 0) (void)shutdown(fds[0], SHUT_WR);
+    }
+
+  if ((pfd.revents & (POLLIN|POLLHUP|POLLERR)) != 0)
+    {
+    n = read(fds[0], buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    if (sink(sinkdata, buffer, n) != 0)
+      {
+      abandoned = TRUE;
+      break;
+      }
+    }
+  }
+
+(void)close(fds[0]);
+if (abandoned) (void)kill(pid, SIGKILL);
+while (waitpid(pid, &status, 0) < 0)
+  if (errno != EINTR) return -1;
+
+if (abandoned) return -1;
+return WIFEXITED(status)? WEXITSTATUS(status) : -1;
+}
+
+
+
+/*************************************************
+*         Start a parallel writing worker        *
+*************************************************/
+
+/* The parallel page writer in write.c forks a worker for each range of pages.
+Output streams are flushed first, so that nothing buffered is written twice.
+The worker's standard error is redirected to the given file, so that its
+messages can be copied to the real standard error in page order. A pipe is set
+up for the worker to say that it has finished successfully.
+
+Arguments:
+  err        file for the worker's standard error
+  fdptr      where to return the worker's end of the pipe (in the worker) or
+               the parent's end (in the parent)
+
+Returns:     0 in the worker, the worker's process id in the parent, or -1 if
+               the worker could not be started
+*/
+
+int
+sys_worker_start(FILE *err, int *fdptr)
+{
+int fds[2];
+pid_t pid;
+
+if (pipe(fds) < 0) return -1;
+(void)fflush(NULL);
+
+pid = fork();
+if (pid < 0)
+  {
+  (void)close(fds[0]);
+  (void)close(fds[1]);
+  return -1;
+  }
+
+if (pid == 0)
+  {
+  (void)close(fds[0]);
+  if (dup2(fileno(err), 2) < 0) _exit(EXIT_FAILURE);
+  *fdptr = fds[1];
+  return 0;
+  }
+
+(void)close(fds[1]);
+*fdptr = fds[0];
+return (int)pid;
+}
+
+
+
+/*************************************************
+*        Finish a parallel writing worker        *
+*************************************************/
+
+/* This is called in a worker when it has successfully finished. It does not
+return.
+
+Argument:   the worker's end of the pipe
+Returns:    nothing
+*/
+
+void
+sys_worker_finish(int fd)
+{
+(void)fflush(NULL);
+if (write(fd, "", 1) != 1) _exit(EXIT_FAILURE);
+_exit(EXIT_SUCCESS);
+}
+
+
+
+/*************************************************
+*       Wait for a parallel writing worker       *
+*************************************************/
+
+/*
+Arguments:
+  pid        the worker's process id
+  fd         the parent's end of the pipe
+
+Returns:     TRUE if the worker finished successfully
+*/
+
+BOOL
+sys_worker_wait(int pid, int fd)
+{
+int status, n;
+char c;
+
+do n = read(fd, &c, 1); while (n < 0 && errno == EINTR);
+(void)close(fd);
+
+while (waitpid((pid_t)pid, &status, 0) < 0)
+  if (errno != EINTR) return FALSE;
+
+return n == 1 && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
 /* End of sys.c */
@@ -430,12 +430,19 @@ if (rc && preface_item_list != NULL)
       {
       long int n;
       uschar *s, *t;
+      uschar buffer[32];
       textblock *tb = ol->txtblk;
+      textblock *ntb;
 
-      /* Check that that is just a single textblock, and get its string. */
+      /* Check that that is just a single textblock, and get its string. The
+      text of a formatted line may be a slice of an input block, so it is
+      copied in order to be terminated. */
 
-      if (tb == NULL || tb->next != NULL) continue;
-      s = tb->string;
+      if (tb == NULL || tb->next != NULL || tb->length >= (int)sizeof(buffer))
+        continue;
+      s = buffer;
+      memcpy(s, TBTEXT(tb), tb->length);
+      s[tb->length] = 0;
 
       /* If the string consists entirely of digits, assume we have reached a
       non-preface entry, and terminate the loop. Otherwise look for a string
@@ -447,13 +454,20 @@ if (rc && preface_item_list != NULL)
       n = Ustrtol(s, (char *)(&t), 10) - PREFACE_DUMMY_PAGE;
       if (*t != 0 || n <= 0 || n > 1000) continue;  /* Paranoia */
 
-      /* Replace the number with the correct roman numeral, adjust the string
-      length, and also the width and indent of the line. */
+      /* Replace the textblock with one that contains the correct roman
+      numeral, and adjust the width and indent of the line. */
 
       misc_roman(s, n + toc_page_count + title_page_count);
-      tb->length = Ustrlen(s);
+      ntb = misc_malloc(sizeof(textblock) + Ustrlen(s));
+      *ntb = *tb;
+      ntb->slice = NULL;
+      ntb->length = Ustrlen(s);
+      Ustrcpy(ntb->string, s);
+      ol->txtblk = ntb;
+      misc_free(tb, sizeof(textblock) +
+        ((tb->slice == NULL)? tb->length : 0));
       ol->indent += ol->width;
-      ol->width = font_stringwidth(s, tb->vfont);
+      ol->width = font_stringwidth(ntb->string, ntb->vfont);
       ol->indent -= ol->width;
       }
     }
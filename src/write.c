@@ -10,6 +10,7 @@
 #include "sdop.h"
 
 #define PLINETHRESH    60
+#define RUNBUFFERSIZE 256
 
 
 
@@ -21,15 +22,19 @@
 
 static int   ccount;         /* Count of PostScript chars in an output line */
 static FILE *outfile;        /* The output file */
+static int   runlength = 0;  /* Length of output waiting to be written */
+static uschar runbuffer[RUNBUFFERSIZE];
 static int   listcount;      /* For numbering/bulleting lists */
 static int   listnumeration;
 static int   liststackptr = 0;
 static int   liststack[MAXLISTNEST];
 static int   page_count;     /* The physical page count */
+static uschar page_id[32];   /* The identifier of the current page */
 static int   setcolour;
 static int   setfont;        /* The currently set font */
 static int   setlinewidth;   /* The currently set linewidth */
 static BOOL  suppress;       /* Used to suppress unwanted pages */
+static BOOL  tracking;       /* Suppressed, but keeping track of state */
 
 static int   ytoppage;       /* The y value for the top of the page */
 static int   ypos;           /* The current y position */
@@ -54,6 +59,33 @@ static uschar *sectionnumber;
 static lengthstring *chaptitblock;
 static lengthstring *secttitblock;
 
+/* When the output is being streamed, body pages are written to a spool file
+as soon as they are paginated. The offsets of their %%Page lines are kept so
+that the page ordinals can be corrected when the spool is copied after the
+front matter. */
+
+static FILE  *spool_file = NULL;
+static long  *spool_offsets = NULL;
+static int    spool_offsets_size = 0;
+static int    spool_pages = 0;
+
+static item  *stream_next;      /* The next body page to be written */
+static int    stream_pagenumber;
+static int    stream_columns;   /* Column settings while writing the body */
+static int    stream_colsep;
+static uschar *stream_filename; /* Input file name while writing the body */
+static uschar stream_arabic[12];
+static uschar stream_roman[12];
+
+/* TRUE when fonts are being embedded, which means that the pages are written
+before the setup. */
+
+static BOOL   embed_fonts = FALSE;
+
+/* The PostScript header, once it has been read */
+
+static uschar *psheader = NULL;
+
 
 /* Table for head/foot entity substitutions */
 
@@ -82,11 +114,36 @@ static int hfent_list_count = sizeof(hfent_list)/sizeof(hfent);
 
 
 
+/*************************************************
+*          Write buffered output                 *
+*************************************************/
+
+/* Output that needs no formatting is saved up in a buffer by cprintf() and
+cputcode(), and written when the buffer fills, or before any output that does
+need formatting.
+
+Arguments:   none
+Returns:     nothing
+*/
+
+static void
+flush_run(void)
+{
+(void)fwrite(runbuffer, 1, runlength, outfile);
+runlength = 0;
+}
+
+
+
 /*************************************************
 *          Checked print function                *
 *************************************************/
 
-/* Prints to outfile if output is not suppressed.
+/* Prints to outfile if output is not suppressed. Much of the output consists
+of fixed strings such as "(" and ")S"; a format without any insertions is
+added to the buffer instead of being formatted. Whatever is in the buffer is
+written before anything that is formatted, and flush_run() is called before
+the output file is changed, positioned, or written directly.
 
 Arguments:
   format       the format
@@ -101,6 +158,20 @@ cprintf(const char *format, ...)
 int yield;
 va_list ap;
 if (suppress) return 0;
+
+if (strchr(format, '%') == NULL)
+  {
+  yield = strlen(format);
+  if (yield <= RUNBUFFERSIZE)
+    {
+    if (runlength + yield > RUNBUFFERSIZE) flush_run();
+    memcpy(runbuffer + runlength, format, yield);
+    runlength += yield;
+    return yield;
+    }
+  }
+
+if (runlength > 0) flush_run();
 va_start(ap, format);
 yield = vfprintf(outfile, format, ap);
 va_end(ap);
@@ -109,6 +180,46 @@ return yield;
 
 
 
+/*************************************************
+*        Output a character within a string      *
+*************************************************/
+
+/* The characters of PostScript strings are the bulk of the output, so rather
+than formatting each one with cprintf(), they are encoded directly into the
+output buffer. Parentheses and backslashes are escaped, and non-printing codes
+are output in octal.
+
+Argument:   the code within the current font
+Returns:    number of characters output
+*/
+
+static int
+cputcode(int code)
+{
+uschar *p;
+if (suppress) return 0;
+if (runlength > RUNBUFFERSIZE - 4) flush_run();
+p = runbuffer + runlength;
+if (code == '(' || code == ')' || code == '\\')
+  {
+  *p++ = '\\';
+  *p++ = code;
+  }
+else if (code >= 32 && code <= 126) *p++ = code;
+else
+  {
+  *p++ = '\\';
+  *p++ = '0' + ((code >> 6) & 7);
+  *p++ = '0' + ((code >> 3) & 7);
+  *p++ = '0' + (code & 7);
+  }
+code = p - (runbuffer + runlength);
+runlength += code;
+return code;
+}
+
+
+
 /*************************************************
 *          Check if page is to be output         *
 *************************************************/
@@ -175,15 +286,40 @@ static void
 check_colour(int c)
 {
 if (c == setcolour) return;
-ccount += fprintf(outfile, " %s ", misc_formatfixed(c >> 20));
-ccount += fprintf(outfile, "%s ", misc_formatfixed((c >> 10) & 0x3ff));
-ccount += fprintf(outfile, "%s setrgbcolor", misc_formatfixed(c & 0x3ff));
+ccount += cprintf(" %s ", misc_formatfixed(c >> 20));
+ccount += cprintf("%s ", misc_formatfixed((c >> 10) & 0x3ff));
+ccount += cprintf("%s setrgbcolor", misc_formatfixed(c & 0x3ff));
 setcolour = c;
 }
 
 
 
 
+/*************************************************
+*         Note a code printed in a font          *
+*************************************************/
+
+/* The codes that are printed in each actual font are remembered, so that a
+subset of the font containing just those glyphs can be embedded. Nothing is
+noted while output is suppressed.
+
+Arguments:
+  af        the actual font
+  half      0 for the lower encoding, 1 for the upper
+  code      the code within the encoding
+
+Returns:    nothing
+*/
+
+static void
+note_code(afontstr *af, int half, int code)
+{
+int n = half*256 + code;
+if (!suppress) af->glyphs[n >> 5] |= 1u << (n & 31);
+}
+
+
+
 /*************************************************
 *         Ensure a font is current               *
 *************************************************/
@@ -233,19 +369,17 @@ or to a character in one of the special fonts. */
 
 else
   {
-  uschar utf[8];
-  tree_node *t;
+  code_node *cn;
 
-  /* Search for the character in the widths tree for this font. If we find it,
-  we should also find the offset for the printing code point. */
+  /* Search for the character in the widths table for this font. If we find
+  it, we should also find the offset for the printing code point. */
 
-  utf[misc_ord2utf8(c, utf)] = 0;
-  t = tree_search(vf->afont->widths_tree, utf);
+  cn = hash_code_search(vf->afont->widths_table, c);
 
-  if (t != NULL)
+  if (cn != NULL)
     {
     fr = 1;
-    code = LOWCHARLIMIT + t->data.val[1] - 256;
+    code = LOWCHARLIMIT + cn->val[1] - 256;
     }
 
   /* Otherwise, see if the character is in one of the special fonts. */
@@ -300,6 +434,7 @@ else
 
 /* Find the font number and ensure that it is made current */
 
+note_code(vf->afont, fr, code);
 fn = vf->pnumber + fr;
 if (setfont != fn)
   {
@@ -415,7 +550,29 @@ Returns:    nothing
 static void
 init_page(uschar *pageid)
 {
-if (!suppress) ++page_count;    /* Number of actual pages written */
+Ustrncpy(page_id, pageid, sizeof(page_id) - 1);
+if (tracking) ++page_count;     /* Will be written by a parallel worker */
+else if (!suppress)
+  {
+  ++page_count;                 /* Number of actual pages written */
+  if (outfile == spool_file && spool_file != NULL)
+    {
+    if (spool_pages >= spool_offsets_size)
+      {
+      int newsize = (spool_offsets_size == 0)? 256 : spool_offsets_size * 2;
+      long *newoffsets = misc_malloc(newsize * sizeof(long));
+      if (spool_pages > 0)
+        {
+        memcpy(newoffsets, spool_offsets, spool_pages * sizeof(long));
+        misc_free(spool_offsets, spool_offsets_size * sizeof(long));
+        }
+      spool_offsets = newoffsets;
+      spool_offsets_size = newsize;
+      }
+    flush_run();
+    spool_offsets[spool_pages++] = ftell(spool_file);
+    }
+  }
 
 (void)cprintf("%%%%Page: %s %d\n", pageid, page_count);
 (void)cprintf("%%%%BeginPageSetup\n");
@@ -518,7 +675,7 @@ the correct numbers for them. If there are more than 9 footnotes, the layout
 may be poor. There is an attempt to compensate for this when we output the page
 below, and that may help for stretched lines. */
 
-if (!suppress && !do_fn)
+if ((!suppress || tracking) && !do_fn)
   {
   for (i = pagestart->next;
        i != NULL && Ustrcmp(i->name, "#PDATA") != 0;
@@ -555,7 +712,7 @@ if (!suppress && !do_fn)
       { if (Ustrcmp(p->name, "linkend") == 0) break; }
     if (p == NULL) continue;
 
-    tn = tree_search(id_tree, p->value);
+    tn = hash_search(id_table, p->value);
     if (tn == NULL) continue;
 
     /* We have a <footnote> item; scan for its reference */
@@ -606,9 +763,12 @@ if (!suppress && !do_fn)
   }
 
 /* Now process the page's items for output. If the page is being suppressed,
-all we need do is keep track of the current file name and line number. We need
-to recount the footnotes so as to be able to try to compensate for bad spacing
-when there are more than 9. */
+all we need do is keep track of the current file name and line number, unless
+it is being tracked for a parallel writer (see write_body_parallel() below), in
+which case everything is processed so that state that carries over from page
+to page (list numbering, for instance) is kept up to date. We need to recount
+the footnotes so as to be able to try to compensate for bad spacing when there
+are more than 9. */
 
 nextfn = 0;
 for (i = pagestart->next;
@@ -629,7 +789,7 @@ for (i = pagestart->next;
 
   /* No need to do more if suppressing */
 
-  if (suppress) continue;
+  if (suppress && !tracking) continue;
 
   /* If not processing foonotes, skip footnotes */
 
@@ -741,7 +901,9 @@ for (i = pagestart->next;
       {
       if (Ustrcmp(j->name, "imageobject") == 0)
         {
-        int depth = suppress? 0 : object_write_image(j, ypos, outfile,
+        int depth;
+        flush_run();
+        depth = object_write_image(j, ypos, suppress? NULL : outfile,
           &object_width, &object_justify);
         if (depth >= 0)
           {
@@ -957,7 +1119,7 @@ for (i = pagestart->next;
 
   if (Ustrcmp(name, "tgroup") == 0)
     {
-    if (td == NULL) (void)error(43, "<tgroup>"); else
+    if (td == NULL) { if (!tracking) (void)error(43, "<tgroup>"); } else
       {
       paramstr *p = misc_param_find(i, US"rowsep");
       tgrouprowsep = tablerowsep;
@@ -971,7 +1133,7 @@ for (i = pagestart->next;
 
   if (Ustrcmp(name, "row") == 0)
     {
-    if (td == NULL) (void)error(43, "<row>"); else
+    if (td == NULL) { if (!tracking) (void)error(43, "<row>"); } else
       {
       paramstr *p = misc_param_find(i, US"rowsep");
       thisrowsep = tgrouprowsep;
@@ -1042,7 +1204,9 @@ for (i = pagestart->next;
 
         char *endptr;
         unsigned int ucode = Ustrtoul(markname + 1, &endptr, 16);
-        if (*endptr != 0) error(66, markname); else listcount = -ucode;
+        if (*endptr != 0)
+          { if (!tracking) error(66, markname); }
+        else listcount = -ucode;
         }
       }
     if (listcount == 0)
@@ -1084,7 +1248,7 @@ for (i = pagestart->next;
       else if (Ustrcmp(p->value, "lowerroman") == 0) listnumeration = LN_roman;
       else if (Ustrcmp(p->value, "upperalpha") == 0) listnumeration = LN_ALPHA;
       else if (Ustrcmp(p->value, "upperroman") == 0) listnumeration = LN_ROMAN;
-      else error(67, p->value);
+      else if (!tracking) error(67, p->value);
       }
     liststack[liststackptr++] = listcount;
     listcount = +1;
@@ -1125,7 +1289,7 @@ for (i = pagestart->next;
 
   if (Ustrcmp(name, "entry") == 0)
     {
-    if (td == NULL) (void)error(43, "<entry>"); else
+    if (td == NULL) { if (!tracking) (void)error(43, "<entry>"); } else
       {
       if (colnum++ == 0)
         {
@@ -1148,9 +1312,10 @@ for (i = pagestart->next;
 
   /* If this is a figure or table title, adjust the indent according to the
   width of the figure or table, not the page. If object_justify is unset, we
-  haven't seen an object for this figure. */
+  haven't seen an object for this figure. The indents are left alone when a
+  page is being tracked, because it is written by another process. */
 
-  if ((i->flags & (IF_FIGTITLE|IF_TABTITLE)) != 0)
+  if (!tracking && (i->flags & (IF_FIGTITLE|IF_TABTITLE)) != 0)
     {
     int para_justify = (pg->justify != J_UNSET)? pg->justify :
       pg->layparm->justify;
@@ -1213,7 +1378,7 @@ for (i = pagestart->next;
 
   /* If we are in a table, add in any overall indent. */
 
-  if (td != NULL && td->indent != 0)
+  if (!tracking && td != NULL && td->indent != 0)
     {
     for (ol = pg->out; ol != NULL; ol = ol->next)
       ol->indent += td->indent;
@@ -1271,7 +1436,7 @@ for (i = pagestart->next;
     if (ypos < 0 && (td == NULL || colnum >= td->colcount))
       {
       uschar buff[64];
-      (void)error(26, page_count);
+      if (!tracking) (void)error(26, page_id);
       (void)cprintf("\npagesave restore showpage\n"
                     "%%%%PageTrailer\n\n");
       (void)sprintf(CS buff, "XX-%d", ++overflow_page_count);
@@ -1381,10 +1546,7 @@ for (i = pagestart->next;
             (void)cprintf(")S\n(");
             ccount = 1;
             }
-          ccount += cprintf(
-            (code == '(' || code == ')' || code == '\\')? "\\%c" :
-            (code >= 32  && code <= 126)? "%c" : "\\%03o",
-            code);
+          ccount += cputcode(code);
           }
         ccount += cprintf(")show ");
         }
@@ -1392,6 +1554,15 @@ for (i = pagestart->next;
       marklistitem = FALSE;
       }
 
+    /* When a page is being tracked, nothing more is needed than the vertical
+    position, which decides whether the page overflows. */
+
+    if (tracking)
+      {
+      if (ypos < ytablelow) ytablelow = ypos;
+      continue;
+      }
+
     /* If there is any text in the line and the first textblock is a footnote
     key definition, output the next number at the lefthand side and then move
     on. Then position for printing the text, but there's no need to position if
@@ -1403,13 +1574,17 @@ for (i = pagestart->next;
       {
       if ((tb->pin_flags & PIN_FNKEYDEF) != 0)
         {
+        uschar *s;
+        uschar buffer[12];
         (void)set_font(tb->vfont, '0', US"", &chfont, &inaux);
+        (void)sprintf(CS buffer, "%d", ++nextfn);
+        for (s = buffer; *s != 0; s++) note_code(tb->vfont->afont, 0, *s);
         ccount += cprintf("%s ", misc_formatfixed(margin_left));
-        ccount += cprintf("%s Mt (%d)S ",
-          misc_formatfixed(ypos + ol->depth/3), ++nextfn);
+        ccount += cprintf("%s Mt (%s)S ",
+          misc_formatfixed(ypos + ol->depth/3), buffer);
         tb =  tb->next;
         }
-      if (tb != NULL && (tb->string[0] != 0 || tb->next != NULL))
+      if (tb != NULL && (tb->length > 0 || tb->next != NULL))
         {
         ccount += cprintf("%s ", misc_formatfixed(indent));
         ccount += cprintf("%s Mt", misc_formatfixed(ypos));
@@ -1450,7 +1625,8 @@ for (i = pagestart->next;
       BOOL instring = FALSE;
       BOOL kerning = (tb->pin_flags & PIN_KERN) != 0;
       BOOL fiok = tb->vfont->afont->hasfi && !tb->vfont->afont->fixedpitch;
-      uschar *p = tb->string;
+      uschar *p = TBTEXT(tb);
+      uschar *pend = p + ((tb->slice != NULL)? tb->length : Ustrlen(p));
 
       check_colour(tb->colour);
       if ((tb->pin_flags & PIN_REVCH) != 0) changed = TRUE;
@@ -1501,17 +1677,21 @@ for (i = pagestart->next;
         ccount += cprintf(" 0 %s RMt", misc_formatfixed(ypos_adjust));
         }
 
-      while (*p != 0)
+      while (p < pend)
         {
         int code;
         GETCHARINC(c, p);
 
+        /* A newline in the text of a filled line is printed as a space. */
+
+        if (c == '\n') c = ' ';
+
         /* Handle special cases, in standardly encoded fonts only */
 
         if (tb->vfont->afont->stdencoding) switch (c)
           {
           case 'f':
-          if (*p == 'i' && fiok)
+          if (p < pend && *p == 'i' && fiok)
             {
             c = CHAR_FI;
             p++;
@@ -1521,7 +1701,7 @@ for (i = pagestart->next;
           /* A soft hyphen prints only if it is at the end of a line */
 
           case SOFT_HYPHEN:
-          if (*p != 0 || tb->next != NULL) continue;
+          if (p < pend || tb->next != NULL) continue;
           break;
 
           /* A hard space is printed as a space, and can be stretched. */
@@ -1608,10 +1788,7 @@ for (i = pagestart->next;
 
         /* Output the character */
 
-        ccount += cprintf(
-          (code == '(' || code == ')' || code == '\\')? "\\%c" :
-          (code >= 32  && code <= 126)? "%c" : "\\%03o",
-          code);
+        ccount += cputcode(code);
 
         /* Cannot kern with the next if this is a space, or printed from an
         auxiliary font. */
@@ -1705,10 +1882,7 @@ for (i = pagestart->next;
                 (void)cprintf(")S\n(");
                 ccount = 1;
                 }
-              ccount += cprintf(
-                (code == '(' || code == ')' || code == '\\')? "\\%c" :
-                (code >= 32  && code <= 126)? "%c" : "\\%03o",
-                code);
+              ccount += cputcode(code);
               }
             }
 
@@ -1999,7 +2173,8 @@ for (i = item_list; i != NULL; i = i->next)
     for (tb = ol->txtblk; tb != NULL; tb = ntb)
       {
       ntb = tb->next;
-      misc_free(tb, sizeof(textblock) + tb->length);
+      misc_free(tb, sizeof(textblock) +
+        ((tb->slice == NULL)? tb->length : 0));
       }
     misc_free(ol, sizeof(outputline));
     }
@@ -2271,141 +2446,573 @@ main_headfoot = main_headfoot_default;
 
 
 /*************************************************
-*             Write the output file              *
+*       Free the formatted data for a page       *
 *************************************************/
 
-/*
-Argument:     the name of the output file
-Returns:      TRUE/FALSE
+/* When the output is being streamed, the formatted lines of a body page are
+no longer needed once it has been written. The items themselves are kept,
+because the index and the TOC are made from them later, and the input
+textblocks are shared with the #PCDATA items.
+
+Argument:   the #PDATA item that starts the page
+Returns:    nothing
+*/
+
+static void
+free_page_output(item *i)
+{
+for (i = i->next; i != NULL && Ustrcmp(i->name, "#PDATA") != 0; i = i->next)
+  {
+  paragraph *pp;
+  outputline *ol, *nol;
+
+  if (Ustrcmp(i->name, "#PCPARA") != 0) continue;
+  pp = i->p.prgrph;
+
+  for (ol = pp->out; ol != NULL; ol = nol)
+    {
+    textblock *tb, *ntb;
+    nol = ol->next;
+    for (tb = ol->txtblk; tb != NULL; tb = ntb)
+      {
+      ntb = tb->next;
+      misc_free(tb, sizeof(textblock) +
+        ((tb->slice == NULL)? tb->length : 0));
+      }
+    misc_free(ol, sizeof(outputline));
+    }
+
+  pp->out = NULL;
+  }
+}
+
+
+
+/*************************************************
+*        Write completed pages when streaming    *
+*************************************************/
+
+/* This is called after each page or chunk of the main text has been
+paginated. It writes the body pages that are complete to the spool file, and
+frees their formatted data. The last #PDATA item that pagination has inserted
+starts the page that is still being filled, so writing stops there, unless this
+is the final call. When pagination has paused, that #PDATA item is found by
+searching back from where it paused, which is quick; otherwise the chain is
+searched from the next page to be written. Because the writer moves the title
+of a figure to the end of the figure, a page on which a figure starts is not
+written until the whole figure has been paginated; otherwise a title could be
+moved into text that has not yet been paginated. Pagination and writing both
+use the multicolumn variables and the current input file name, so the writer's
+values are kept separately.
+
+Arguments:
+  all         TRUE if all the remaining pages are to be written
+  paused      the item at which pagination paused, or NULL
+
+Returns:      TRUE
 */
 
 BOOL
-write_file(uschar *filename)
+write_stream_pages(BOOL all, item *paused)
 {
-int afontnumber, pagenumber, vfontcount;
 item *i;
-FILE *ph;
-time_t timer;
-afontstr *af;
-vfontstr *vf;
-pdfmarkstr *pdf;
-uschar buffer[1024];
-uschar arabic[12];
-uschar roman[12];
+item *stop = NULL;
+FILE *save_outfile = outfile;
+uschar *save_arabicpage = arabicpage;
+uschar *save_romanpage = romanpage;
+int save_columns = page_columns;
+int save_colsep = page_colsep;
+uschar *save_filename = read_filename;
 
-arabicpage = arabic;
-romanpage = roman;
+if (spool_file == NULL)
+  {
+  spool_file = tmpfile();
+  if (spool_file == NULL)  /* Hard */
+    (void)error(0, US"(temporary)", "page spool file", strerror(errno));
+  page_count = 0;
+  main_headfoot = main_headfoot_default;
+  stream_columns = 1;
+  stream_colsep = DEFAULT_PAGE_COLSEP;
+  stream_next = main_item_list->next;
+  stream_pagenumber = 0;
+  stream_filename = read_filename;
+  chaptertitle = chapternumber = NULL;
+  sectiontitle = sectionnumber = NULL;
+  chaptitblock = secttitblock = NULL;
+  }
 
-/* Set up the output file. */
+if (all) stop = NULL;
 
-if (filename == NULL || Ustrcmp(filename, "-") == 0)
+else if (paused != NULL)
   {
-  DEBUG(D_any) debug_printf("==> Writing to stdout\n");
-  outfile = stdout;
+  for (stop = paused; stop != NULL && stop != stream_next; stop = stop->prev)
+    if (Ustrcmp(stop->name, "#PDATA") == 0) break;
+
+  for (i = stream_next; i != NULL && i != stop; i = i->next)
+    {
+    item *j;
+    if (Ustrcmp(i->name, "figure") != 0) continue;
+    for (j = i; j != i->partner && j != paused; j = j->next);
+    if (j != paused) continue;
+    for (stop = i; stop != stream_next; stop = stop->prev)
+      if (Ustrcmp(stop->name, "#PDATA") == 0) break;
+    break;
+    }
   }
+
 else
   {
-  DEBUG(D_any) debug_printf("==> Writing to %s\n", filename);
-  outfile = Ufopen(filename, "wb");
-  if (outfile == NULL)
-    (void)error(0, filename, "output file", strerror(errno));  /* Hard error */
+  for (i = stream_next; i != NULL; i = i->next)
+    if (Ustrcmp(i->name, "#PDATA") == 0) stop = i;
   }
 
+flush_run();
+outfile = spool_file;
+arabicpage = stream_arabic;
+romanpage = stream_roman;
+page_columns = stream_columns;
+page_colsep = stream_colsep;
+read_filename = stream_filename;
 
-/* Before we do the real output, we do a dummy run through the preface and body
-pages, with suppress forced. This has the effect of processing the heads and
-feet, which may contain text from chapter or section titles. This may include
-characters that require additional vfonts to be bound (e.g. special
-characters); the initial scan of the head/foot lines won't have picked these
-up. Processing the head/foot as a table causes font_charwidth() to be called
-for all the characters, and this has the effect of setting up any missing
-vfonts. */
+i = stream_next;
+while (i != NULL && i->next != NULL && i != stop)
+  {
+  item *nexti;
+  (void)sprintf(CS arabicpage, "%d", ++stream_pagenumber);
+  (void)misc_roman(romanpage, stream_pagenumber);
+  suppress = !okpage(stream_pagenumber, FALSE);
+  margin_left = ((stream_pagenumber & 1) == 0)?
+    margin_left_recto : margin_left_verso;
+  nexti = write_pbody_page(i, stream_pagenumber, arabicpage, &main_headfoot,
+    main_head_item_list, main_foot_item_list);
+  free_page_output(i);
+  i = nexti;
+  }
 
-set_pagedata_defaults();
-pagenumber = 0;
-suppress = TRUE;
+DEBUG(D_any) debug_printf("Streamed %d body pages: memory in use = %d\n",
+  stream_pagenumber, memory_used);
 
-/* ---------- DUMMY: The preface pages ---------- a*/
+stream_next = i;
+stream_columns = page_columns;
+stream_colsep = page_colsep;
+stream_filename = read_filename;
 
-if (preface_item_list != NULL)
-  {
-  chaptertitle = chapternumber = NULL;
-  sectiontitle = sectionnumber = NULL;
-  chaptitblock = secttitblock = NULL;
+flush_run();
+outfile = save_outfile;
+arabicpage = save_arabicpage;
+romanpage = save_romanpage;
+page_columns = save_columns;
+page_colsep = save_colsep;
+read_filename = save_filename;
+suppress = FALSE;
+return TRUE;
+}
 
-  i = preface_item_list->next;       /* The first #PDATA (page data) item */
 
-  DEBUG(D_any) if (i != NULL) debug_printf("Dummy scan of preface\n");
 
-  while (i != NULL && i->next != NULL)
+/*************************************************
+*       Copy the spooled pages to the output     *
+*************************************************/
+
+/* The spooled body pages are copied after the front matter, with the ordinal
+in each %%Page line increased by the number of pages that precede them.
+
+Argument:     the number of pages already written
+Returns:      nothing
+*/
+
+static void
+copy_spool(int pageoffset)
+{
+int n = 0;
+long pos = 0;
+uschar buffer[1024];
+
+flush_run();
+rewind(spool_file);
+
+for (;;)
+  {
+  long next = (n < spool_pages)? spool_offsets[n] : LONG_MAX;
+  uschar *p;
+
+  while (pos < next)
     {
-    (void)sprintf(CS arabicpage, "%d", ++pagenumber);
-    (void)misc_roman(romanpage, pagenumber);
-    margin_left = ((pagenumber & 1) == 0)? margin_left_recto:margin_left_verso;
-    i = write_pbody_page(i, pagenumber, romanpage, &preface_headfoot,
-      preface_head_item_list, preface_foot_item_list);
+    size_t want = (next - pos > (long)sizeof(buffer))?
+      sizeof(buffer) : (size_t)(next - pos);
+    size_t got = fread(buffer, 1, want, spool_file);
+    if (got == 0) break;
+    (void)fwrite(buffer, 1, got, outfile);
+    pos += got;
     }
+
+  if (n++ >= spool_pages ||
+      Ufgets(buffer, sizeof(buffer), spool_file) == NULL) break;
+
+  p = Ustrrchr(buffer, ' ');
+  (void)fprintf(outfile, "%.*s %d\n", (int)(p - buffer), CS buffer,
+    Uatoi(p + 1) + pageoffset);
+  pos = ftell(spool_file);
   }
 
-/* ------ DUMMY: The main body pages, appendices, indexes, colophons ------ */
+(void)fclose(spool_file);
+spool_file = NULL;
+}
+
+
 
-chaptertitle = chapternumber = NULL;
-sectiontitle = sectionnumber = NULL;
-chaptitblock = secttitblock = NULL;
+/*************************************************
+*         Write some main body pages             *
+*************************************************/
 
-i = main_item_list->next;       /* The first #PDATA (page data) item */
+/* This writes (or tracks, for the parallel writer) a number of pages from the
+main body, appendices, indexes and colophons.
 
-DEBUG(D_any) if (i != NULL) debug_printf("Dummy scan of main body etc.\n");
+Arguments:
+  i           the #PDATA item for the first page
+  pnptr       points to the page number of the previous page; updated
+  count       the number of pages, or -1 for all the rest
+  track       TRUE to track the pages (that are not otherwise suppressed)
+                instead of writing them
 
-while (i != NULL && i->next != NULL)
+Returns:      the #PDATA item for the next page
+*/
+
+static item *
+write_main_pages(item *i, int *pnptr, int count, BOOL track)
+{
+int pagenumber = *pnptr;
+
+while (i != NULL && i->next != NULL && count-- != 0)
   {
   (void)sprintf(CS arabicpage, "%d", ++pagenumber);
   (void)misc_roman(romanpage, pagenumber);
-  margin_left = ((pagenumber & 1) == 0)? margin_left_recto : margin_left_verso;
+  suppress = !okpage(pagenumber, FALSE);
+  if (track && !suppress) suppress = tracking = TRUE;
+  margin_left = ((pagenumber & 1) == 0)? margin_left_recto:margin_left_verso;
   i = write_pbody_page(i, pagenumber, arabicpage, &main_headfoot,
     main_head_item_list, main_foot_item_list);
+  tracking = FALSE;
   }
 
+*pnptr = pagenumber;
+return i;
+}
 
-/* ------ REAL ------ */
 
-/* Re-initialize things and output the beginning of the PostScript. */
 
-set_pagedata_defaults();
-time(&timer);
-suppress = FALSE;
+/*************************************************
+*          Copy a temporary file                 *
+*************************************************/
 
-(void)cprintf("%%!PS-Adobe-3.0\n");
-(void)cprintf("%%%%Creator: SDoP %s\n", SDOP_VERSION);
-(void)cprintf("%%%%CreationDate: %s", ctime(&timer));
-(void)cprintf("%%%%Pages: (atend)\n");
+/* This is used for the parallel writers' output and messages, and for font
+subsets and the pages when fonts are embedded. The file is closed.
+
+Arguments:
+  f           the temporary file
+  to          where to copy it
+
+Returns:      nothing
+*/
 
-(void)cprintf("%%%%DocumentNeededResources:\n");
+static void
+copy_temp_file(FILE *f, FILE *to)
+{
+size_t n;
+uschar buffer[8192];
+
+rewind(f);
+while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+  (void)fwrite(buffer, 1, n, to);
+(void)fclose(f);
+}
+
+
+
+/*************************************************
+*    Pass back the codes printed by a worker     *
+*************************************************/
+
+/* When fonts are embedded, each parallel writer saves the bit maps of the
+codes that it printed in each actual font, and the parent merges them into its
+own. The list of actual fonts is complete before the workers are started.
+
+Arguments:
+  f           a temporary file
+  save        TRUE in the worker, to save the maps;
+                FALSE in the parent, to merge them and close the file
+
+Returns:      nothing
+*/
+
+static void
+worker_glyphs(FILE *f, BOOL save)
+{
+afontstr *af;
+if (!save) rewind(f);
 for (af = afont_list; af != NULL; af = af->next)
   {
-  afontstr *bf;
-  for (bf = afont_list; bf != af; bf = bf->next)
-    { if (Ustrcmp(af->name, bf->name) == 0) break; }
-  if (af == bf) (void)cprintf("%%%%+ font %s\n", af->name);
+  int k;
+  unsigned int glyphs[16];
+  if (save)
+    {
+    (void)fwrite(af->glyphs, sizeof(af->glyphs), 1, f);
+    continue;
+    }
+  if (fread(glyphs, sizeof(glyphs), 1, f) != 1) break;
+  for (k = 0; k < 16; k++) af->glyphs[k] |= glyphs[k];
   }
+if (!save) (void)fclose(f);
+}
 
-(void)cprintf("%%%%Requirements: numcopies(1)\n");
-(void)cprintf("%%%%EndComments\n\n");
 
-/* Copy the PostScript header file, omitting any single-% comments and
-any blank lines. */
+
+/*************************************************
+*     Write the main body pages in parallel      *
+*************************************************/
+
+/* The pages are divided into ranges, one for each worker. Apart from the
+head/foot data, which is set up for every page whether it is written or not,
+the only state that carries over from one page to the next is the list
+numbering, the footnote numbers that <footnoteref> picks up from earlier
+pages, and the physical page count, which includes any extra pages that are
+started when a page overflows. These are kept up to date by "tracking" pages:
+processing them as if for output, including the vertical position of each line
+and image, but with the output suppressed and the text of the lines skipped,
+which is cheaper than writing them. At the start of each range, a worker process is
+forked with the state as it is at that point. It writes its range of pages
+into a temporary file, while the parent tracks the pages in the range so that
+it can start the next worker, and so that its own state at the end is as if it
+had written all the pages. The workers' output and messages are then copied
+in order, so the result is the same as writing the pages one after another.
+When fonts are embedded, the codes that the workers printed are collected too.
+
+Arguments:
+  i           the #PDATA item for the first page
+  workers     the number of workers
+
+Returns:      nothing
+*/
+
+static void
+write_body_parallel(item *i, int workers)
+{
+int k, pages;
+int pagenumber = 0;
+int pids[MAXWRITEWORKERS];
+int fds[MAXWRITEWORKERS];
+FILE *outs[MAXWRITEWORKERS];
+FILE *errs[MAXWRITEWORKERS];
+FILE *glyphs[MAXWRITEWORKERS];
+item *ii;
+
+/* Count the pages */
+
+pages = 0;
+for (ii = i; ii != NULL && ii->next != NULL; pages++)
+  {
+  for (ii = ii->next; ii != NULL; ii = ii->next)
+    if (Ustrcmp(ii->name, "#PDATA") == 0) break;
+  }
+
+if (workers > pages) workers = pages;
+if (workers < 2)
+  {
+  (void)write_main_pages(i, &pagenumber, -1, FALSE);
+  return;
+  }
+
+DEBUG(D_any) debug_printf("Writing %d pages with %d workers\n", pages,
+  workers);
+
+for (k = 0; k < workers; k++)
+  {
+  int first = (k * pages)/workers;
+  int last = ((k + 1) * pages)/workers;
+
+  i = write_main_pages(i, &pagenumber, first - pagenumber, TRUE);
+  flush_run();
+
+  outs[k] = tmpfile();
+  errs[k] = tmpfile();
+  glyphs[k] = embed_fonts? tmpfile() : NULL;
+  if (outs[k] == NULL || errs[k] == NULL || (embed_fonts && glyphs[k] == NULL))
+    (void)error(0, US"(temporary)", "parallel output file", strerror(errno));
+
+  pids[k] = sys_worker_start(errs[k], fds + k);
+  if (pids[k] < 0)
+    (void)error(0, US"(worker)", "parallel writing process", strerror(errno));
+
+  /* In the worker, write this range of pages and exit. */
+
+  if (pids[k] == 0)
+    {
+    outfile = outs[k];
+    (void)write_main_pages(i, &pagenumber, last - first, FALSE);
+    flush_run();
+    if (glyphs[k] != NULL) worker_glyphs(glyphs[k], TRUE);
+    sys_worker_finish(fds[k]);
+    }
+  }
+
+/* Track the final range, so that everything that was noticed while writing
+(for example, which processing instructions have been seen) is as it would
+be after writing serially. */
+
+(void)write_main_pages(i, &pagenumber, -1, TRUE);
+flush_run();
+
+/* Collect the workers' output in order, stopping after any that failed. */
+
+for (k = 0; k < workers; k++)
+  {
+  BOOL ok = sys_worker_wait(pids[k], fds[k]);
+  copy_temp_file(errs[k], stderr);
+  if (!ok)
+    {
+    (void)fprintf(stderr, "** SDoP processing abandoned\n");
+    exit(EXIT_FAILURE);
+    }
+  copy_temp_file(outs[k], outfile);
+  if (glyphs[k] != NULL) worker_glyphs(glyphs[k], FALSE);
+  }
+}
+
+
+
+/*************************************************
+*          Read the PostScript header            *
+*************************************************/
+
+/* The header file is read just once, omitting any single-% comments and any
+blank lines. This is called when writing the output, and also when the render
+server starts up.
+
+Arguments:    none
+Returns:      TRUE
+*/
+
+BOOL
+write_load_psheader(void)
+{
+FILE *ph;
+int size = 4096;
+int length = 0;
+uschar buffer[1024];
+
+if (psheader != NULL) return TRUE;
 
 (void)misc_find_share(US"PSheader", buffer, TRUE);
 ph = Ufopen(buffer, "rb");
 if (ph == NULL)  /* Hard */
   (void)error(0, buffer, "PostScript header file", strerror(errno));
 
+psheader = misc_malloc(size);
 while (Ufgets(buffer, sizeof(buffer), ph) != NULL)
   {
+  int len;
   if (buffer[0] == '\n' || (buffer[0] == '%' && buffer[1] != '%')) continue;
-  (void)cprintf("%s", CS buffer);
+  len = Ustrlen(buffer);
+  if (length + len >= size)
+    {
+    uschar *newheader = misc_malloc(size * 2);
+    memcpy(newheader, psheader, length);
+    misc_free(psheader, size);
+    psheader = newheader;
+    size *= 2;
+    }
+  memcpy(psheader + length, buffer, len);
+  length += len;
   }
+psheader[length] = 0;
 (void)fclose(ph);
+return TRUE;
+}
+
+
+
+/*************************************************
+*        Write the beginning of the output       *
+*************************************************/
+
+/* This writes the DSC comments, the PostScript header, and the setup, which
+defines the fonts. When fonts are embedded, this is called after the pages
+have been written, and the subsets are made first, so that the comments can
+say which fonts are supplied. If there are several actual fonts with the same
+name, the codes that are printed in all of them are put in one subset.
+
+Arguments:   none
+Returns:     nothing
+*/
+
+static void
+write_setup(void)
+{
+int afontnumber, vfontcount, n, supplied;
+int afontcount = 0;
+time_t timer;
+afontstr *af;
+vfontstr *vf;
+pdfmarkstr *pdf;
+FILE **subsets = NULL;
+
+(void)write_load_psheader();
+
+if (embed_fonts)
+  {
+  for (af = afont_list; af != NULL; af = af->next) afontcount++;
+  subsets = misc_malloc(afontcount * sizeof(FILE *));
+  for (af = afont_list, n = 0; af != NULL; af = af->next, n++)
+    {
+    afontstr *bf;
+    subsets[n] = NULL;
+    for (bf = afont_list; bf != af; bf = bf->next)
+      { if (Ustrcmp(af->name, bf->name) == 0) break; }
+    if (bf != af) continue;
+    for (bf = af->next; bf != NULL; bf = bf->next)
+      {
+      int k;
+      if (Ustrcmp(af->name, bf->name) != 0) continue;
+      for (k = 0; k < 16; k++) af->glyphs[k] |= bf->glyphs[k];
+      }
+    subsets[n] = embed_subset(af, psheader);
+    }
+  }
+
+time(&timer);
+
+(void)cprintf("%%!PS-Adobe-3.0\n");
+(void)cprintf("%%%%Creator: SDoP %s\n", SDOP_VERSION);
+(void)cprintf("%%%%CreationDate: %s", ctime(&timer));
+(void)cprintf("%%%%Pages: (atend)\n");
+
+/* List the fonts that are needed, and those that are supplied. */
+
+for (supplied = 0; supplied < 2; supplied++)
+  {
+  const char *comment = (supplied == 0)?
+    "%%%%DocumentNeededResources:\n" : "%%%%DocumentSuppliedResources:\n";
+  if (supplied == 1 && subsets == NULL) break;
+  for (af = afont_list, n = 0; af != NULL; af = af->next, n++)
+    {
+    afontstr *bf;
+    if ((subsets != NULL && subsets[n] != NULL) != (supplied == 1)) continue;
+    for (bf = afont_list; bf != af; bf = bf->next)
+      { if (Ustrcmp(af->name, bf->name) == 0) break; }
+    if (af != bf) continue;
+    if (comment != NULL) (void)cprintf(comment);
+    comment = NULL;
+    (void)cprintf("%%%%+ font %s\n", af->name);
+    }
+  if (comment != NULL && subsets == NULL) (void)cprintf(comment);
+  }
+
+(void)cprintf("%%%%Requirements: numcopies(1)\n");
+(void)cprintf("%%%%EndComments\n\n");
+
+/* Copy the PostScript header. */
+
+(void)cprintf("%s", CS psheader);
 
 /* Do the font binding in the general setup section. */
 
@@ -2500,12 +3107,20 @@ if (pages_even && pages_odd && pages_main == NULL && pages_front == NULL)
     }
   }
 
-/* Find and possibly re-encode the actual fonts. */
+/* Find or embed, and possibly re-encode, the actual fonts. */
 
 afontnumber = 0;
-for (af = afont_list; af != NULL; af = af->next)
+for (af = afont_list, n = 0; af != NULL; af = af->next, n++)
   {
-  (void)cprintf("%%%%IncludeResource: font %s\n", af->name);
+  if (subsets == NULL || subsets[n] == NULL)
+    (void)cprintf("%%%%IncludeResource: font %s\n", af->name);
+  else
+    {
+    (void)cprintf("%%%%BeginResource: font %s\n", af->name);
+    flush_run();
+    copy_temp_file(subsets[n], outfile);
+    (void)cprintf("%%%%EndResource\n");
+    }
   (void)cprintf("/af%d /af%d /%s inf\n", afontnumber, afontnumber+1,
     af->name);
   af->psnumber = afontnumber;
@@ -2514,24 +3129,168 @@ for (af = afont_list; af != NULL; af = af->next)
 
 /* Now, for each vfont that is actually used, scale the appropriate fonts
 and put them into an array. For each vfont there may be two PostScript fonts,
-to allow for more than 256 characters. */
+to allow for more than 256 characters. The numbers were allocated in chain
+order when the vfonts were first used. */
 
 vfontcount = 0;
 for (vf = vfont_list; vf != NULL; vf = vf->next) vfontcount++;
 
 (void)cprintf("/vf %d array def\n", vfontcount * 2);
 
-vfontcount = 0;
 for (vf = vfont_list; vf != NULL; vf = vf->next)
   {
-  vf->pnumber = vfontcount;
-  (void)cprintf("vf %d af%d %s scalefont put\n", vfontcount++,
+  (void)cprintf("vf %d af%d %s scalefont put\n", vf->pnumber,
     vf->afont->psnumber, misc_formatfixed(vf->size));
-  (void)cprintf("vf %d af%d %s scalefont put\n", vfontcount++,
+  (void)cprintf("vf %d af%d %s scalefont put\n", vf->pnumber + 1,
     vf->afont->psnumber + 1, misc_formatfixed(vf->size));
   }
 
 (void)cprintf("%%%%EndSetup\n\n");
+if (subsets != NULL) misc_free(subsets, afontcount * sizeof(FILE *));
+}
+
+
+
+/*************************************************
+*             Write the output file              *
+*************************************************/
+
+/*
+Argument:     the name of the output file
+Returns:      TRUE/FALSE
+*/
+
+BOOL
+write_file(uschar *filename)
+{
+int pagenumber;
+item *i;
+afontstr *af;
+FILE *realfile = NULL;
+uschar arabic[12];
+uschar roman[12];
+
+arabicpage = arabic;
+romanpage = roman;
+
+/* Set up the output file. */
+
+if (filename == NULL || Ustrcmp(filename, "-") == 0)
+  {
+  DEBUG(D_any) debug_printf("==> Writing to stdout\n");
+  outfile = stdout;
+  }
+else
+  {
+  DEBUG(D_any) debug_printf("==> Writing to %s\n", filename);
+  outfile = Ufopen(filename, "wb");
+  if (outfile == NULL)
+    (void)error(0, filename, "output file", strerror(errno));  /* Hard error */
+  }
+
+/* If the output is being streamed, write any body pages that are not yet in
+the spool file. */
+
+if (stream_output) (void)write_stream_pages(TRUE, NULL);
+
+
+/* Before we do the real output, we do a dummy run through the preface and body
+pages, with suppress forced. This has the effect of processing the heads and
+feet, which may contain text from chapter or section titles. This may include
+characters that require additional vfonts to be bound (e.g. special
+characters); the initial scan of the head/foot lines won't have picked these
+up. Processing the head/foot as a table causes font_charwidth() to be called
+for all the characters, and this has the effect of setting up any missing
+vfonts. */
+
+set_pagedata_defaults();
+pagenumber = 0;
+suppress = TRUE;
+stats_begin(US"dummy");
+
+/* ---------- DUMMY: The preface pages ---------- a*/
+
+if (preface_item_list != NULL)
+  {
+  chaptertitle = chapternumber = NULL;
+  sectiontitle = sectionnumber = NULL;
+  chaptitblock = secttitblock = NULL;
+
+  i = preface_item_list->next;       /* The first #PDATA (page data) item */
+
+  DEBUG(D_any) if (i != NULL) debug_printf("Dummy scan of preface\n");
+
+  while (i != NULL && i->next != NULL)
+    {
+    (void)sprintf(CS arabicpage, "%d", ++pagenumber);
+    (void)misc_roman(romanpage, pagenumber);
+    margin_left = ((pagenumber & 1) == 0)? margin_left_recto:margin_left_verso;
+    i = write_pbody_page(i, pagenumber, romanpage, &preface_headfoot,
+      preface_head_item_list, preface_foot_item_list);
+    }
+  }
+
+/* ------ DUMMY: The main body pages, appendices, indexes, colophons ------ */
+
+/* This is not needed when streaming, because the body pages have already been
+written. */
+
+if (!stream_output)
+  {
+  chaptertitle = chapternumber = NULL;
+  sectiontitle = sectionnumber = NULL;
+  chaptitblock = secttitblock = NULL;
+
+  i = main_item_list->next;       /* The first #PDATA (page data) item */
+
+  DEBUG(D_any) if (i != NULL) debug_printf("Dummy scan of main body etc.\n");
+
+  while (i != NULL && i->next != NULL)
+    {
+    (void)sprintf(CS arabicpage, "%d", ++pagenumber);
+    (void)misc_roman(romanpage, pagenumber);
+    margin_left = ((pagenumber & 1) == 0)? margin_left_recto:margin_left_verso;
+    i = write_pbody_page(i, pagenumber, arabicpage, &main_headfoot,
+      main_head_item_list, main_foot_item_list);
+    }
+  }
+
+(void)stats_end(TRUE);
+
+
+/* ------ REAL ------ */
+
+/* Re-initialize things and output the beginning of the PostScript. If any
+fonts are to be embedded, their subsets cannot be made until it is known which
+characters are printed, so the pages are written to a temporary file, and the
+beginning of the PostScript is written when they are finished. */
+
+stats_begin(US"setup");
+
+set_pagedata_defaults();
+suppress = FALSE;
+
+embed_fonts = FALSE;
+for (af = afont_list; af != NULL; af = af->next)
+  {
+  uschar buffer[FONTFILESIZE];
+  if (embed_find(af->name, buffer))
+    {
+    embed_fonts = TRUE;
+    break;
+    }
+  }
+
+if (!embed_fonts) write_setup(); else
+  {
+  flush_run();
+  realfile = outfile;
+  outfile = tmpfile();
+  if (outfile == NULL)
+    (void)error(0, US"(temporary)", "page output file", strerror(errno));
+  }
+
+(void)stats_end(TRUE);
 
 /* Now output the selected pages. */
 
@@ -2539,6 +3298,7 @@ for (vf = vfont_list; vf != NULL; vf = vf->next)
 /* ---------- The title pages ---------- */
 
 pagenumber = 0;                /* For title, TOC, preface */
+stats_begin(US"title");
 
 i = title_item_list->next;     /* The first #PDATA (page data) item */
 DEBUG(D_any) if (i != NULL) debug_printf("Writing title pages\n");
@@ -2558,8 +3318,12 @@ while (i != NULL && i->next != NULL)
   }
 
 
+(void)stats_end(TRUE);
+
+
 /* ---------- The TOC pages ---------- */
 
+stats_begin(US"toc");
 i = toc_item_list->next;       /* The first #PDATA (page data) item */
 
 DEBUG(D_any) if (i != NULL) debug_printf("Writing TOC\n");
@@ -2623,9 +3387,12 @@ while (i != NULL && i->next != NULL)
   i = nexti;
   }
 
+(void)stats_end(TRUE);
+
 
 /* ---------- The preface pages ---------- */
 
+stats_begin(US"preface");
 if (preface_item_list != NULL)
   {
   chaptertitle = chapternumber = NULL;
@@ -2647,33 +3414,63 @@ if (preface_item_list != NULL)
     }
   }
 
+(void)stats_end(TRUE);
+
 
 /* -------- The main body pages, appendices, indexes, colophons -------- */
 
-pagenumber = 0;                 /* Restart the numbering */
+/* When streaming, these are already in the spool file. */
+
+stats_begin(US"body");
 
-chaptertitle = chapternumber = NULL;
-sectiontitle = sectionnumber = NULL;
-chaptitblock = secttitblock = NULL;
+if (stream_output)
+  {
+  DEBUG(D_any) debug_printf("Copying %d spooled body pages\n", spool_pages);
+  copy_spool(page_count);
+  page_count += spool_pages;
+  read_filename = stream_filename;
+  }
 
-i = main_item_list->next;       /* The first #PDATA (page data) item */
+else
+  {
+  pagenumber = 0;                 /* Restart the numbering */
 
-DEBUG(D_any) if (i != NULL) debug_printf("Writing main body etc.\n");
+  chaptertitle = chapternumber = NULL;
+  sectiontitle = sectionnumber = NULL;
+  chaptitblock = secttitblock = NULL;
 
-while (i != NULL && i->next != NULL)
+  i = main_item_list->next;       /* The first #PDATA (page data) item */
+
+  DEBUG(D_any) if (i != NULL) debug_printf("Writing main body etc.\n");
+
+  if (write_workers > 1) write_body_parallel(i, write_workers);
+    else (void)write_main_pages(i, &pagenumber, -1, FALSE);
+  }
+
+(void)stats_end(TRUE);
+
+/* If fonts are being embedded, now write the beginning of the PostScript,
+followed by the pages. */
+
+suppress = FALSE;
+
+if (embed_fonts)
   {
-  (void)sprintf(CS arabicpage, "%d", ++pagenumber);
-  (void)misc_roman(romanpage, pagenumber);
-  suppress = !okpage(pagenumber, FALSE);
-  margin_left = ((pagenumber & 1) == 0)? margin_left_recto : margin_left_verso;
-  i = write_pbody_page(i, pagenumber, arabicpage, &main_headfoot,
-    main_head_item_list, main_foot_item_list);
+  FILE *pagefile;
+  stats_begin(US"fonts");
+  flush_run();
+  pagefile = outfile;
+  outfile = realfile;
+  write_setup();
+  flush_run();
+  copy_temp_file(pagefile, outfile);
+  (void)stats_end(TRUE);
   }
 
 /* Write terminating stuff and close the file. */
 
-suppress = FALSE;
 (void)cprintf("%%%%Trailer\n%%%%Pages: %d\n", page_count);
+flush_run();
 (void)fclose(outfile);
 
 DEBUG(D_any) debug_printf("Finished writing\n");